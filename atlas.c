@@ -0,0 +1,238 @@
+/**
+ * Many small images packed into one texture.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <SDL2/SDL_image.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atlas.h"
+#include "error.h"
+
+/* Transparent pixels between images, so filtering never picks up a
+ * neighbour. */
+#define ATLAS_PAD 1
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+/* Order the images tallest first, which keeps the shelves full. */
+static void atlas_sort(int *order, SDL_Surface ** surfaces, int n)
+{
+        for (int i = 0; i < n; i++) {
+                order[i] = i;
+        }
+        for (int i = 1; i < n; i++) {
+                int j, k = order[i];
+                for (j = i; j > 0 && surfaces[order[j - 1]]->h < surfaces[k]->h;
+                     j--) {
+                        order[j] = order[j - 1];
+                }
+                order[j] = k;
+        }
+}
+
+/* Lay the images out on shelves no wider than `w`. Returns the height
+ * used. */
+static int atlas_pack(SDL_Rect * rects, SDL_Surface ** surfaces,
+                      const int *order, int n, int w)
+{
+        int x = 0, y = 0, shelf_h = 0;
+
+        for (int i = 0; i < n; i++) {
+                SDL_Rect *rect = &rects[order[i]];
+                SDL_Surface *surface = surfaces[order[i]];
+
+                if (x + surface->w + ATLAS_PAD > w) {
+                        x = 0;
+                        y += shelf_h;
+                        shelf_h = 0;
+                }
+                rect->x = x + ATLAS_PAD;
+                rect->y = y + ATLAS_PAD;
+                rect->w = surface->w;
+                rect->h = surface->h;
+                x += surface->w + ATLAS_PAD;
+                shelf_h = max(shelf_h, surface->h + ATLAS_PAD);
+        }
+
+        return y + shelf_h + ATLAS_PAD;
+}
+
+/* Copy the alpha of part of the sheet. */
+static void atlas_read_alpha(atlas_t * atlas, SDL_Surface * sheet,
+                             const SDL_Rect * rect)
+{
+        for (int y = rect->y; y < rect->y + rect->h; y++) {
+                Uint32 *row = (Uint32 *) ((Uint8 *) sheet->pixels +
+                                          y * sheet->pitch);
+                for (int x = rect->x; x < rect->x + rect->w; x++) {
+                        Uint8 r, g, b;
+                        SDL_GetRGBA(row[x], sheet->format, &r, &g, &b,
+                                    &atlas->alpha[y * atlas->w + x]);
+                }
+        }
+}
+
+int atlas_init(atlas_t * atlas, SDL_Renderer * renderer, const char **files,
+               int n, int spare_h)
+{
+        SDL_Surface **surfaces, *sheet = NULL;
+        SDL_Rect all = { 0, 0, 0, 0 };
+        Uint32 format;
+        int *order, area = 0, max_w = 0, res = -1;
+
+        memset(atlas, 0, sizeof (*atlas));
+
+        surfaces = calloc(n, sizeof (SDL_Surface *));
+        order = malloc(n * sizeof (int));
+        atlas->rects = calloc(n, sizeof (SDL_Rect));
+        if (!surfaces || !order || !atlas->rects) {
+                res = ERROR_ALLOC;
+                goto done;
+        }
+        atlas->n_rects = n;
+
+        for (int i = 0; i < n; i++) {
+                if (!(surfaces[i] = IMG_Load(files[i]))) {
+                        printf("%s:IMG_Load:%s\n", __FUNCTION__,
+                               SDL_GetError());
+                        goto done;
+                }
+                area += (surfaces[i]->w + ATLAS_PAD) *
+                    (surfaces[i]->h + ATLAS_PAD);
+                max_w = max(max_w, surfaces[i]->w + 2 * ATLAS_PAD);
+        }
+
+        atlas_sort(order, surfaces, n);
+
+        /* Start with a square's width and widen until it is no taller than
+         * it is wide. */
+        atlas->w = 16;
+        while (atlas->w * atlas->w < area || atlas->w < max_w) {
+                atlas->w *= 2;
+        }
+        while ((atlas->h = atlas_pack(atlas->rects, surfaces, order, n,
+                                      atlas->w)) > atlas->w) {
+                atlas->w *= 2;
+        }
+        if (spare_h > 0) {
+                atlas->spare.y = atlas->h;
+                atlas->spare.w = atlas->w;
+                atlas->spare.h = spare_h;
+                atlas->h += spare_h;
+        }
+
+        if (!(sheet = SDL_CreateRGBSurfaceWithFormat(0, atlas->w, atlas->h, 32,
+                                                     SDL_PIXELFORMAT_RGBA32)))
+        {
+                printf("%s:SDL_CreateRGBSurfaceWithFormat:%s\n", __FUNCTION__,
+                       SDL_GetError());
+                goto done;
+        }
+        SDL_FillRect(sheet, NULL, 0);
+
+        /* Copy the alpha too instead of blending with the empty sheet. */
+        for (int i = 0; i < n; i++) {
+                SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+                SDL_BlitSurface(surfaces[i], NULL, sheet, &atlas->rects[i]);
+        }
+
+        if (!(atlas->texture = SDL_CreateTextureFromSurface(renderer, sheet))) {
+                printf("%s:SDL_CreateTextureFromSurface:%s\n", __FUNCTION__,
+                       SDL_GetError());
+                goto done;
+        }
+        SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+
+        if (!(atlas->alpha = malloc(atlas->w * atlas->h))) {
+                res = ERROR_ALLOC;
+                goto done;
+        }
+        all.w = atlas->w;
+        all.h = atlas->h;
+        atlas_read_alpha(atlas, sheet, &all);
+
+        /* Keep the sheet as the texture has it, so parts of it can be
+         * uploaded as they are. */
+        if (SDL_QueryTexture(atlas->texture, &format, NULL, NULL, NULL) ||
+            !(atlas->sheet = SDL_ConvertSurfaceFormat(sheet, format, 0))) {
+                printf("%s:SDL_ConvertSurfaceFormat:%s\n", __FUNCTION__,
+                       SDL_GetError());
+                goto done;
+        }
+        if (atlas->sheet->format->BytesPerPixel != 4) {
+                printf("%s:texture has %d bytes per pixel\n", __FUNCTION__,
+                       atlas->sheet->format->BytesPerPixel);
+                goto done;
+        }
+
+        printf("atlas %dx%d for %d images\n", atlas->w, atlas->h, n);
+        res = 0;
+
+done:
+        if (surfaces) {
+                for (int i = 0; i < n; i++) {
+                        if (surfaces[i]) {
+                                SDL_FreeSurface(surfaces[i]);
+                        }
+                }
+        }
+        if (sheet) {
+                SDL_FreeSurface(sheet);
+        }
+        free(surfaces);
+        free(order);
+        if (res) {
+                atlas_deinit(atlas);
+        }
+        return res;
+}
+
+void atlas_deinit(atlas_t * atlas)
+{
+        if (atlas->texture) {
+                SDL_DestroyTexture(atlas->texture);
+        }
+        if (atlas->sheet) {
+                SDL_FreeSurface(atlas->sheet);
+        }
+        free(atlas->rects);
+        free(atlas->alpha);
+        memset(atlas, 0, sizeof (*atlas));
+}
+
+int atlas_update(atlas_t * atlas, const SDL_Rect * rect)
+{
+        SDL_Surface *sheet = atlas->sheet;
+
+        if (SDL_UpdateTexture(atlas->texture, rect,
+                              (Uint8 *) sheet->pixels + rect->y * sheet->pitch +
+                              rect->x * 4, sheet->pitch)) {
+                printf("%s:SDL_UpdateTexture:%s\n", __FUNCTION__,
+                       SDL_GetError());
+                return -1;
+        }
+        atlas_read_alpha(atlas, sheet, rect);
+        atlas->version++;
+
+        return 0;
+}
+
+int atlas_reload(atlas_t * atlas, SDL_Renderer * renderer)
+{
+        SDL_Texture *texture;
+
+        if (!(texture = SDL_CreateTextureFromSurface(renderer, atlas->sheet))) {
+                printf("%s:SDL_CreateTextureFromSurface:%s\n", __FUNCTION__,
+                       SDL_GetError());
+                return -1;
+        }
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        SDL_DestroyTexture(atlas->texture);
+        atlas->texture = texture;
+        atlas->version++;
+
+        return 0;
+}
@@ -0,0 +1,53 @@
+/**
+ * Many small images packed into one texture.
+ *
+ * Drawing from one texture instead of one per image saves the renderer from
+ * switching textures between draws, and lets draws be batched. Images keep
+ * their index; `rects` has where each one ended up. A copy of the alpha
+ * channel stays in memory for finding which texels are see-through.
+ *
+ * The sheet stays in memory too, in the texture's format, for drawing from
+ * on the CPU. Rows can be left spare below the images for drawing into
+ * later, and changes to the sheet go up with atlas_update().
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef atlas_h
+#define atlas_h
+
+#include <SDL2/SDL.h>
+
+typedef struct {
+        SDL_Texture *texture;
+        SDL_Rect *rects;        /* one per image */
+        int n_rects;
+        int w, h;               /* of the texture */
+        Uint8 *alpha;           /* w * h, row by row */
+        SDL_Surface *sheet;     /* as the texture has it */
+        SDL_Rect spare;         /* empty if there aren't */
+        int version;            /* bumped when texels change */
+} atlas_t;
+
+/**
+ * Load `n` image files and pack them into a texture for `renderer`, with
+ * `spare_h` clear rows below them. Returns zero on success, -1 if loading
+ * failed, or ERROR_ALLOC.
+ */
+int atlas_init(atlas_t * atlas, SDL_Renderer * renderer, const char **files,
+               int n, int spare_h);
+void atlas_deinit(atlas_t * atlas);
+
+/**
+ * Send a changed part of the sheet to the texture and the alpha copy.
+ * Returns 0 or -1 if the renderer wouldn't take it.
+ */
+int atlas_update(atlas_t * atlas, const SDL_Rect * rect);
+
+/**
+ * Make the texture again from the sheet, like after the renderer lost its
+ * textures. The texture is a new one. Returns 0 or -1 if the renderer
+ * wouldn't make it.
+ */
+int atlas_reload(atlas_t * atlas, SDL_Renderer * renderer);
+
+#endif
@@ -0,0 +1,476 @@
+/**
+ * Benchmarks that run on an area without a renderer.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "conn.h"
+#include "crowd.h"
+#include "error.h"
+#include "flow.h"
+#include "hpa.h"
+#include "jps.h"
+#include "move.h"
+#include "path.h"
+#include "pool.h"
+
+#define BENCH_WALL 0xf5f0f3ff
+#define BENCH_FLOOR 0x8080f0ff
+#define BENCH_STAIRS(h) (0xf0f0f7ff | ((h) << 24))
+#define BENCH_MAX_PATH 4096
+#define BENCH_TICKS 100
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+/* Small deterministic generator so runs are comparable across machines. */
+static uint32_t bench_rand(uint32_t * state)
+{
+        *state = *state * 1664525u + 1013904223u;
+        return *state >> 8;
+}
+
+static int bench_range(uint32_t * state, int lo, int hi)
+{
+        return lo + (int)(bench_rand(state) % (uint32_t) (hi - lo));
+}
+
+/* A walled story of a building with a doorway, or a floor with a stairwell
+ * coming up from the story below. */
+static void bench_synth_story(area_t * area, int level, int x0, int y0, int w,
+                              int h, uint32_t * rng)
+{
+        for (int y = y0; y < y0 + h; y++) {
+                for (int x = x0; x < x0 + w; x++) {
+                        bool edge = (x == x0 || y == y0 || x == x0 + w - 1 ||
+                                     y == y0 + h - 1);
+                        area_set_pixel(area, level, x, y,
+                                       edge ? BENCH_WALL : BENCH_FLOOR);
+                }
+        }
+
+        /* Doorway on the ground floor. */
+        if (!level) {
+                area_set_pixel(area, level, x0 + bench_range(rng, 1, w - 1),
+                               y0 + h - 1, BENCH_FLOOR);
+                return;
+        }
+
+        /* Stairs climb one z unit per tile along a row of the story below,
+         * with a hole above them. Each story uses its own row so stairwells
+         * don't stack. */
+        for (int i = 1; i <= Z_PER_LEVEL; i++) {
+                area_set_pixel(area, level - 1, x0 + i, y0 + level,
+                               BENCH_STAIRS(i));
+                area_set_pixel(area, level, x0 + i, y0 + level, 0);
+        }
+}
+
+int bench_synth_area(area_t * area, int w, int h, int n_levels, uint32_t seed)
+{
+        uint32_t rng = seed;
+
+        for (int i = 0; i < n_levels; i++) {
+                map_t *map = map_create(w, h);
+                if (!map) {
+                        return ERROR_ALLOC;
+                }
+                area_add(area, map);
+        }
+
+        /* Grass with scattered walls. */
+        for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                        area_set_pixel(area, 0, x, y,
+                                       bench_range(&rng, 0, 20) ?
+                                       PIXEL_VALUE_GRASS : BENCH_WALL);
+                }
+        }
+
+        /* Buildings, some with upper stories. */
+        for (int n = w * h / 400; n > 0; n--) {
+                int bw = bench_range(&rng, Z_PER_LEVEL + 3, 17);
+                int bh = bench_range(&rng, 5, 17);
+                int stories = bench_range(&rng, 1, min(n_levels, bh - 2) + 1);
+                int x0, y0;
+
+                if (bw >= w || bh >= h) {
+                        break;
+                }
+                x0 = bench_range(&rng, 0, w - bw);
+                y0 = bench_range(&rng, 0, h - bh);
+                for (int level = 0; level < stories; level++) {
+                        bench_synth_story(area, level, x0, y0, bw, bh, &rng);
+                }
+        }
+
+        return 0;
+}
+
+/* Pick a random place to stand. */
+static bool bench_random_loc(area_t * area, uint32_t * rng, point_t loc)
+{
+        for (int tries = 0; tries < 1000; tries++) {
+                int x = bench_range(rng, 0, area_w(area));
+                int y = bench_range(rng, 0, area_h(area));
+                int level = bench_range(rng, 0, area->n_maps);
+                if (move_stand(area, x, y, level, loc)) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static double bench_ms(Uint64 start, Uint64 end)
+{
+        return (end - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+/* A path query, as answered by one of the path finders. */
+typedef int (*bench_find_fn) (void *finder, const point_t from,
+                              const point_t to, point_t * path, int max_path);
+
+static int bench_find_astar(void *finder, const point_t from, const point_t to,
+                            point_t * path, int max_path)
+{
+        return path_find(finder, from, to, path, max_path);
+}
+
+/* A* that skips goals in another component. */
+typedef struct {
+        path_finder_t *pf;
+        conn_index_t *conn;
+} bench_guarded_t;
+
+static int bench_find_guarded(void *finder, const point_t from,
+                              const point_t to, point_t * path, int max_path)
+{
+        bench_guarded_t *guarded = finder;
+
+        if (!conn_same(guarded->conn, from, to)) {
+                guarded->pf->expanded = 0;
+                return -1;
+        }
+        return path_find(guarded->pf, from, to, path, max_path);
+}
+
+static int bench_find_jps(void *finder, const point_t from, const point_t to,
+                          point_t * path, int max_path)
+{
+        return jps_find(finder, from, to, path, max_path);
+}
+
+static int bench_find_hpa(void *finder, const point_t from, const point_t to,
+                          point_t * path, int max_path)
+{
+        return hpa_find(finder, from, to, path, max_path);
+}
+
+/* Time one path finder over the same queries as the others. Returns the
+ * average number of nodes it expanded; with a nonzero `astar`, the average
+ * plain A* expanded, that is printed alongside. */
+static double bench_finder(area_t * area, const char *name,
+                           const char *method, bench_find_fn find,
+                           void *finder, const int *expanded,
+                           point_t(*ends)[2], int n_queries, double astar)
+{
+        static point_t path[BENCH_MAX_PATH];
+        int found = 0;
+        double total = 0, length = 0;
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int i = 0; i < n_queries; i++) {
+                int len = find(finder, ends[i][0], ends[i][1], path,
+                               BENCH_MAX_PATH);
+                total += *expanded;
+                if (len > 0) {
+                        found++;
+                        length += len;
+                }
+        }
+        Uint64 end = SDL_GetPerformanceCounter();
+        double secs = (double)(end - start) / SDL_GetPerformanceFrequency();
+
+        printf("%s %s (%dx%dx%d): %d queries, %.1f queries/sec, "
+               "%.1f avg expanded", name, method, area_w(area), area_h(area),
+               area->n_maps, n_queries, n_queries / secs, total / n_queries);
+        if (astar > 0) {
+                printf(" (%.2fx astar)", total / n_queries / astar);
+        }
+        printf(", %d found, %.1f avg length\n", found,
+               found ? length / found : 0.0);
+        return total / n_queries;
+}
+
+void bench_path(area_t * area, const char *name, int n_queries)
+{
+        path_finder_t pf;
+        conn_index_t conn;
+        bench_guarded_t guarded = { &pf, &conn };
+        hpa_t hpa;
+        jps_t jps;
+        uint32_t rng = 1;
+        point_t (*ends)[2] = NULL;
+        Uint64 t0, t1, t2;
+        double astar;
+
+        memset(&pf, 0, sizeof (pf));
+        memset(&conn, 0, sizeof (conn));
+        memset(&hpa, 0, sizeof (hpa));
+        memset(&jps, 0, sizeof (jps));
+
+        if (path_init(&pf, area)) {
+                printf("%s: out of memory\n", name);
+                goto done;
+        }
+        t0 = SDL_GetPerformanceCounter();
+        if (conn_init(&conn, area)) {
+                printf("%s: out of memory\n", name);
+                goto done;
+        }
+        t1 = SDL_GetPerformanceCounter();
+        if (hpa_init(&hpa, area)) {
+                printf("%s: out of memory\n", name);
+                goto done;
+        }
+        t2 = SDL_GetPerformanceCounter();
+        printf("%s (%dx%dx%d): %d components labeled in %.1f ms, hpa built "
+               "in %.1f ms\n", name, area_w(area), area_h(area), area->n_maps,
+               conn.n_labels, bench_ms(t0, t1), bench_ms(t1, t2));
+        if (jps_init(&jps, area)) {
+                printf("%s: out of memory\n", name);
+                goto done;
+        }
+
+        /* Pick the endpoints up front so only the searches are timed. */
+        if (!(ends = malloc(n_queries * sizeof (*ends)))) {
+                goto done;
+        }
+        for (int i = 0; i < n_queries; i++) {
+                if (!bench_random_loc(area, &rng, ends[i][0]) ||
+                    !bench_random_loc(area, &rng, ends[i][1])) {
+                        printf("%s: nowhere to stand\n", name);
+                        goto done;
+                }
+        }
+
+        /* The others' expansions are compared with flat A*'s. */
+        astar = bench_finder(area, name, "astar", bench_find_astar, &pf,
+                             &pf.expanded, ends, n_queries, 0);
+        bench_finder(area, name, "astar+conn", bench_find_guarded, &guarded,
+                     &pf.expanded, ends, n_queries, astar);
+        bench_finder(area, name, "jps", bench_find_jps, &jps,
+                     &jps.pf.expanded, ends, n_queries, astar);
+        bench_finder(area, name, "hpa", bench_find_hpa, &hpa, &hpa.expanded,
+                     ends, n_queries, astar);
+
+        /* Time the incremental updates after a wall goes up. */
+        pixel_t old = area_get_pixel(area, 0, ends[0][0][X], ends[0][0][Y]);
+        t0 = SDL_GetPerformanceCounter();
+        area_set_pixel(area, 0, ends[0][0][X], ends[0][0][Y], BENCH_WALL);
+        t1 = SDL_GetPerformanceCounter();
+        hpa_update(&hpa);
+        t2 = SDL_GetPerformanceCounter();
+        printf("%s (%dx%dx%d): after an edit, components updated in %.2f ms, "
+               "%d hpa clusters rebuilt in %.2f ms\n", name, area_w(area),
+               area_h(area), area->n_maps, bench_ms(t0, t1), hpa.rebuilt,
+               bench_ms(t1, t2));
+        area_set_pixel(area, 0, ends[0][0][X], ends[0][0][Y], old);
+
+done:
+        free(ends);
+        jps_deinit(&jps);
+        hpa_deinit(&hpa);
+        conn_deinit(&conn);
+        path_deinit(&pf);
+}
+
+void bench_flow(area_t * area, const char *name, int n_agents)
+{
+        flow_cache_t serial, parallel;
+        flow_field_t *one, *many;
+        path_finder_t pf;
+        pool_t pool;
+        uint32_t rng = 1;
+        point_t goal, (*starts) = NULL;
+        int n_nodes = move_n_nodes(area), same = 1, steps = 0;
+        Uint64 t0, t1, t2, t3;
+
+        memset(&serial, 0, sizeof (serial));
+        memset(&parallel, 0, sizeof (parallel));
+        memset(&pf, 0, sizeof (pf));
+        memset(&pool, 0, sizeof (pool));
+        if (pool_init(&pool, 0) ||
+            flow_cache_init(&serial, area, NULL, 1) ||
+            flow_cache_init(&parallel, area, &pool, 1) ||
+            path_init(&pf, area) ||
+            !(starts = malloc(n_agents * sizeof (point_t)))) {
+                printf("%s: out of memory\n", name);
+                goto done;
+        }
+
+        if (!bench_random_loc(area, &rng, goal)) {
+                printf("%s: nowhere to stand\n", name);
+                goto done;
+        }
+        for (int i = 0; i < n_agents; i++) {
+                bench_random_loc(area, &rng, starts[i]);
+        }
+
+        /* One search per agent... */
+        t0 = SDL_GetPerformanceCounter();
+        for (int i = 0; i < n_agents; i++) {
+                path_find(&pf, starts[i], goal, NULL, 0);
+        }
+        t1 = SDL_GetPerformanceCounter();
+        printf("%s flow (%dx%dx%d): %d agents, %.1f ms for one A* search "
+               "each\n", name, area_w(area), area_h(area), area->n_maps,
+               n_agents, bench_ms(t0, t1));
+
+        /* ...versus one field for all of them, on one thread and on all. */
+        t0 = SDL_GetPerformanceCounter();
+        one = flow_get(&serial, (const point_t *)&goal, 1);
+        t1 = SDL_GetPerformanceCounter();
+        many = flow_get(&parallel, (const point_t *)&goal, 1);
+        t2 = SDL_GetPerformanceCounter();
+        if (!one || !many) {
+                printf("%s: out of memory\n", name);
+                goto done;
+        }
+        for (int i = 0; i < n_nodes; i++) {
+                if (one->dist[i].value != many->dist[i].value ||
+                    one->next[i] != many->next[i]) {
+                        same = 0;
+                        break;
+                }
+        }
+        printf("%s flow (%dx%dx%d): field built in %.1f ms on 1 thread, "
+               "%.1f ms on %d (%s)\n", name, area_w(area), area_h(area),
+               area->n_maps, bench_ms(t0, t1), bench_ms(t1, t2),
+               pool_size(&pool), same ? "identical" : "DIFFERENT");
+
+        /* Walk every agent to the goal. */
+        t0 = SDL_GetPerformanceCounter();
+        for (int i = 0; i < n_agents; i++) {
+                point_t loc, next;
+                int dir;
+
+                point_copy(loc, starts[i]);
+                while ((dir = flow_next(many, loc)) >= 0 &&
+                       move_step(area, loc, move_directions[dir], next)) {
+                        point_copy(loc, next);
+                        steps++;
+                }
+        }
+        t1 = SDL_GetPerformanceCounter();
+
+        /* A repeat is a cache hit; an edit where the field reached forces a
+         * rebuild. */
+        flow_get(&parallel, (const point_t *)&goal, 1);
+        t2 = SDL_GetPerformanceCounter();
+        pixel_t old = area_get_pixel(area, 0, goal[X], goal[Y]);
+        area_set_pixel(area, 0, goal[X], goal[Y], BENCH_WALL);
+        area_set_pixel(area, 0, goal[X], goal[Y], old);
+        flow_get(&parallel, (const point_t *)&goal, 1);
+        t3 = SDL_GetPerformanceCounter();
+        printf("%s flow (%dx%dx%d): walked %d steps in %.2f ms, %d builds "
+               "and %d hits, %.1f ms to rebuild after an edit\n", name,
+               area_w(area), area_h(area), area->n_maps, steps,
+               bench_ms(t0, t1), parallel.builds, parallel.hits,
+               bench_ms(t2, t3));
+
+done:
+        free(starts);
+        path_deinit(&pf);
+        flow_cache_deinit(&parallel);
+        flow_cache_deinit(&serial);
+        pool_deinit(&pool);
+}
+
+/* Run the ticks with and without the pool, timing only the ticks. */
+void bench_crowd(area_t * area, const char *name, int n_actors)
+{
+        crowd_t serial, parallel;
+        pool_t pool;
+        uint32_t rng = 1;
+        point_t *buf[5] = { 0 }, *dirs;
+        double ms[2] = { 0, 0 };
+        int moved = 0, same = 1;
+
+        memset(&serial, 0, sizeof (serial));
+        memset(&parallel, 0, sizeof (parallel));
+        memset(&pool, 0, sizeof (pool));
+        for (int i = 0; i < 5; i++) {
+                if (!(buf[i] = malloc(n_actors * sizeof (point_t)))) {
+                        goto nomem;
+                }
+        }
+        if (pool_init(&pool, 0) || crowd_init(&serial, area, NULL) ||
+            crowd_init(&parallel, area, &pool)) {
+                goto nomem;
+        }
+
+        /* Two pairs of position buffers, one per crowd, and the dirs. */
+        for (int i = 0; i < n_actors; i++) {
+                if (!bench_random_loc(area, &rng, buf[0][i])) {
+                        printf("%s: nowhere to stand\n", name);
+                        goto done;
+                }
+                point_copy(buf[2][i], buf[0][i]);
+        }
+        dirs = buf[4];
+
+        for (int tick = 0; tick < BENCH_TICKS; tick++) {
+                point_t *from = buf[tick & 1], *to = buf[!(tick & 1)];
+                Uint64 t0, t1, t2;
+                int n_moved, n_moved_parallel;
+
+                for (int i = 0; i < n_actors; i++) {
+                        point_copy(dirs[i], move_directions
+                                   [bench_range(&rng, DIR_XLEFT,
+                                                DIR_YDOWN + 1)]);
+                }
+
+                t0 = SDL_GetPerformanceCounter();
+                n_moved = crowd_step(&serial, from, dirs, to, n_actors);
+                t1 = SDL_GetPerformanceCounter();
+                n_moved_parallel = crowd_step(&parallel, buf[2 + (tick & 1)],
+                                              dirs, buf[2 + !(tick & 1)],
+                                              n_actors);
+                t2 = SDL_GetPerformanceCounter();
+                if (n_moved < 0 || n_moved_parallel < 0) {
+                        goto nomem;
+                }
+                moved += n_moved;
+                ms[0] += bench_ms(t0, t1);
+                ms[1] += bench_ms(t1, t2);
+        }
+
+        for (int i = 0; i < n_actors; i++) {
+                if (!point_equal(buf[0][i], buf[2][i])) {
+                        same = 0;
+                        break;
+                }
+        }
+
+        printf("%s crowd (%dx%dx%d): %d actors, %.2f ms/tick on 1 thread, "
+               "%.2f ms/tick on %d (%s), %.1f%% of moves taken\n", name,
+               area_w(area), area_h(area), area->n_maps, n_actors,
+               ms[0] / BENCH_TICKS, ms[1] / BENCH_TICKS, pool_size(&pool),
+               same ? "identical" : "DIFFERENT",
+               100.0 * moved / ((double)n_actors * BENCH_TICKS));
+        goto done;
+
+nomem:
+        printf("%s: out of memory\n", name);
+done:
+        crowd_deinit(&parallel);
+        crowd_deinit(&serial);
+        pool_deinit(&pool);
+        for (int i = 0; i < 5; i++) {
+                free(buf[i]);
+        }
+}
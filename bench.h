@@ -0,0 +1,38 @@
+/**
+ * Benchmarks that run on an area without a renderer.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef bench_h
+#define bench_h
+
+#include <stdint.h>
+
+#include "map.h"
+
+/**
+ * Fill an empty area with generated maps: grass with scattered walls, and
+ * buildings whose stories are joined by stairs.
+ */
+int bench_synth_area(area_t * area, int w, int h, int n_levels, uint32_t seed);
+
+/**
+ * Time random point-to-point path queries on the area with plain A*, with A*
+ * behind the connectivity index, with JPS and with HPA*, along with building
+ * and updating the index and the HPA* graph.
+ */
+void bench_path(area_t * area, const char *name, int n_queries);
+
+/**
+ * Compare one A* search per agent against one flow field shared by all the
+ * agents, built on one thread and on a pool of them.
+ */
+void bench_flow(area_t * area, const char *name, int n_agents);
+
+/**
+ * Time ticks of random moves for a crowd on one thread and on a pool, and
+ * check that both end up in the same places.
+ */
+void bench_crowd(area_t * area, const char *name, int n_actors);
+
+#endif
@@ -0,0 +1,317 @@
+/**
+ * Drawing lists of draws into a surface on the CPU.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "blit.h"
+#include "error.h"
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define BLIT_HAVE_SSE2
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLIT_HAVE_AVX2
+#endif
+#endif
+
+/* Pixels gathered at a time for stretched draws. */
+#define BLIT_ROW 256
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+/* Blend `n` texels over `n` pixels. */
+typedef void (*blit_row_fn) (Uint32 * dst, const Uint32 * src, int n,
+                             SDL_Color mod);
+
+/* x / 255 for x up to 255 * 255, without dividing. */
+#define blit_div255(x) (((x) + 1 + ((x) >> 8)) >> 8)
+
+/* The kernels all do what SDL's software blitter does for a blended copy
+ * with color and alpha mods: tint, then premultiply by the alpha, then add
+ * what shows through of the pixel under it, each step rounding down. */
+static void blit_row_scalar(Uint32 * dst, const Uint32 * src, int n,
+                            SDL_Color mod)
+{
+        for (int i = 0; i < n; i++) {
+                Uint32 s = src[i], d = dst[i];
+                Uint32 a = blit_div255((s >> 24) * mod.a), inv = 255 - a;
+                Uint32 r, g, b;
+
+                if (!a) {
+                        continue;
+                }
+                r = blit_div255(((s >> 16) & 0xff) * mod.r);
+                g = blit_div255(((s >> 8) & 0xff) * mod.g);
+                b = blit_div255((s & 0xff) * mod.b);
+                r = blit_div255(r * a) + blit_div255(((d >> 16) & 0xff) * inv);
+                g = blit_div255(g * a) + blit_div255(((d >> 8) & 0xff) * inv);
+                b = blit_div255(b * a) + blit_div255((d & 0xff) * inv);
+                a = a + blit_div255((d >> 24) * inv);
+                dst[i] = a << 24 | r << 16 | g << 8 | b;
+        }
+}
+
+#ifdef BLIT_HAVE_SSE2
+static inline __m128i blit_div255_sse2(__m128i x)
+{
+        return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x,
+                                                          _mm_set1_epi16(1)),
+                                            _mm_srli_epi16(x, 8)), 8);
+}
+
+/* Blend two texels over two pixels, widened to 16 bits a channel. */
+static inline __m128i blit_blend_sse2(__m128i s, __m128i d, __m128i mod)
+{
+        const __m128i alpha = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        __m128i t = blit_div255_sse2(_mm_mullo_epi16(s, mod));
+        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(t, 0xff), 0xff);
+        __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), a);
+
+        /* Premultiplying 255 by the alpha leaves the alpha. */
+        t = _mm_or_si128(_mm_andnot_si128(alpha, t),
+                         _mm_and_si128(alpha, _mm_set1_epi16(255)));
+        return _mm_add_epi16(blit_div255_sse2(_mm_mullo_epi16(t, a)),
+                             blit_div255_sse2(_mm_mullo_epi16(d, inv)));
+}
+
+static void blit_row_sse2(Uint32 * dst, const Uint32 * src, int n,
+                          SDL_Color mod)
+{
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i amask = _mm_set1_epi32(0xff000000);
+        __m128i m = _mm_set_epi16(mod.a, mod.r, mod.g, mod.b,
+                                  mod.a, mod.r, mod.g, mod.b);
+        int i = 0;
+
+        for (; i + 4 <= n; i += 4) {
+                __m128i s = _mm_loadu_si128((const __m128i *)&src[i]);
+                __m128i d, lo, hi;
+
+                /* Skip four clear texels at once. */
+                if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, amask),
+                                                      zero)) == 0xffff) {
+                        continue;
+                }
+                d = _mm_loadu_si128((const __m128i *)&dst[i]);
+                lo = blit_blend_sse2(_mm_unpacklo_epi8(s, zero),
+                                     _mm_unpacklo_epi8(d, zero), m);
+                hi = blit_blend_sse2(_mm_unpackhi_epi8(s, zero),
+                                     _mm_unpackhi_epi8(d, zero), m);
+                _mm_storeu_si128((__m128i *)&dst[i], _mm_packus_epi16(lo, hi));
+        }
+        blit_row_scalar(&dst[i], &src[i], n - i, mod);
+}
+#endif
+
+#ifdef BLIT_HAVE_AVX2
+__attribute__ ((target("avx2")))
+static inline __m256i blit_div255_avx2(__m256i x)
+{
+        return _mm256_srli_epi16(_mm256_add_epi16
+                                 (_mm256_add_epi16(x, _mm256_set1_epi16(1)),
+                                  _mm256_srli_epi16(x, 8)), 8);
+}
+
+/* Blend four texels over four pixels, widened to 16 bits a channel. */
+__attribute__ ((target("avx2")))
+static inline __m256i blit_blend_avx2(__m256i s, __m256i d, __m256i mod)
+{
+        const __m256i alpha = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0,
+                                               -1, 0, 0, 0, -1, 0, 0, 0);
+        __m256i t = blit_div255_avx2(_mm256_mullo_epi16(s, mod));
+        __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(t, 0xff),
+                                           0xff);
+        __m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+
+        t = _mm256_or_si256(_mm256_andnot_si256(alpha, t),
+                            _mm256_and_si256(alpha, _mm256_set1_epi16(255)));
+        return _mm256_add_epi16(blit_div255_avx2(_mm256_mullo_epi16(t, a)),
+                                blit_div255_avx2(_mm256_mullo_epi16(d, inv)));
+}
+
+__attribute__ ((target("avx2")))
+static void blit_row_avx2(Uint32 * dst, const Uint32 * src, int n,
+                          SDL_Color mod)
+{
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i amask = _mm256_set1_epi32(0xff000000);
+        __m256i m = _mm256_set_epi16(mod.a, mod.r, mod.g, mod.b,
+                                     mod.a, mod.r, mod.g, mod.b,
+                                     mod.a, mod.r, mod.g, mod.b,
+                                     mod.a, mod.r, mod.g, mod.b);
+        int i = 0;
+
+        for (; i + 8 <= n; i += 8) {
+                __m256i s = _mm256_loadu_si256((const __m256i *)&src[i]);
+                __m256i d, lo, hi;
+
+                if (_mm256_testz_si256(s, amask)) {
+                        continue;
+                }
+                d = _mm256_loadu_si256((const __m256i *)&dst[i]);
+                lo = blit_blend_avx2(_mm256_unpacklo_epi8(s, zero),
+                                     _mm256_unpacklo_epi8(d, zero), m);
+                hi = blit_blend_avx2(_mm256_unpackhi_epi8(s, zero),
+                                     _mm256_unpackhi_epi8(d, zero), m);
+                _mm256_storeu_si256((__m256i *)&dst[i],
+                                    _mm256_packus_epi16(lo, hi));
+        }
+        blit_row_scalar(&dst[i], &src[i], n - i, mod);
+}
+#endif
+
+static const struct {
+        const char *name;
+        blit_row_fn row;        /* or NULL if not built */
+} blit_kernels[N_BLIT_KERNELS] = {
+        [BLIT_SCALAR] = {"scalar", blit_row_scalar},
+#ifdef BLIT_HAVE_SSE2
+        [BLIT_SSE2] = {"sse2", blit_row_sse2},
+#else
+        [BLIT_SSE2] = {"sse2", NULL},
+#endif
+#ifdef BLIT_HAVE_AVX2
+        [BLIT_AVX2] = {"avx2", blit_row_avx2},
+#else
+        [BLIT_AVX2] = {"avx2", NULL},
+#endif
+};
+
+/* Copy the atlas sheet as ARGB8888. */
+static void blit_read_atlas(blit_t * blit)
+{
+        const atlas_t *atlas = blit->atlas;
+        SDL_Surface *sheet = atlas->sheet;
+
+        for (int y = 0; y < atlas->h; y++) {
+                Uint32 *row = (Uint32 *) ((Uint8 *) sheet->pixels +
+                                          y * sheet->pitch);
+                Uint32 *texels = &blit->texels[y * atlas->w];
+
+                if (sheet->format->format == SDL_PIXELFORMAT_ARGB8888) {
+                        memcpy(texels, row, atlas->w * sizeof (Uint32));
+                        continue;
+                }
+                for (int x = 0; x < atlas->w; x++) {
+                        Uint8 r, g, b, a;
+                        SDL_GetRGBA(row[x], sheet->format, &r, &g, &b, &a);
+                        texels[x] = (Uint32) a << 24 | r << 16 | g << 8 | b;
+                }
+        }
+        blit->version = atlas->version;
+}
+
+/* Draw one draw, clipped to the surface. */
+static void blit_draw(blit_t * blit, const draw_t * draw, Uint8 * pixels,
+                      int pitch, blit_row_fn row_fn)
+{
+        const atlas_t *atlas = blit->atlas;
+        const SDL_Rect *src = &draw->src, *dst = &draw->dst;
+        int x0 = max(dst->x, 0), x1 = min(dst->x + dst->w, blit->surface->w);
+        int y0 = max(dst->y, 0), y1 = min(dst->y + dst->h, blit->surface->h);
+        Uint32 row[BLIT_ROW];
+
+        if (!dst->w || !dst->h || !draw->color.a) {
+                return;
+        }
+
+        for (int y = y0; y < y1; y++) {
+                int ty = src->y + (y - dst->y) * src->h / dst->h;
+                const Uint32 *texels = &blit->texels[ty * atlas->w];
+                Uint32 *out = (Uint32 *) (pixels + y * pitch);
+
+                if (src->w == dst->w) {
+                        row_fn(&out[x0], &texels[src->x + x0 - dst->x],
+                               x1 - x0, draw->color);
+                        continue;
+                }
+
+                /* Nearest texel, like the renderer picks for stretched
+                 * draws. */
+                for (int x = x0; x < x1; x += BLIT_ROW) {
+                        int n = min(x1 - x, BLIT_ROW);
+                        for (int i = 0; i < n; i++) {
+                                row[i] = texels[src->x + (x + i - dst->x) *
+                                                src->w / dst->w];
+                        }
+                        row_fn(&out[x], row, n, draw->color);
+                }
+        }
+}
+
+int blit_init(blit_t * blit, const atlas_t * atlas, SDL_Surface * surface)
+{
+        memset(blit, 0, sizeof (*blit));
+
+        if (surface->format->format != SDL_PIXELFORMAT_ARGB8888) {
+                return -1;
+        }
+        if (!(blit->texels = malloc(atlas->w * atlas->h * sizeof (Uint32)))) {
+                return ERROR_ALLOC;
+        }
+        blit->atlas = atlas;
+        blit->surface = surface;
+        blit->version = atlas->version - 1;
+        for (int k = N_BLIT_KERNELS - 1; k >= 0; k--) {
+                if (blit_kernel_supported(k)) {
+                        blit->kernel = k;
+                        break;
+                }
+        }
+
+        return 0;
+}
+
+void blit_deinit(blit_t * blit)
+{
+        free(blit->texels);
+        memset(blit, 0, sizeof (*blit));
+}
+
+bool blit_kernel_supported(blit_kernel_t kernel)
+{
+        if ((unsigned)kernel >= N_BLIT_KERNELS || !blit_kernels[kernel].row) {
+                return false;
+        }
+#ifdef BLIT_HAVE_AVX2
+        if (kernel == BLIT_AVX2) {
+                return __builtin_cpu_supports("avx2");
+        }
+#endif
+        return true;
+}
+
+const char *blit_kernel_name(blit_kernel_t kernel)
+{
+        if ((unsigned)kernel >= N_BLIT_KERNELS) {
+                return "unknown";
+        }
+        return blit_kernels[kernel].name;
+}
+
+int blit_draws(blit_t * blit, const draw_list_t * list)
+{
+        SDL_Surface *surface = blit->surface;
+        blit_row_fn row_fn = blit_kernels[blit->kernel].row;
+
+        if (blit->version != blit->atlas->version) {
+                blit_read_atlas(blit);
+        }
+        if (SDL_MUSTLOCK(surface) && SDL_LockSurface(surface)) {
+                return -1;
+        }
+        for (int i = 0; i < list->n_draws; i++) {
+                blit_draw(blit, &list->draws[i], surface->pixels,
+                          surface->pitch, row_fn);
+        }
+        if (SDL_MUSTLOCK(surface)) {
+                SDL_UnlockSurface(surface);
+        }
+        return 0;
+}
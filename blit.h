@@ -0,0 +1,67 @@
+/**
+ * Drawing lists of draws into a surface on the CPU.
+ *
+ * SDL's software renderer copies each draw through its general blitter,
+ * which tints, blends and scales a pixel at a time. Every draw here is from
+ * the atlas and blends the same way, so the blitter only needs one
+ * operation: tint a row of atlas texels by the draw's color, scale their
+ * alpha by its alpha and blend them over the surface. That is done a row at
+ * a time by a kernel that does 8 pixels at once with AVX2, 4 with SSE2, or
+ * one with plain C, picked by what the CPU has. All of the kernels round the
+ * same way, so they draw the same pixels. Stretched draws pick the nearest
+ * texel for each pixel into a row first.
+ *
+ * The blitter reads the atlas from its sheet, converted to ARGB8888, and
+ * reads it again when the atlas changes.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef blit_h
+#define blit_h
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "atlas.h"
+#include "draw.h"
+
+typedef enum {
+        BLIT_SCALAR = 0,
+        BLIT_SSE2,
+        BLIT_AVX2,
+        N_BLIT_KERNELS
+} blit_kernel_t;
+
+typedef struct {
+        const atlas_t *atlas;   /* draws are from this */
+        SDL_Surface *surface;   /* and go to this, in ARGB8888 */
+        Uint32 *texels;         /* the atlas sheet in ARGB8888 */
+        int version;            /* of the atlas in texels */
+        blit_kernel_t kernel;
+} blit_t;
+
+/**
+ * Set up/tear down a blitter from `atlas` to `surface`, using the best kernel
+ * the CPU has. Returns 0, -1 if the surface isn't ARGB8888, or ERROR_ALLOC.
+ */
+int blit_init(blit_t * blit, const atlas_t * atlas, SDL_Surface * surface);
+void blit_deinit(blit_t * blit);
+
+/**
+ * Check if the build and the CPU can run a kernel.
+ */
+bool blit_kernel_supported(blit_kernel_t kernel);
+
+/**
+ * Get the name of a kernel, for reports.
+ */
+const char *blit_kernel_name(blit_kernel_t kernel);
+
+/**
+ * Draw the list onto the surface, in order. Returns 0 or -1 if the surface
+ * couldn't be locked.
+ */
+int blit_draws(blit_t * blit, const draw_list_t * list);
+
+#endif
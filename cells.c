@@ -0,0 +1,113 @@
+/**
+ * A grid of screen cells, each marked or not.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cells.h"
+#include "error.h"
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+int cells_init(cells_t * cells, int screen_w, int screen_h)
+{
+        cells->w = (screen_w + CELL_SIZE - 1) / CELL_SIZE;
+        cells->h = (screen_h + CELL_SIZE - 1) / CELL_SIZE;
+        if (!(cells->marks = calloc(cells_count(cells), 1))) {
+                return ERROR_ALLOC;
+        }
+        return 0;
+}
+
+void cells_deinit(cells_t * cells)
+{
+        free(cells->marks);
+        memset(cells, 0, sizeof (*cells));
+}
+
+void cells_clear(cells_t * cells)
+{
+        memset(cells->marks, 0, cells_count(cells));
+}
+
+bool cells_range(const cells_t * cells, const SDL_Rect * rect, int *c0,
+                 int *r0, int *c1, int *r1)
+{
+        if (rect->w <= 0 || rect->h <= 0 ||
+            rect->x + rect->w <= 0 || rect->y + rect->h <= 0) {
+                return false;
+        }
+        *c0 = max(rect->x, 0) / CELL_SIZE;
+        *r0 = max(rect->y, 0) / CELL_SIZE;
+        *c1 = min((rect->x + rect->w - 1) / CELL_SIZE, cells->w - 1);
+        *r1 = min((rect->y + rect->h - 1) / CELL_SIZE, cells->h - 1);
+        return *c0 <= *c1 && *r0 <= *r1;
+}
+
+void cells_mark(cells_t * cells, const SDL_Rect * rect)
+{
+        int c0, r0, c1, r1;
+
+        if (!cells_range(cells, rect, &c0, &r0, &c1, &r1)) {
+                return;
+        }
+        for (int r = r0; r <= r1; r++) {
+                memset(&cells->marks[r * cells->w + c0], 1, c1 - c0 + 1);
+        }
+}
+
+int cells_run_end(const cells_t * cells, int r, int c, int c1)
+{
+        Uint8 mark = cells_at(cells, c, r);
+        int end = c;
+
+        while (end <= c1 && cells_at(cells, end, r) == mark) {
+                end++;
+        }
+        return end;
+}
+
+void cells_run_rect(int r, int c0, int c1, SDL_Rect * rect)
+{
+        rect->x = c0 * CELL_SIZE;
+        rect->y = r * CELL_SIZE;
+        rect->w = (c1 - c0) * CELL_SIZE;
+        rect->h = CELL_SIZE;
+}
+
+bool cells_runs_begin(cells_runs_t * runs, const cells_t * cells,
+                      const SDL_Rect * rect)
+{
+        runs->cells = cells;
+        if (!cells_range(cells, rect, &runs->c0, &runs->r, &runs->c1,
+                         &runs->r1)) {
+                return false;
+        }
+        runs->c = runs->c0;
+        return true;
+}
+
+bool cells_runs_next(cells_runs_t * runs, SDL_Rect * run)
+{
+        const cells_t *cells = runs->cells;
+
+        for (; runs->r <= runs->r1; runs->r++, runs->c = runs->c0) {
+                for (; runs->c <= runs->c1; runs->c++) {
+                        int end;
+
+                        if (!cells_at(cells, runs->c, runs->r)) {
+                                continue;
+                        }
+                        end = cells_run_end(cells, runs->r, runs->c,
+                                            runs->c1);
+                        cells_run_rect(runs->r, runs->c, end, run);
+                        runs->c = end;
+                        return true;
+                }
+        }
+        return false;
+}
@@ -0,0 +1,83 @@
+/**
+ * A grid of screen cells, each marked or not.
+ *
+ * Parts of a frame that get drawn some other way than tile by tile, from a
+ * layer or from the last frame, are tracked by the square screen cells they
+ * cover. The cells that can't be had that way are marked, and the frame's
+ * draws are cut to the runs of marked cells along each row they cross.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef cells_h
+#define cells_h
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+/* Screen cell size in pixels. */
+#define CELL_SIZE 32
+
+typedef struct {
+        Uint8 *marks;           /* nonzero: marked */
+        int w, h;               /* in cells */
+} cells_t;
+
+/* The runs of marked cells a screen rect crosses, a row at a time. */
+typedef struct {
+        const cells_t *cells;
+        int c0, c1, r1;         /* cells the rect touches */
+        int r, c;               /* where to look next */
+} cells_runs_t;
+
+/**
+ * Set up/tear down unmarked cells covering a `screen_w` by `screen_h` screen.
+ * Returns 0 or ERROR_ALLOC.
+ */
+int cells_init(cells_t * cells, int screen_w, int screen_h);
+void cells_deinit(cells_t * cells);
+
+#define cells_count(c) ((c)->w * (c)->h)
+#define cells_at(c, col, row) ((c)->marks[(row) * (c)->w + (col)])
+
+/**
+ * Unmark every cell.
+ */
+void cells_clear(cells_t * cells);
+
+/**
+ * Find the cells a screen rect touches, from (c0, r0) to (c1, r1) inclusive.
+ * Returns false if none.
+ */
+bool cells_range(const cells_t * cells, const SDL_Rect * rect, int *c0,
+                 int *r0, int *c1, int *r1);
+
+/**
+ * Mark the cells a screen rect touches.
+ */
+void cells_mark(cells_t * cells, const SDL_Rect * rect);
+
+/**
+ * Find where the run of cells marked the same as (c, r) ends along its row,
+ * not looking past column `c1`. Returns the column after it.
+ */
+int cells_run_end(const cells_t * cells, int r, int c, int c1);
+
+/**
+ * Get the screen rect of the cells of row `r` from column `c0` up to `c1`.
+ */
+void cells_run_rect(int r, int c0, int c1, SDL_Rect * rect);
+
+/**
+ * Start walking the runs of marked cells `rect` crosses. Returns false if it
+ * touches no cells.
+ */
+bool cells_runs_begin(cells_runs_t * runs, const cells_t * cells,
+                      const SDL_Rect * rect);
+
+/**
+ * Get the screen rect of the next run. Returns false when there are no more.
+ */
+bool cells_runs_next(cells_runs_t * runs, SDL_Rect * run);
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * Compressed pixel storage for an area.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk.h"
+#include "error.h"
+#include "log.h"
+
+#define CHUNK_PIXELS (CHUNK_W * CHUNK_H)
+
+static void chunk_decode(chunk_t * chunk, uint32_t * pixels)
+{
+        if (!chunk->n_runs) {
+                memset(pixels, 0, CHUNK_PIXELS * sizeof (*pixels));
+                return;
+        }
+        for (int i = 0; i < chunk->n_runs; i++) {
+                uint32_t len = chunk->runs[i * 2];
+                uint32_t pixel = chunk->runs[i * 2 + 1];
+                while (len--) {
+                        *pixels++ = pixel;
+                }
+        }
+}
+
+static void chunk_encode(chunk_t * chunk, const uint32_t * pixels,
+                         uint32_t * scratch)
+{
+        int n_runs = 0;
+
+        for (int i = 0; i < CHUNK_PIXELS;) {
+                int j = i + 1;
+                while (j < CHUNK_PIXELS && pixels[j] == pixels[i]) {
+                        j++;
+                }
+                scratch[n_runs * 2] = j - i;
+                scratch[n_runs * 2 + 1] = pixels[i];
+                n_runs++;
+                i = j;
+        }
+
+        /* An empty chunk needs no runs at all. */
+        if (n_runs == 1 && !scratch[1]) {
+                n_runs = 0;
+        }
+
+        free(chunk->runs);
+        chunk->runs = NULL;
+        chunk->n_runs = n_runs;
+        if (!n_runs) {
+                return;
+        }
+        if (!(chunk->runs = malloc(n_runs * 2 * sizeof (uint32_t)))) {
+                log_critical("%s:out of memory\n", __FUNCTION__);
+                abort();
+        }
+        memcpy(chunk->runs, scratch, n_runs * 2 * sizeof (uint32_t));
+}
+
+int chunk_store_init(chunk_store_t * store, int w, int h, int n_levels)
+{
+        int n_chunks;
+
+        memset(store, 0, sizeof (*store));
+        store->w = w;
+        store->h = h;
+        store->n_levels = n_levels;
+        store->chunks_w = (w + CHUNK_MASK) >> CHUNK_SHIFT;
+        store->chunks_h = (h + CHUNK_MASK) >> CHUNK_SHIFT;
+        n_chunks = store->chunks_w * store->chunks_h * n_levels;
+
+        if (!(store->chunks = calloc(n_chunks, sizeof (chunk_t))) ||
+            !(store->slot_of = malloc(n_chunks * sizeof (int))) ||
+            !(store->slots = calloc(CHUNK_CACHE_SIZE, sizeof (chunk_slot_t))) ||
+            !(store->scratch = malloc(CHUNK_PIXELS * 2 * sizeof (uint32_t)))) {
+                chunk_store_deinit(store);
+                return ERROR_ALLOC;
+        }
+
+        for (int i = 0; i < n_chunks; i++) {
+                store->slot_of[i] = -1;
+        }
+        for (int i = 0; i < CHUNK_CACHE_SIZE; i++) {
+                store->slots[i].key = -1;
+        }
+
+        return 0;
+}
+
+void chunk_store_deinit(chunk_store_t * store)
+{
+        if (store->chunks) {
+                int n_chunks =
+                    store->chunks_w * store->chunks_h * store->n_levels;
+                for (int i = 0; i < n_chunks; i++) {
+                        free(store->chunks[i].runs);
+                }
+                free(store->chunks);
+        }
+        free(store->slot_of);
+        free(store->slots);
+        free(store->scratch);
+        memset(store, 0, sizeof (*store));
+}
+
+int chunk_store_fetch(chunk_store_t * store, int key)
+{
+        int victim = 0;
+
+        /* Find an unused slot or else the least recently used one. */
+        for (int i = 0; i < CHUNK_CACHE_SIZE; i++) {
+                chunk_slot_t *slot = &store->slots[i];
+                if (slot->key < 0) {
+                        victim = i;
+                        break;
+                }
+                if (slot->stamp < store->slots[victim].stamp) {
+                        victim = i;
+                }
+        }
+
+        chunk_slot_t *slot = &store->slots[victim];
+        if (slot->key >= 0) {
+                if (slot->dirty) {
+                        chunk_encode(&store->chunks[slot->key], slot->pixels,
+                                     store->scratch);
+                        store->encodes++;
+                }
+                store->slot_of[slot->key] = -1;
+        }
+
+        chunk_decode(&store->chunks[key], slot->pixels);
+        store->decodes++;
+        slot->key = key;
+        slot->dirty = false;
+        slot->stamp = ++store->clock;
+        store->slot_of[key] = victim;
+
+        return victim;
+}
+
+void chunk_store_flush(chunk_store_t * store)
+{
+        for (int i = 0; i < CHUNK_CACHE_SIZE; i++) {
+                chunk_slot_t *slot = &store->slots[i];
+                if (slot->key >= 0 && slot->dirty) {
+                        chunk_encode(&store->chunks[slot->key], slot->pixels,
+                                     store->scratch);
+                        store->encodes++;
+                        slot->dirty = false;
+                }
+        }
+}
+
+size_t chunk_store_bytes(chunk_store_t * store)
+{
+        int n_chunks = store->chunks_w * store->chunks_h * store->n_levels;
+        size_t bytes = n_chunks * sizeof (chunk_t);
+
+        for (int i = 0; i < n_chunks; i++) {
+                bytes += store->chunks[i].n_runs * 2 * sizeof (uint32_t);
+        }
+
+        return bytes;
+}
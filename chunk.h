@@ -0,0 +1,111 @@
+/**
+ * Compressed pixel storage for an area.
+ *
+ * Each level of the area is cut into CHUNK_W x CHUNK_H chunks which are kept
+ * run-length encoded. A chunk is only decoded when something reads or writes
+ * it, and then it lives in a small cache of hot chunks until it is evicted.
+ * Modified chunks are re-encoded on eviction.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef chunk_h
+#define chunk_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHUNK_SHIFT 5
+#define CHUNK_W (1 << CHUNK_SHIFT)
+#define CHUNK_H CHUNK_W
+#define CHUNK_MASK (CHUNK_W - 1)
+
+/* A 35x35 view spans at most 3x3 chunks on each of the 4 levels, so this
+ * holds a whole frame's working set. That bounds the decodes per frame to the
+ * chunks that newly scrolled into view. */
+#define CHUNK_CACHE_SIZE 64
+
+typedef struct {
+        uint32_t *runs;         /* (length, pixel) pairs */
+        int n_runs;
+} chunk_t;
+
+typedef struct {
+        int key;                /* chunk index, or -1 if unused */
+        bool dirty;             /* written since it was decoded */
+        uint32_t stamp;         /* last use, for LRU eviction */
+        uint32_t pixels[CHUNK_W * CHUNK_H];
+} chunk_slot_t;
+
+typedef struct chunk_store {
+        int w, h, n_levels;
+        int chunks_w, chunks_h;
+        chunk_t *chunks;
+        int *slot_of;           /* per chunk: cache slot or -1 */
+        chunk_slot_t *slots;
+        uint32_t clock;
+        uint32_t *scratch;      /* runs being encoded */
+
+        /* Statistics */
+        int decodes;
+        int encodes;
+} chunk_store_t;
+
+/**
+ * Initialize/deinitialize an empty (all-zero) store.
+ */
+int chunk_store_init(chunk_store_t * store, int w, int h, int n_levels);
+void chunk_store_deinit(chunk_store_t * store);
+
+/**
+ * Decode the chunk into the cache, evicting the least recently used one if
+ * necessary. Returns the slot index.
+ */
+int chunk_store_fetch(chunk_store_t * store, int key);
+
+/**
+ * Encode all the modified chunks in the cache.
+ */
+void chunk_store_flush(chunk_store_t * store);
+
+/**
+ * Total bytes used by the encoded chunks (not counting the cache).
+ */
+size_t chunk_store_bytes(chunk_store_t * store);
+
+static inline int chunk_store_key(chunk_store_t * store, int level, int x,
+                                  int y)
+{
+        return ((level * store->chunks_h + (y >> CHUNK_SHIFT)) *
+                store->chunks_w + (x >> CHUNK_SHIFT));
+}
+
+static inline chunk_slot_t *chunk_store_slot(chunk_store_t * store, int level,
+                                             int x, int y)
+{
+        int key = chunk_store_key(store, level, x, y);
+        int slot = store->slot_of[key];
+        if (slot < 0) {
+                slot = chunk_store_fetch(store, key);
+        } else {
+                store->slots[slot].stamp = ++store->clock;
+        }
+        return &store->slots[slot];
+}
+
+static inline uint32_t chunk_store_get(chunk_store_t * store, int level, int x,
+                                       int y)
+{
+        chunk_slot_t *slot = chunk_store_slot(store, level, x, y);
+        return slot->pixels[(y & CHUNK_MASK) * CHUNK_W + (x & CHUNK_MASK)];
+}
+
+static inline void chunk_store_set(chunk_store_t * store, int level, int x,
+                                   int y, uint32_t pixel)
+{
+        chunk_slot_t *slot = chunk_store_slot(store, level, x, y);
+        slot->pixels[(y & CHUNK_MASK) * CHUNK_W + (x & CHUNK_MASK)] = pixel;
+        slot->dirty = true;
+}
+
+#endif
@@ -0,0 +1,374 @@
+/**
+ * Connected components of the places things can stand in an area.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "conn.h"
+#include "error.h"
+#include "log.h"
+
+/* How far from an edit the check for a split component searches. */
+#define CONN_RADIUS 16
+
+/* Most locations linked to one location in either direction. */
+#define CONN_MAX_LINKS (MOVE_MAX_PREDS + N_DIR)
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+static int32_t conn_find(conn_index_t * conn, int32_t label)
+{
+        while (conn->parents[label] != label) {
+                conn->parents[label] = conn->parents[conn->parents[label]];
+                label = conn->parents[label];
+        }
+        return label;
+}
+
+/* Join two labels, keeping the lower root so results don't depend on the
+ * order of the joins. */
+static void conn_union(conn_index_t * conn, int32_t a, int32_t b)
+{
+        a = conn_find(conn, a);
+        b = conn_find(conn, b);
+        if (a != b) {
+                conn->parents[max(a, b)] = min(a, b);
+        }
+}
+
+static int32_t conn_new_label(conn_index_t * conn)
+{
+        if (conn->n_labels == conn->max_labels) {
+                int max_labels = conn->max_labels * 2;
+                int32_t *parents = realloc(conn->parents,
+                                           max_labels * sizeof (int32_t));
+                if (!parents) {
+                        log_critical("%s:out of memory\n", __FUNCTION__);
+                        abort();
+                }
+                conn->parents = parents;
+                conn->max_labels = max_labels;
+        }
+        conn->parents[conn->n_labels] = conn->n_labels;
+        return conn->n_labels++;
+}
+
+static void conn_node_loc(conn_index_t * conn, int node, point_t loc)
+{
+        int w = area_w(conn->area);
+        loc[X] = node % w;
+        loc[Y] = (node / w) % area_h(conn->area);
+        loc[Z] = conn->z[node];
+}
+
+/* Find the locations linked to one in either direction. */
+static int conn_links(conn_index_t * conn, const point_t loc, point_t * links)
+{
+        int dirs[MOVE_MAX_PREDS];
+        int n = move_preds(conn->area, loc, links, dirs);
+
+        for (int dir = 0; dir < N_DIR; dir++) {
+                if (move_step(conn->area, loc, move_directions[dir],
+                              links[n])) {
+                        n++;
+                }
+        }
+        return n;
+}
+
+/* Give every location in a column a label, or take it away if nothing can
+ * stand there anymore. */
+static void conn_label_column(conn_index_t * conn, int x, int y)
+{
+        bool stands[N_MAPS] = { 0 };
+        point_t loc;
+
+        for (int level = 0; level < conn->area->n_maps; level++) {
+                if (move_stand(conn->area, x, y, level, loc)) {
+                        int node = move_node(conn->area, loc);
+                        stands[Z2L(loc[Z])] = true;
+                        conn->z[node] = loc[Z];
+                        if (conn->labels[node] < 0) {
+                                conn->labels[node] = conn_new_label(conn);
+                        }
+                }
+        }
+
+        for (int level = 0; level < conn->area->n_maps; level++) {
+                if (!stands[level]) {
+                        loc[X] = x;
+                        loc[Y] = y;
+                        loc[Z] = L2Z(level);
+                        conn->labels[move_node(conn->area, loc)] = -1;
+                }
+        }
+}
+
+/* Join the label of each location in a column with those it steps to. */
+static void conn_join_column(conn_index_t * conn, int x, int y)
+{
+        for (int level = 0; level < conn->area->n_maps; level++) {
+                int node = (level * area_h(conn->area) + y) *
+                    area_w(conn->area) + x;
+                point_t loc, to;
+
+                if (conn->labels[node] < 0) {
+                        continue;
+                }
+                conn_node_loc(conn, node, loc);
+                for (int dir = 0; dir < N_DIR; dir++) {
+                        if (move_step(conn->area, loc, move_directions[dir],
+                                      to)) {
+                                int next = move_node(conn->area, to);
+                                if (conn->labels[next] >= 0) {
+                                        conn_union(conn, conn->labels[node],
+                                                   conn->labels[next]);
+                                }
+                        }
+                }
+        }
+}
+
+/* Flood from a node within a window, stamping what it reaches with the
+ * current generation. */
+static void conn_flood_local(conn_index_t * conn, int start, int x0, int y0,
+                             int x1, int y1)
+{
+        int head = 0, tail = 0;
+
+        if (++conn->gen == 0) {
+                memset(conn->seen, 0, conn->n_nodes * sizeof (uint32_t));
+                conn->gen = 1;
+        }
+
+        conn->seen[start] = conn->gen;
+        conn->queue[tail++] = start;
+        while (head < tail) {
+                point_t loc, links[CONN_MAX_LINKS];
+                int n;
+
+                conn_node_loc(conn, conn->queue[head++], loc);
+                n = conn_links(conn, loc, links);
+                for (int i = 0; i < n; i++) {
+                        int node = move_node(conn->area, links[i]);
+                        if (links[i][X] >= x0 && links[i][X] < x1 &&
+                            links[i][Y] >= y0 && links[i][Y] < y1 &&
+                            conn->seen[node] != conn->gen) {
+                                conn->seen[node] = conn->gen;
+                                conn->queue[tail++] = node;
+                        }
+                }
+        }
+}
+
+/* Give the whole component of a node a new label. Labels at or above `base`
+ * were given by this round of labeling. */
+static void conn_flood_label(conn_index_t * conn, int start, int32_t base)
+{
+        int32_t label = conn_new_label(conn);
+        int head = 0, tail = 0;
+
+        conn->labels[start] = label;
+        conn->queue[tail++] = start;
+        while (head < tail) {
+                point_t loc, links[CONN_MAX_LINKS];
+                int n;
+
+                conn_node_loc(conn, conn->queue[head++], loc);
+                n = conn_links(conn, loc, links);
+                for (int i = 0; i < n; i++) {
+                        int node = move_node(conn->area, links[i]);
+                        if (conn->labels[node] < base) {
+                                conn->labels[node] = label;
+                                conn->queue[tail++] = node;
+                        }
+                }
+        }
+}
+
+/* Renumber the labels from zero once stale ones pile up. */
+static void conn_compact(conn_index_t * conn)
+{
+        int32_t *remap = malloc(conn->n_labels * sizeof (int32_t));
+        int n = 0;
+
+        if (!remap) {
+                return;
+        }
+        memset(remap, 0xff, conn->n_labels * sizeof (int32_t));
+        for (int node = 0; node < conn->n_nodes; node++) {
+                if (conn->labels[node] >= 0) {
+                        int32_t root = conn_find(conn, conn->labels[node]);
+                        if (remap[root] < 0) {
+                                remap[root] = n++;
+                        }
+                        conn->labels[node] = remap[root];
+                }
+        }
+        for (int i = 0; i < n; i++) {
+                conn->parents[i] = i;
+        }
+        conn->n_labels = n;
+        free(remap);
+}
+
+/* Update the labels after the terrain changed in the column at (x, y).
+ * Only links into that column change, and those all start in the column or
+ * beside it. */
+static void conn_update(conn_index_t * conn, int x, int y)
+{
+        static const int cols[][2] = { {0, 0}, {-1, 0}, {1, 0}, {0, -1},
+        {0, 1}
+        };
+        int nodes[5 * N_MAPS], roots[5 * N_MAPS], n = 0;
+        int32_t base;
+
+        /* Remember the components around the edit as they were. */
+        for (int c = 0; c < 5; c++) {
+                int cx = x + cols[c][0], cy = y + cols[c][1];
+                if (!area_contains(conn->area, cx, cy)) {
+                        continue;
+                }
+                for (int level = 0; level < conn->area->n_maps; level++) {
+                        int node = (level * area_h(conn->area) + cy) *
+                            area_w(conn->area) + cx;
+                        if (conn->labels[node] >= 0) {
+                                nodes[n] = node;
+                                roots[n] = conn_find(conn,
+                                                     conn->labels[node]);
+                                n++;
+                        }
+                }
+        }
+
+        conn_label_column(conn, x, y);
+        base = conn->n_labels;
+
+        /* A component can only have split if its nodes around the edit are
+         * no longer linked to each other. Look for links nearby before
+         * labeling the whole thing again. */
+        for (int i = 0; i < n; i++) {
+                bool split = false;
+
+                if (conn->labels[nodes[i]] < 0 || roots[i] < 0) {
+                        continue;
+                }
+
+                conn_flood_local(conn, nodes[i], x - CONN_RADIUS,
+                                 y - CONN_RADIUS, x + CONN_RADIUS + 1,
+                                 y + CONN_RADIUS + 1);
+                for (int j = i + 1; j < n; j++) {
+                        if (roots[j] == roots[i] &&
+                            conn->labels[nodes[j]] >= 0 &&
+                            conn->seen[nodes[j]] != conn->gen) {
+                                split = true;
+                        }
+                }
+
+                if (split) {
+                        conn->splits++;
+                        for (int j = i; j < n; j++) {
+                                if (roots[j] == roots[i] &&
+                                    conn->labels[nodes[j]] >= 0 &&
+                                    conn->labels[nodes[j]] < base) {
+                                        conn_flood_label(conn, nodes[j], base);
+                                }
+                        }
+                }
+
+                /* Done with this component. */
+                for (int j = i + 1; j < n; j++) {
+                        if (roots[j] == roots[i]) {
+                                roots[j] = -1;
+                        }
+                }
+        }
+
+        /* Join whatever the edit connected. */
+        for (int c = 0; c < 5; c++) {
+                int cx = x + cols[c][0], cy = y + cols[c][1];
+                if (area_contains(conn->area, cx, cy)) {
+                        conn_join_column(conn, cx, cy);
+                }
+        }
+
+        if (conn->n_labels > 2 * conn->n_nodes) {
+                conn_compact(conn);
+        }
+}
+
+static void conn_on_change(void *data, int level, int x, int y, pixel_t old,
+                           pixel_t pixel)
+{
+        conn_update(data, x, y);
+}
+
+int conn_init(conn_index_t * conn, area_t * area)
+{
+        int n_nodes = move_n_nodes(area);
+
+        memset(conn, 0, sizeof (*conn));
+        conn->n_nodes = n_nodes;
+        conn->max_labels = n_nodes + 1;
+
+        if (!(conn->labels = malloc(n_nodes * sizeof (int32_t))) ||
+            !(conn->z = malloc(n_nodes)) ||
+            !(conn->parents = malloc(conn->max_labels * sizeof (int32_t))) ||
+            !(conn->queue = malloc(n_nodes * sizeof (int))) ||
+            !(conn->seen = calloc(n_nodes, sizeof (uint32_t)))) {
+                conn_deinit(conn);
+                return ERROR_ALLOC;
+        }
+
+        /* Set the area first for the node helpers. */
+        conn->area = area;
+        memset(conn->labels, 0xff, n_nodes * sizeof (int32_t));
+        for (int y = 0; y < area_h(area); y++) {
+                for (int x = 0; x < area_w(area); x++) {
+                        conn_label_column(conn, x, y);
+                }
+        }
+        for (int y = 0; y < area_h(area); y++) {
+                for (int x = 0; x < area_w(area); x++) {
+                        conn_join_column(conn, x, y);
+                }
+        }
+        conn_compact(conn);
+
+        if (!area_listen(area, conn_on_change, conn)) {
+                conn->area = NULL;
+                conn_deinit(conn);
+                return ERROR_ALLOC;
+        }
+
+        return 0;
+}
+
+void conn_deinit(conn_index_t * conn)
+{
+        if (conn->area) {
+                area_unlisten(conn->area, conn_on_change, conn);
+        }
+        free(conn->labels);
+        free(conn->z);
+        free(conn->parents);
+        free(conn->queue);
+        free(conn->seen);
+        memset(conn, 0, sizeof (*conn));
+}
+
+int conn_component(conn_index_t * conn, const point_t loc)
+{
+        int32_t label = conn->labels[move_node(conn->area, loc)];
+        return label < 0 ? -1 : conn_find(conn, label);
+}
+
+bool conn_same(conn_index_t * conn, const point_t a, const point_t b)
+{
+        int ca = conn_component(conn, a);
+        return ca >= 0 && ca == conn_component(conn, b);
+}
@@ -0,0 +1,67 @@
+/**
+ * Connected components of the places things can stand in an area.
+ *
+ * Two locations are in the same component if `move_step` links them, in
+ * either direction, through any chain of locations. Falls only go one way, so
+ * this is weak connectivity: locations in different components can never
+ * reach each other, which lets pathfinding reject hopeless goals without a
+ * search, but a location is not always reachable from another just because
+ * they share a component.
+ *
+ * Each node holds a raw label and the labels are joined by a union-find, so
+ * an edit that connects components only merges their labels. An edit that
+ * might split a component is checked with a small search around it first,
+ * and only if that fails are the pieces labeled again.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef conn_h
+#define conn_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "map.h"
+#include "move.h"
+#include "point.h"
+
+typedef struct {
+        area_t *area;
+        int n_nodes;
+
+        /* Per-node state. */
+        int32_t *labels;        /* raw label, or -1 where nothing stands */
+        int8_t *z;              /* z of the location */
+
+        /* Union-find over the raw labels. */
+        int32_t *parents;
+        int n_labels, max_labels;
+
+        /* Scratch for searches. */
+        int *queue;
+        uint32_t *seen;
+        uint32_t gen;
+
+        /* Statistics. */
+        int splits;             /* edits that needed labeling again */
+} conn_index_t;
+
+/**
+ * Label the area and keep the labels current as it changes, until
+ * `conn_deinit`.
+ */
+int conn_init(conn_index_t * conn, area_t * area);
+void conn_deinit(conn_index_t * conn);
+
+/**
+ * Get the component of a location, or -1 if nothing can stand there.
+ */
+int conn_component(conn_index_t * conn, const point_t loc);
+
+/**
+ * True if two locations are in the same component. If not, there is no path
+ * between them.
+ */
+bool conn_same(conn_index_t * conn, const point_t a, const point_t b);
+
+#endif
@@ -0,0 +1,242 @@
+/**
+ * Which screen pixels a frame's draws cover.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cover.h"
+#include "error.h"
+#include "log.h"
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+/* What walking down a draw's runs does with them. */
+enum {
+        COVER_TEST,             /* check they are all covered */
+        COVER_TOUCH,            /* mark them touched */
+        COVER_SOLID             /* and mark the solid ones covered */
+};
+
+/* Bits from b0 up to b1 of a word. */
+static inline uint64_t cover_mask(int b0, int b1)
+{
+        return (b1 - b0 == 64 ? ~0ULL : ((1ULL << (b1 - b0)) - 1)) << b0;
+}
+
+static bool cover_bits_all(const uint64_t * bits, int y0, int y1)
+{
+        for (int w = y0 >> 6; w <= (y1 - 1) >> 6; w++) {
+                uint64_t mask = cover_mask(max(y0 - w * 64, 0),
+                                           min(y1 - w * 64, 64));
+                if ((bits[w] & mask) != mask) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+static void cover_bits_set(uint64_t * bits, int y0, int y1)
+{
+        for (int w = y0 >> 6; w <= (y1 - 1) >> 6; w++) {
+                bits[w] |= cover_mask(max(y0 - w * 64, 0),
+                                      min(y1 - w * 64, 64));
+        }
+}
+
+/* Go down each screen column of a draw through the runs of the atlas column
+ * it comes from, adding up the pixels. Testing stops and returns false at
+ * the first run that isn't all covered. */
+static bool cover_walk(cover_t * cover, const draw_t * draw, int mode,
+                       Uint64 * pixels)
+{
+        int x0 = max(draw->dst.x, 0);
+        int x1 = min(draw->dst.x + draw->dst.w, cover->w);
+        int top = draw->src.y, bottom = draw->src.y + draw->src.h;
+        int dy = draw->dst.y - draw->src.y;
+
+        for (int x = x0; x < x1; x++) {
+                int ax = draw->src.x + x - draw->dst.x;
+                uint64_t *covered = &cover->covered[x * cover->words];
+                uint64_t *touched = &cover->touched[x * cover->words];
+
+                for (int r = cover->columns[ax]; r < cover->columns[ax + 1];
+                     r++) {
+                        cover_run_t *run = &cover->runs[r];
+                        int y0 = max(max(run->y0, top) + dy, 0);
+                        int y1 = min(min(run->y1, bottom) + dy, cover->h);
+
+                        if (y0 >= y1) {
+                                continue;
+                        }
+                        switch (mode) {
+                        case COVER_TEST:
+                                if (!cover_bits_all(covered, y0, y1)) {
+                                        return false;
+                                }
+                                break;
+                        case COVER_SOLID:
+                                if (run->solid) {
+                                        cover_bits_set(covered, y0, y1);
+                                }
+                                /* fall through */
+                        case COVER_TOUCH:
+                                cover_bits_set(touched, y0, y1);
+                                break;
+                        }
+                        *pixels += y1 - y0;
+                }
+        }
+
+        return true;
+}
+
+/* Mark all of a rect touched, for draws whose texels can't be followed. */
+static Uint64 cover_touch_rect(cover_t * cover, const SDL_Rect * rect)
+{
+        int x0 = max(rect->x, 0), x1 = min(rect->x + rect->w, cover->w);
+        int y0 = max(rect->y, 0), y1 = min(rect->y + rect->h, cover->h);
+
+        if (x0 >= x1 || y0 >= y1) {
+                return 0;
+        }
+        for (int x = x0; x < x1; x++) {
+                cover_bits_set(&cover->touched[x * cover->words], y0, y1);
+        }
+        return (Uint64) (x1 - x0) * (y1 - y0);
+}
+
+/* Find the runs down every atlas column, again if it changed. */
+static int cover_runs(cover_t * cover)
+{
+        const atlas_t *atlas = cover->atlas;
+        int n_runs = 0;
+
+        /* Count the runs first. */
+        for (int x = 0; x < atlas->w; x++) {
+                Uint8 prev = 0;
+                for (int y = 0; y < atlas->h; y++) {
+                        Uint8 a = atlas->alpha[y * atlas->w + x];
+                        if (a && (!prev || (a == 255) != (prev == 255))) {
+                                n_runs++;
+                        }
+                        prev = a;
+                }
+        }
+
+        free(cover->runs);
+        free(cover->columns);
+        if (!(cover->runs = malloc(max(n_runs, 1) * sizeof (cover_run_t))) ||
+            !(cover->columns = malloc((atlas->w + 1) * sizeof (int)))) {
+                return ERROR_ALLOC;
+        }
+
+        n_runs = 0;
+        for (int x = 0; x < atlas->w; x++) {
+                cover_run_t *run = NULL;
+                cover->columns[x] = n_runs;
+                for (int y = 0; y < atlas->h; y++) {
+                        Uint8 a = atlas->alpha[y * atlas->w + x];
+                        if (!a) {
+                                run = NULL;
+                        } else if (!run || run->solid != (a == 255)) {
+                                run = &cover->runs[n_runs++];
+                                run->y0 = y;
+                                run->y1 = y + 1;
+                                run->solid = a == 255;
+                        } else {
+                                run->y1 = y + 1;
+                        }
+                }
+        }
+        cover->columns[atlas->w] = n_runs;
+        cover->version = atlas->version;
+
+        return 0;
+}
+
+int cover_init(cover_t * cover, const atlas_t * atlas, int w, int h)
+{
+        memset(cover, 0, sizeof (*cover));
+        cover->w = w;
+        cover->h = h;
+        cover->words = (h + 63) / 64;
+        cover->atlas = atlas;
+
+        if (!(cover->covered = malloc(w * cover->words * sizeof (uint64_t))) ||
+            !(cover->touched = malloc(w * cover->words * sizeof (uint64_t))) ||
+            cover_runs(cover)) {
+                cover_deinit(cover);
+                return ERROR_ALLOC;
+        }
+
+        return 0;
+}
+
+void cover_deinit(cover_t * cover)
+{
+        free(cover->covered);
+        free(cover->touched);
+        free(cover->runs);
+        free(cover->columns);
+        memset(cover, 0, sizeof (*cover));
+}
+
+int cover_cull(cover_t * cover, draw_list_t * list)
+{
+        int n = list->n_draws, next = n;
+        size_t n_words = cover->w * cover->words;
+
+        if (cover->version != cover->atlas->version && cover_runs(cover)) {
+                log_critical("%s:out of memory\n", __FUNCTION__);
+                abort();
+        }
+
+        memset(cover->covered, 0, n_words * sizeof (uint64_t));
+        memset(cover->touched, 0, n_words * sizeof (uint64_t));
+        cover->culled = 0;
+        cover->drawn = 0;
+        cover->kept = 0;
+
+        /* Front to back, keeping the survivors at the end of the list. */
+        for (int i = n - 1; i >= 0; i--) {
+                draw_t *draw = &list->draws[i];
+                Uint64 pixels = 0;
+
+                if (draw->src.w != draw->dst.w || draw->src.h != draw->dst.h) {
+                        pixels = cover_touch_rect(cover, &draw->dst);
+                } else if (cover_walk(cover, draw, COVER_TEST, &pixels)) {
+                        cover->drawn += pixels;
+                        cover->culled++;
+                        continue;
+                } else {
+                        pixels = 0;
+                        cover_walk(cover, draw, draw->color.a == 255 ?
+                                   COVER_SOLID : COVER_TOUCH, &pixels);
+                }
+
+                cover->drawn += pixels;
+                cover->kept += pixels;
+                list->draws[--next] = *draw;
+        }
+
+        memmove(list->draws, &list->draws[next],
+                (n - next) * sizeof (draw_t));
+        list->n_draws = n - next;
+
+        cover->visible = 0;
+        for (size_t i = 0; i < n_words; i++) {
+                cover->visible += __builtin_popcountll(cover->touched[i]);
+        }
+
+        cover->frames++;
+        cover->total_culled += cover->culled;
+        cover->total_drawn += cover->drawn;
+        cover->total_kept += cover->kept;
+        cover->total_visible += cover->visible;
+
+        return cover->culled;
+}
@@ -0,0 +1,68 @@
+/**
+ * Which screen pixels a frame's draws cover.
+ *
+ * Going through a frame's draws from the last to the first, a draw whose
+ * opaque pixels are all covered by opaque draws after it can't be seen, and
+ * leaving it out changes nothing on the screen. The buffer keeps a bit per
+ * screen pixel, a column at a time, and gets which texels are opaque from the
+ * atlas as runs down each atlas column, found again whenever the atlas
+ * changes. Only draws from the atlas at their own size and with no alpha mod
+ * count as covering anything; stretched ones are never left out.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef cover_h
+#define cover_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+#include "atlas.h"
+#include "draw.h"
+
+/* A run of texels that aren't clear down an atlas column, from y0 up to
+ * y1. Only solid runs, with no see-through texels, cover anything. */
+typedef struct {
+        Uint16 y0, y1;
+        bool solid;
+} cover_run_t;
+
+typedef struct {
+        int w, h;               /* screen */
+        int words;              /* 64-bit words per screen column */
+        uint64_t *covered;      /* by opaque draws */
+        uint64_t *touched;      /* by any draw */
+
+        const atlas_t *atlas;
+        int version;            /* of the atlas the runs are from */
+        cover_run_t *runs;      /* atlas columns one after another */
+        int *columns;           /* index of each atlas column's first run,
+                                 * plus one past the last */
+
+        /* Statistics for the last frame. */
+        int culled;
+        Uint64 drawn;           /* pixels the draws would have written */
+        Uint64 kept;            /* and the ones left did */
+        Uint64 visible;         /* distinct pixels written */
+
+        /* And over every frame. */
+        int frames;
+        Uint64 total_culled, total_drawn, total_kept, total_visible;
+} cover_t;
+
+/**
+ * Set up/tear down a buffer for a `w` by `h` screen and the draws from an
+ * atlas. Returns 0 or ERROR_ALLOC.
+ */
+int cover_init(cover_t * cover, const atlas_t * atlas, int w, int h);
+void cover_deinit(cover_t * cover);
+
+/**
+ * Take the draws nobody would see out of a frame's list, keeping the rest in
+ * order. Returns the number taken out.
+ */
+int cover_cull(cover_t * cover, draw_list_t * list);
+
+#endif
@@ -0,0 +1,161 @@
+/**
+ * Moving many things one step at a time.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crowd.h"
+#include "error.h"
+#include "move.h"
+
+/* Things per job. */
+#define CROWD_JOB 1024
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+static void crowd_run(crowd_t * crowd, pool_fn fn)
+{
+        int n_jobs = (crowd->n + CROWD_JOB - 1) / CROWD_JOB;
+
+        /* Compressed areas decode through a shared cache. */
+        if (crowd->pool && !crowd->area->store) {
+                pool_run(crowd->pool, fn, crowd, n_jobs);
+        } else {
+                for (int job = 0; job < n_jobs; job++) {
+                        fn(crowd, job);
+                }
+        }
+}
+
+static void crowd_occupy_job(void *data, int job)
+{
+        crowd_t *crowd = data;
+        int end = min((job + 1) * CROWD_JOB, crowd->n);
+
+        for (int i = job * CROWD_JOB; i < end; i++) {
+                SDL_AtomicSet(&crowd->occupied
+                              [move_node(crowd->area, crowd->from[i])], 1);
+        }
+}
+
+/* Find where each one would go and claim it. The destination goes in `to`
+ * for now. */
+static void crowd_claim_job(void *data, int job)
+{
+        crowd_t *crowd = data;
+        int end = min((job + 1) * CROWD_JOB, crowd->n);
+
+        for (int i = job * CROWD_JOB; i < end; i++) {
+                SDL_atomic_t *claim;
+                int node, held;
+
+                crowd->targets[i] = -1;
+                if (!move_step(crowd->area, crowd->from[i], crowd->dirs[i],
+                               crowd->to[i])) {
+                        continue;
+                }
+                node = move_node(crowd->area, crowd->to[i]);
+                if (SDL_AtomicGet(&crowd->occupied[node])) {
+                        continue;
+                }
+
+                crowd->targets[i] = node;
+                claim = &crowd->claims[node];
+                while ((held = SDL_AtomicGet(claim)) > i &&
+                       !SDL_AtomicCAS(claim, held, i)) ;
+        }
+}
+
+/* Move the winners and leave everyone else where they were. */
+static void crowd_move_job(void *data, int job)
+{
+        crowd_t *crowd = data;
+        int end = min((job + 1) * CROWD_JOB, crowd->n);
+        int moved = 0;
+
+        for (int i = job * CROWD_JOB; i < end; i++) {
+                int node = crowd->targets[i];
+
+                if (node >= 0 && SDL_AtomicGet(&crowd->claims[node]) == i) {
+                        moved++;
+                } else {
+                        point_copy(crowd->to[i], crowd->from[i]);
+                }
+        }
+        SDL_AtomicAdd(&crowd->moved, moved);
+}
+
+/* Clear the per-node state for the next tick. Runs after every job has read
+ * the claims, so the order doesn't matter. */
+static void crowd_clear_job(void *data, int job)
+{
+        crowd_t *crowd = data;
+        int end = min((job + 1) * CROWD_JOB, crowd->n);
+
+        for (int i = job * CROWD_JOB; i < end; i++) {
+                SDL_AtomicSet(&crowd->occupied
+                              [move_node(crowd->area, crowd->from[i])], 0);
+                if (crowd->targets[i] >= 0) {
+                        SDL_AtomicSet(&crowd->claims[crowd->targets[i]],
+                                      INT_MAX);
+                }
+        }
+}
+
+int crowd_init(crowd_t * crowd, area_t * area, pool_t * pool)
+{
+        int n_nodes = move_n_nodes(area);
+
+        memset(crowd, 0, sizeof (*crowd));
+        crowd->area = area;
+        crowd->pool = pool;
+
+        if (!(crowd->occupied = calloc(n_nodes, sizeof (SDL_atomic_t))) ||
+            !(crowd->claims = malloc(n_nodes * sizeof (SDL_atomic_t)))) {
+                crowd_deinit(crowd);
+                return ERROR_ALLOC;
+        }
+        for (int i = 0; i < n_nodes; i++) {
+                crowd->claims[i].value = INT_MAX;
+        }
+
+        return 0;
+}
+
+void crowd_deinit(crowd_t * crowd)
+{
+        free(crowd->occupied);
+        free(crowd->claims);
+        free(crowd->targets);
+        memset(crowd, 0, sizeof (*crowd));
+}
+
+int crowd_step(crowd_t * crowd, const point_t * from, const point_t * dirs,
+               point_t * to, int n)
+{
+        if (n > crowd->max) {
+                int *targets = realloc(crowd->targets, n * sizeof (int));
+                if (!targets) {
+                        return ERROR_ALLOC;
+                }
+                crowd->targets = targets;
+                crowd->max = n;
+        }
+
+        crowd->from = from;
+        crowd->dirs = dirs;
+        crowd->to = to;
+        crowd->n = n;
+        SDL_AtomicSet(&crowd->moved, 0);
+
+        crowd_run(crowd, crowd_occupy_job);
+        crowd_run(crowd, crowd_claim_job);
+        crowd_run(crowd, crowd_move_job);
+        crowd_run(crowd, crowd_clear_job);
+
+        return SDL_AtomicGet(&crowd->moved);
+}
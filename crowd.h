@@ -0,0 +1,59 @@
+/**
+ * Moving many things one step at a time.
+ *
+ * A tick takes everyone's position and the direction each is trying to go,
+ * already rotated into map coordinates like `move_step` wants, and writes
+ * where everyone ended up to a separate array. Terrain is handled exactly as
+ * `move_step` handles it. Things also block each other: nobody moves into a
+ * location that was occupied when the tick began, and when several want the
+ * same empty location the one with the lowest index gets it.
+ *
+ * The work is spread over a thread pool, but the claims are settled by the
+ * lowest index rather than by who got there first, so the results are the
+ * same for any number of threads. The area must not change during a tick.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef crowd_h
+#define crowd_h
+
+#include <SDL2/SDL.h>
+
+#include "map.h"
+#include "point.h"
+#include "pool.h"
+
+typedef struct {
+        area_t *area;
+        pool_t *pool;
+
+        /* Per-node state, left clear between ticks. */
+        SDL_atomic_t *occupied;
+        SDL_atomic_t *claims;   /* lowest index that wants in, or INT_MAX */
+
+        /* The current tick. */
+        const point_t *from;
+        const point_t *dirs;
+        point_t *to;
+        int *targets;           /* node each one is trying for, or -1 */
+        int n, max;
+
+        /* Statistics for the last tick. */
+        SDL_atomic_t moved;
+} crowd_t;
+
+/**
+ * Set up/tear down. The pool may be NULL to run ticks on the caller.
+ */
+int crowd_init(crowd_t * crowd, area_t * area, pool_t * pool);
+void crowd_deinit(crowd_t * crowd);
+
+/**
+ * Move `n` things from `from` one step in `dirs` (z in levels), storing the
+ * results in `to`. Things that can't move stay put. Returns how many moved,
+ * or ERROR_ALLOC.
+ */
+int crowd_step(crowd_t * crowd, const point_t * from, const point_t * dirs,
+               point_t * to, int n);
+
+#endif
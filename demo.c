@@ -2,14 +2,31 @@
 #include <SDL2/SDL_image.h>
 #include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <gcu.h>
 
+#include "atlas.h"
+#include "bench.h"
+#include "blit.h"
+#include "cover.h"
+#include "draw.h"
+#include "error.h"
 #include "fov.h"
 #include "iso.h"
+#include "layer.h"
 #include "map.h"
+#include "mip.h"
 #include "model.h"
+#include "move.h"
+#include "pace.h"
+#include "pick.h"
 #include "point.h"
+#include "pool.h"
+#include "region.h"
+#include "rotmap.h"
+#include "scroll.h"
+#include "sprite.h"
 #include "view.h"
 
 enum {
@@ -48,38 +65,179 @@ enum {
         N_MODELS
 };
 
-enum {
-        DIR_XLEFT,
-        DIR_XRIGHT,
-        DIR_YUP,
-        DIR_YDOWN,
-        DIR_ZUP,
-        DIR_ZDOWN,
-        N_DIR
-};
-
 struct args {
         char *filenames[N_MAPS];
         char *cmd;
         bool fov;
         bool delay;
+        int rate;               /* frames per second to pace to, or -1 */
+        bool vsync;
         bool transparency;
+        bool compress;
+        bool prerotate;
+        bool always;
+        bool copy;
+        bool layers;
+        bool cull;
+        bool sprites;
+        bool fused;
+        bool regions;
+        bool blit;
+        bool scroll;
+        int zoom;               /* steps out to start at, or -1 for none */
+        bool headless;
+        int headless_frames;
+        int threads;            /* to draw levels in strips, or -1 */
+        char *png_prefix;
 };
 
+/* Everything a frame depends on. If none of it changed since the last frame,
+ * the screen already shows the right thing. */
+typedef struct {
+        point_t cursor;
+        rotation_t rotation;
+        bool transparency;
+        uint32_t version;       /* of the area */
+        int zoom;
+} frame_state_t;
+
+/* Part of a level whose draws are decided on its own, a band of the view's
+ * diagonals. */
+typedef struct {
+        draw_list_t draws;      /* for strips done by the pool */
+        int index;              /* in session->strips, or -1 if the draws
+                                 * go straight into the frame */
+        int d0, d1;             /* view_x - view_y from d0 up to d1 */
+        bool clipped_pillar;
+        bool top_of_stairs;
+} strip_t;
+
+/* Where a tile's draws went when its level was done in strips. */
+typedef struct {
+        int strip;
+        int first, n;
+        bool dynamic;           /* not as in the layer */
+} tile_span_t;
+
+/* What a tile has to draw on a level, all but what depends on the tiles drawn
+ * before it. */
+typedef struct {
+        int index;              /* view tile */
+        pixel_t pixel;          /* or 0 for nothing but the cursor */
+        bool fog;               /* out of view: only the fog */
+        bool cutaway;           /* model is the wall cut away */
+        Sint8 model;            /* to draw, after any cutaway, or -1 */
+        Uint8 tile_h;           /* of the model before the cutaway */
+        Sint8 cursor;           /* cursor model here, or -1 */
+        Sint8 cursor_z;         /* how far up it is */
+        bool clipped_pillar;    /* cut away under a ceiling */
+        bool top_of_stairs;     /* cursor is on top of the stairs */
+} tile_plan_t;
+
+/* The tiles with something to draw on each level, in painter's order, and
+ * whether the levels above get drawn, from the fused walk. */
+typedef struct {
+        tile_plan_t tiles[N_MAPS][VIEW_W * VIEW_H];
+        int counts[N_MAPS];
+        bool clipped_pillar[N_MAPS];
+        bool top_of_stairs[N_MAPS];
+} fused_t;
+
 typedef struct {
         view_t view;
         area_t area;
+        region_index_t regions;
+        rotmap_t rotmap;
+        bool prerotated;        /* read pixels from rotmap */
         bool transparency;
+        frame_state_t drawn;    /* what the screen shows */
+        bool exposed;           /* window needs repainting anyway */
+        draw_list_t draws;      /* the frame being rendered */
+        bool batch;             /* submit draws as geometry */
+        int n_draws;            /* tiles and faces in the last frame */
+        int calls;              /* SDL calls to draw them */
+        draw_state_t state;     /* texture mods, counted per frame */
+        layer_cache_t layers;
+        bool use_layers;
+        pool_t *pool;           /* to draw levels in strips, or NULL */
+        strip_t *strips;
+        int n_strips;
+        tile_span_t spans[VIEW_W * VIEW_H];
+        cover_t cover;
+        bool cull;              /* leave out hidden draws */
+        sprite_cache_t sprites;
+        bool use_sprites;
+        pick_t pick;            /* what each pixel shows, when asked */
+        fused_t *fused;         /* to walk each tile once for every
+                                 * level, or NULL */
+        blit_t blit;            /* draws on the CPU, when offscreen */
+        bool use_blit;
+        scroll_t scroll;        /* the last frame, to move */
+        bool use_scroll;
+        int scroll_version;     /* of the atlas when it was drawn */
+        mip_t mip;              /* the terrain from above, to zoom out */
+        int zoom;               /* steps out, each halving the tile size */
 } session_t;
 
+/* How the level being rendered lines up with its layer. */
+typedef struct {
+        layer_t *layer;
+        int dx, dy;             /* view tile + margin + (dx, dy) = layer tile */
+        int px, py;             /* screen pixel + (px, py) = layer pixel */
+} layer_view_t;
+
+/* A level being turned into draws. */
+typedef struct {
+        atlas_t *atlas;
+        session_t *session;
+        area_t *area;
+        int map_level;
+        layer_view_t *lv;
+        tile_span_t *spans;     /* if done in strips */
+} level_pass_t;
+
+/* Do a level of a walk up the levels. Returns false if the levels above it
+ * should not be drawn. */
+typedef bool (*level_fn) (atlas_t * atlas, session_t * session, int level,
+                          void *data);
+
 #define FPS 60
+#define BENCH_FRAMES 200
+#define BENCH_TRAVERSALS 2000
+#define BENCH_SCROLL_SIDE 8
+#define BENCH_ZOOM_FRAMES 50
+#define HEADLESS_FRAMES 400
+#define SCREEN_W (640 * 2)
+#define SCREEN_H (480 * 2)
 #define MODEL_H2I(h) clamp((h), 0, N_MODELS - 1)
 #define MODEL_I2H(i) (i)
 #define TILE_HEIGHT 18
 #define TILE_HEIGHT_HALF (TILE_HEIGHT / 2)
 #define TILE_WIDTH 36
 #define TILE_WIDTH_HALF (TILE_WIDTH / 2)
-#define TICK_PER_FRAME (1000 / FPS)
+
+/* Zoomed out, the view is drawn as before in the middle of a screen 2^zoom
+ * times as big, around which the terrain is drawn from the mip level with
+ * texels a few pixels across. */
+#define ZOOM_MAX 5
+#define ZOOM_MIP_LAG 3          /* steps out before the mip level goes up */
+#define ZOOM_REACH ((SCREEN_W / TILE_WIDTH + SCREEN_H / TILE_HEIGHT) / 2 + 1)
+
+/* Layers cover the view plus a margin the cursor can move in before they
+ * are drawn again, with room above the back row for the tallest model. */
+#define LAYER_MARGIN 4
+#define LAYER_TILES (VIEW_W + 2 * LAYER_MARGIN)
+#define LAYER_TOP (6 * TILE_HEIGHT)
+#define LAYER_OFFSET ((LAYER_TILES - 1) * TILE_WIDTH_HALF)
+#define LAYER_PIXEL_W (LAYER_TILES * TILE_WIDTH)
+#define LAYER_PIXEL_H (LAYER_TILES * TILE_HEIGHT + LAYER_TOP)
+
+/* Pick ids: a face of a view tile on a level, plus one so none is zero. */
+#define PICK_ID(level, index, face) \
+        ((((level) * VIEW_W * VIEW_H + (index)) * N_MODEL_FACES + (face)) + 1)
+
+/* Atlas rows kept for sprites, four rows of the tallest model. */
+#define SPRITE_SPARE_H (4 * (LAYER_TOP + 1))
 
 
 #define between(x, l, r) (((l) < (x)) && (x) < (r))
@@ -117,21 +275,82 @@ static const size_t texture_indices[N_MODELS][N_MODEL_FACES] = {
 };
 
 
+/* Which face each texture is drawn as. */
+static const int texture_faces[N_TEXTURES] = {
+        [TEXTURE_GRASS] = MODEL_FACE_TOP,
+        [TEXTURE_5x1x1LEFT] = MODEL_FACE_LEFT,
+        [TEXTURE_5x1x1RIGHT] = MODEL_FACE_RIGHT,
+        [TEXTURE_TOP] = MODEL_FACE_TOP,
+        [TEXTURE_LEFTSHORT] = MODEL_FACE_LEFT,
+        [TEXTURE_RIGHTSHORT] = MODEL_FACE_RIGHT,
+        [TEXTURE_INTERIOR] = MODEL_FACE_TOP,
+        [TEXTURE_1x1x1LEFT] = MODEL_FACE_LEFT,
+        [TEXTURE_1x1x1RIGHT] = MODEL_FACE_RIGHT,
+        [TEXTURE_2x1x1LEFT] = MODEL_FACE_LEFT,
+        [TEXTURE_2x1x1RIGHT] = MODEL_FACE_RIGHT,
+        [TEXTURE_3x1x1LEFT] = MODEL_FACE_LEFT,
+        [TEXTURE_3x1x1RIGHT] = MODEL_FACE_RIGHT,
+        [TEXTURE_4x1x1LEFT] = MODEL_FACE_LEFT,
+        [TEXTURE_4x1x1RIGHT] = MODEL_FACE_RIGHT,
+};
+
+static const char *face_names[N_MODEL_FACES] = { "left", "right", "top" };
+
 static char rendered[VIEW_W * VIEW_H] = { 0 };
 static model_t models[N_MODELS] = { 0 };
 
+/* Where each view tile goes on the screen at view z 0. */
+static SDL_Point view_screen[VIEW_W * VIEW_H];
+
 /**
  * Print a command-line usage message.
  */
 static void print_usage(void)
 {
         printf("Usage:  demo [options] [command]\n");
+        printf("Commands: \n");
+        printf("  bench-path: compare A*, JPS and HPA* path queries on the "
+               "maps and on large generated maps\n");
+        printf("  bench-blit: with -x, time frames drawn by SDL's software "
+               "renderer and by each blitter kernel\n");
+        printf("  bench-crowd: time movement ticks for large crowds\n");
+        printf("  bench-flow: compare per-agent A* with a shared flow "
+               "field\n");
+        printf("  bench-rotate: time frames at each camera rotation\n");
+        printf("  bench-scroll: with -k, time frames drawn whole and over "
+               "the last one while the cursor walks\n");
+        printf("  bench-traverse: time deciding what to draw, without "
+               "drawing it\n");
+        printf("  bench-zoom: with -m, time frames at each zoom step\n");
         printf("Options: \n");
+        printf("  -a: render every frame, even if nothing changed\n");
+        printf("  -b: with -x, draw tiles with the CPU blitter instead of "
+               "SDL\n");
+        printf("  -c: draw each face with its own SDL_RenderCopy\n");
         printf("  -d: disable delay (show true framerate)\n");
         printf("  -f: disable fov\n");
+        printf("  -g: count terrain over the 5x5 block around clicks\n");
         printf("  -h: help\n");
         printf("  -i: image filename (max %d)\n", N_MAPS);
+        printf("  -j: decide what to draw in strips on this many threads "
+               "(0 for one per CPU)\n");
+        printf("  -k: keep the last frame and move it when the view moves\n");
+        printf("  -l: cache the static parts of each level in textures\n");
+        printf("  -m: zoom out this many steps (0 to %d), with - and = to "
+               "change it\n", ZOOM_MAX);
+        printf("  -n: frames to render headless (default %d)\n",
+               HEADLESS_FRAMES);
+        printf("  -o: with -x, save each frame to <prefix>NNNN.png\n");
+        printf("  -p: frames per second to pace to (default %d, or none "
+               "with -y)\n", FPS);
+        printf("  -r: keep pre-rotated copies of the maps\n");
+        printf("  -s: draw each model as one sprite instead of its faces\n");
         printf("  -t: enable transparency\n");
+        printf("  -u: walk each view tile once for every level\n");
+        printf("  -v: leave out faces hidden behind others\n");
+        printf("  -x: render offscreen with software, without a window\n");
+        printf("  -y: wait for vsync when showing a frame\n");
+        printf("  -z: keep maps compressed in memory\n");
 }
 
 static void parse_filenames(struct args *args, char *filenames, int i)
@@ -161,16 +380,32 @@ static void parse_args(int argc, char **argv, struct args *args)
         /* Set defaults */
         memset(args, 0, sizeof (*args));
         args->delay = true;
+        args->headless_frames = HEADLESS_FRAMES;
+        args->threads = -1;
+        args->rate = -1;
+        args->zoom = -1;
 
         /* Get user args */
-        while ((c = getopt(argc, argv, "i:hfdt")) != -1) {
+        while ((c = getopt(argc, argv, "abci:hfgj:klm:dn:o:p:rstuvxyz")) != -1) {
                 switch (c) {
+                case 'a':
+                        args->always = true;
+                        break;
+                case 'b':
+                        args->blit = true;
+                        break;
+                case 'c':
+                        args->copy = true;
+                        break;
                 case 'd':
                         args->delay = false;
                         break;
                 case 'f':
                         args->fov = !args->fov;
                         break;
+                case 'g':
+                        args->regions = true;
+                        break;
                 case 'i':
                         args->filenames[0] = optarg;
                         parse_filenames(args, optarg, 1);
@@ -178,9 +413,51 @@ static void parse_args(int argc, char **argv, struct args *args)
                 case 'h':
                         print_usage();
                         exit(0);
+                case 'j':
+                        args->threads = atoi(optarg);
+                        break;
+                case 'k':
+                        args->scroll = true;
+                        break;
+                case 'l':
+                        args->layers = true;
+                        break;
+                case 'm':
+                        args->zoom = clamp(atoi(optarg), 0, ZOOM_MAX);
+                        break;
+                case 'n':
+                        args->headless_frames = atoi(optarg);
+                        break;
+                case 'o':
+                        args->png_prefix = optarg;
+                        break;
+                case 'p':
+                        args->rate = atoi(optarg);
+                        break;
+                case 'r':
+                        args->prerotate = true;
+                        break;
+                case 's':
+                        args->sprites = true;
+                        break;
                 case 't':
                         args->transparency = true;
                         break;
+                case 'u':
+                        args->fused = true;
+                        break;
+                case 'v':
+                        args->cull = true;
+                        break;
+                case 'x':
+                        args->headless = true;
+                        break;
+                case 'y':
+                        args->vsync = true;
+                        break;
+                case 'z':
+                        args->compress = true;
+                        break;
                 case '?':
                 default:
                         print_usage();
@@ -189,6 +466,17 @@ static void parse_args(int argc, char **argv, struct args *args)
                 }
         }
 
+        if (optind < argc) {
+                args->cmd = argv[optind];
+        }
+
+        /* Vsync paces frames by itself unless asked for another rate. */
+        if (args->rate < 0) {
+                args->rate = args->vsync ? 0 : FPS;
+        }
+        if (!args->delay) {
+                args->rate = 0;
+        }
 }
 
 static void clear_screen(SDL_Renderer * renderer)
@@ -197,20 +485,6 @@ static void clear_screen(SDL_Renderer * renderer)
         SDL_RenderClear(renderer);
 }
 
-static inline int screen_to_view_x(int screen_x, int screen_y)
-{
-        screen_x -= (VIEW_OFFSET + TILE_WIDTH_HALF);
-        return (int)((float)screen_x / (float)TILE_WIDTH +
-                     (float)screen_y / (float)TILE_HEIGHT);
-}
-
-static inline int screen_to_view_y(int screen_x, int screen_y)
-{
-        screen_x -= (VIEW_OFFSET + TILE_WIDTH_HALF);
-        return (int)((float)screen_y / (float)TILE_HEIGHT -
-                     (float)screen_x / (float)TILE_WIDTH);
-}
-
 static inline int view_to_screen_x(int view_x, int view_y)
 {
         return (view_x - view_y) * TILE_WIDTH_HALF + VIEW_OFFSET;
@@ -254,14 +528,16 @@ static inline int view_rendered_at(size_t view_x, size_t view_y)
         return rendered[view_y * VIEW_W + view_x];
 }
 
-static inline void view_set_rendered(size_t view_x, size_t view_y,
-                                     size_t tile_h)
+/* Mark the cells a model of `tile_h` tiles covers, up its diagonal. It stops
+ * at the edge of the view rather than wrap onto the row above, which would
+ * put it on another strip's diagonal. */
+static inline void view_set_rendered(int view_x, int view_y, int tile_h)
 {
-        int index = view_y * VIEW_W + view_x;
-        while (tile_h && index > 0) {
-                rendered[index] = 1;
+        while (tile_h && view_x >= 0 && view_y >= 0) {
+                rendered[view_y * VIEW_W + view_x] = 1;
                 tile_h--;
-                index -= (VIEW_W + 1);  /* up one row and left one column */
+                view_x--;       /* up one row and left one column */
+                view_y--;
         }
 }
 
@@ -295,390 +571,1850 @@ static bool cutaway_at(point_t vloc)
 }
 
 /**
- * The view coordinates overlay the map and follow the cursor around with an
- * origin at a fixed (x, y) distance from the cursor. The view z coordinate is
- * offset from the cursor z.
+ * Find where every view tile goes on the screen.
  */
-static void model_render(SDL_Renderer * renderer, model_t * model, int view_x,
-                         int view_y, int view_z, Uint8 red, Uint8 grn,
-                         Uint8 blu, int flags)
+static void view_screen_init(void)
 {
-        for (int j = 0; j < N_MODEL_FACES; j++) {
+        for (int y = 0, index = 0; y < VIEW_H; y++) {
+                for (int x = 0; x < VIEW_W; x++, index++) {
+                        view_screen[index].x = view_to_screen_x(x, y);
+                        view_screen[index].y = view_to_screen_y(x, y, 0);
+                }
+        }
+}
 
-                if (j == MODEL_FACE_LEFT &&
-                    (flags & MODEL_RENDER_FLAG_SKIPLEFT)) {
-                        continue;
+static inline sprite_cache_t *session_sprites(session_t * session)
+{
+        return session->use_sprites ? &session->sprites : NULL;
+}
+
+/**
+ * Queue the faces of a model standing on a tile whose top left corner is at
+ * (`screen_x`, `screen_y`) on the screen, as one sprite if `sprites` has
+ * them together.
+ */
+static void model_render(draw_list_t * draws, sprite_cache_t * sprites,
+                         model_t * model, int screen_x, int screen_y,
+                         Uint8 red, Uint8 grn, Uint8 blu, int flags)
+{
+        int faces = SPRITE_ALL_FACES;
+
+        if (flags & MODEL_RENDER_FLAG_SKIPLEFT) {
+                faces &= ~(1 << MODEL_FACE_LEFT);
+        }
+        if (flags & MODEL_RENDER_FLAG_SKIPRIGHT) {
+                faces &= ~(1 << MODEL_FACE_RIGHT);
+        }
+
+        if (sprites && !(flags & MODEL_RENDER_FLAG_TRANSPARENT)) {
+                const sprite_t *sprite = sprite_get(sprites, model - models,
+                                                    faces);
+                if (sprite) {
+                        SDL_Rect dst;
+                        dst.x = screen_x + sprite->dx;
+                        dst.y = screen_y + sprite->dy;
+                        dst.w = sprite->src.w;
+                        dst.h = sprite->src.h;
+                        draw_list_add(draws, &sprite->src, &dst, red, grn,
+                                      blu, 255);
+                        return;
                 }
-                if (j == MODEL_FACE_RIGHT &&
-                    (flags & MODEL_RENDER_FLAG_SKIPRIGHT)) {
+        }
+
+        for (int j = 0; j < N_MODEL_FACES; j++) {
+
+                if (!(faces & (1 << j))) {
                         continue;
                 }
-                SDL_Texture *texture = model->textures[j];
                 SDL_Rect *offset = &model->offsets[j];
                 SDL_Rect dst;
                 dst.w = model->offsets[j].w;
                 dst.h = model->offsets[j].h;
-                dst.x = view_to_screen_x(view_x, view_y) + offset->x;
-                dst.y = view_to_screen_y(view_x, view_y, view_z) - offset->y;
+                dst.x = screen_x + offset->x;
+                dst.y = screen_y - offset->y;
                 Uint8 alpha =
                         (flags & MODEL_RENDER_FLAG_TRANSPARENT) ? 128 : 255;
-                SDL_SetTextureAlphaMod(texture, alpha);
-                SDL_SetTextureColorMod(texture, red, grn, blu);
-                SDL_RenderCopy(renderer, texture, NULL, &dst);
+                draw_list_add(draws, &model->srcs[j], &dst, red, grn, blu,
+                              alpha);
         }
 }
 
 
-static bool render_level(SDL_Renderer * renderer, SDL_Texture ** textures,
-                         session_t * session, area_t *area, int map_level)
+/**
+ * Get the pixel at a map location, or equivalently at its location in the
+ * pre-rotated maps if those are in use.
+ */
+static inline pixel_t level_pixel_at(session_t * session, int level,
+                                     point_t mloc, point_t qloc)
 {
-        SDL_Rect src, dst;
-        view_t *view = &session->view;
-        int cursor_level = Z2L(view->cursor[Z]);
-        int map_z = map_level * Z_PER_LEVEL;
-        //int view_z = (map_level - cursor_level) * Z_PER_LEVEL;
-        int view_z = (map_z - view->cursor[Z]);
-        static const int cursor_h = Z_PER_LEVEL;
-        int cursor_top_z = view->cursor[Z] + cursor_h;
-        bool clipped_pillar = false;
-        bool top_of_stairs = false;
-        bool enable_cutaway = cursor_level == map_level || cursor_top_z > map_z;
-        map_t *map = area_get_map_at_level(area, map_level);
-
-        src.x = 0;
-        src.y = 0;
-        src.w = TILE_WIDTH;
-        src.h = TILE_HEIGHT;
-
-        /* Render the map as a tiled view */
-        for (int view_y = 0; view_y < VIEW_H; view_y++) {
-                for (int view_x = 0; view_x < VIEW_W; view_x++) {
-                        point_t vloc = { view_x, view_y, view_z };
-                        point_t mloc = { 0, 0, 0 };
-                        view_to_map(view, vloc, mloc);
-                        mloc[Z] = map_z;
-                        int map_y = mloc[Y];
-                        int map_x = mloc[X];
-                        Uint8 model_index = 0;
+        if (session->prerotated) {
+                return rotmap_get_pixel(&session->rotmap,
+                                        session->view.rotation, level,
+                                        qloc[X], qloc[Y]);
+        }
+        return area_get_pixel(&session->area, level, mloc[X], mloc[Y]);
+}
 
-                        if (!(map_contains(map, map_x, map_y))) {
+/**
+ * Draw what a level looks like with nothing dynamic on it into its layer:
+ * every tile as its plain model, skipping what the levels up to the cursor's
+ * cover. Only the part in `clip` changes, unless that is NULL.
+ */
+static void render_layer(atlas_t * atlas, session_t * session, layer_t * layer,
+                         int level, const SDL_Rect * clip)
+{
+        draw_list_t *draws = &session->draws;
+        area_t *area = &session->area;
+        int ox = LAYER_OFFSET - VIEW_OFFSET;
+        int oy = LAYER_MARGIN * TILE_HEIGHT + LAYER_TOP;
+
+        draw_list_clear(draws);
+        for (int ly = 0; ly < LAYER_TILES; ly++) {
+                for (int lx = 0; lx < LAYER_TILES; lx++) {
+                        SDL_Rect *rect = &layer->rects[ly * LAYER_TILES + lx];
+                        int view_x = lx - LAYER_MARGIN, view_y = ly - LAYER_MARGIN;
+                        point_t mloc = { view_to_camera_x(view_x),
+                                         view_to_camera_y(view_y), 0 };
+                        int first = draws->n_draws;
+                        bool skip = false;
+                        pixel_t pixel;
+
+                        rect->w = rect->h = 0;
+                        point_rotate(mloc, session->view.rotation);
+                        mloc[X] += layer->anchor[X];
+                        mloc[Y] += layer->anchor[Y];
+                        if (!area_contains(area, mloc[X], mloc[Y])) {
+                                continue;
+                        }
+                        for (int lvl = level + 1; lvl <= layer->cursor_level;
+                             lvl++) {
+                                if (area_has_level(area, lvl) &&
+                                    area_get_pixel(area, lvl, mloc[X],
+                                                   mloc[Y])) {
+                                        skip = true;
+                                        break;
+                                }
+                        }
+                        if (skip || !(pixel = area_get_pixel(area, level,
+                                                             mloc[X],
+                                                             mloc[Y]))) {
                                 continue;
                         }
 
-                        if (!view_in_fov(view, mloc)) {
-
+                        if (pixel == PIXEL_VALUE_GRASS) {
+                                SDL_Rect dst;
                                 dst.x = view_to_screen_x(view_x, view_y);
-                                dst.y = view_to_screen_y(view_x, view_y, view_z);
+                                dst.y = view_to_screen_y(view_x, view_y, 0);
                                 dst.w = TILE_WIDTH;
                                 dst.h = TILE_HEIGHT;
-                                SDL_SetTextureColorMod(textures[TEXTURE_TOP], 0, 0, 16);
-                                SDL_RenderCopy(renderer,
-                                               textures[TEXTURE_TOP],
-                                               &src, &dst);
-                                continue;
+                                draw_list_add(draws,
+                                              &atlas->rects[TEXTURE_GRASS],
+                                              &dst, 255, 255, 255, 255);
+                        } else if (PIXEL_MODEL(pixel) < N_MODELS) {
+                                model_render(draws, session_sprites(session),
+                                             &models[PIXEL_MODEL(pixel)],
+                                             view_to_screen_x(view_x, view_y),
+                                             view_to_screen_y(view_x, view_y,
+                                                              0),
+                                             PIXEL_RED(pixel),
+                                             PIXEL_GREEN(pixel),
+                                             PIXEL_BLUE(pixel), 0);
                         }
 
-                        if (map_level < cursor_level) {
-                                int lvl = map_level;
-                                int skip = false;
-                                while (lvl < cursor_level) {
-                                        lvl++;
-                                        map_t *map = area_get_map_at_level(area, lvl);
-                                        if (map && map_get_pixel (map, map_x, map_y)) {
-                                                skip = true;
-                                                break;
-                                        }
-                                }
-                                if (skip) {
-                                        continue;
+                        /* Move the tile from the view onto the layer and
+                         * remember where it went. */
+                        for (int i = first; i < draws->n_draws; i++) {
+                                SDL_Rect *dst = &draws->draws[i].dst;
+                                dst->x += ox;
+                                dst->y += oy;
+                                if (i == first) {
+                                        *rect = *dst;
+                                } else {
+                                        SDL_UnionRect(rect, dst, rect);
                                 }
                         }
+                }
+        }
 
-                        /* Draw the terrain */
-                        pixel_t pixel =
-                                map_get_pixel(map, map_x, map_y);
-                        if (!pixel) {
-                                /* transparent, nothing there */
-                                goto draw_cursor;
-                        }
-                        model_t *model = NULL;
-                        int flags = 0;
+        layer_draw(&session->layers, layer, draws, clip);
+        draw_list_clear(draws);
+}
 
-                        switch (pixel) {
-                        case PIXEL_VALUE_GRASS:
+/**
+ * Get the layer for a level ready for the current view, drawing it again if
+ * the cursor left its window or some of it if the maps changed. Returns false
+ * if there is no layer.
+ */
+static bool layer_line_up(atlas_t * atlas, session_t * session, int level,
+                          layer_view_t * lv)
+{
+        view_t *view = &session->view;
+        const matrix_t *m = &rotations[view->rotation];
+        int cursor_level = Z2L(view->cursor[Z]);
+        layer_t *layer;
+        int dx, dy, cx, cy;
 
-                                dst.x = view_to_screen_x(view_x, view_y);
-                                dst.y = view_to_screen_y(view_x, view_y, view_z);
-                                dst.w = TILE_WIDTH;
-                                dst.h = TILE_HEIGHT;
+        if (!(layer = layer_get(&session->layers, level, view->rotation))) {
+                return false;
+        }
 
-                                if (session->transparency &&
-                                    blocks_fov(view_x, view_y, 1)) {
-                                        SDL_SetTextureAlphaMod(textures
-                                                               [TEXTURE_GRASS],
-                                                               128);
-                                } else {
+        /* The inverse of a rotation is its transpose. */
+        cx = view->cursor[X] - layer->anchor[X];
+        cy = view->cursor[Y] - layer->anchor[Y];
+        dx = cx * (*m)[0][0] + cy * (*m)[1][0];
+        dy = cx * (*m)[0][1] + cy * (*m)[1][1];
+
+        if (!layer->valid || layer->cursor_level != cursor_level ||
+            abs(dx) > LAYER_MARGIN || abs(dy) > LAYER_MARGIN) {
+                point_copy(layer->anchor, view->cursor);
+                layer->cursor_level = cursor_level;
+                render_layer(atlas, session, layer, level, NULL);
+                layer->valid = true;
+                layer_clean(layer);
+                dx = dy = 0;
+        } else if (layer_is_dirty(layer)) {
+                int lx[2], ly[2];
+                SDL_Rect clip, bounds = { 0, 0, LAYER_PIXEL_W, LAYER_PIXEL_H };
+
+                /* Find the window tiles at two corners of the changes. */
+                for (int i = 0; i < 2; i++) {
+                        cx = (i ? layer->x1 - 1 : layer->x0) - layer->anchor[X];
+                        cy = (i ? layer->y1 - 1 : layer->y0) - layer->anchor[Y];
+                        lx[i] = cx * (*m)[0][0] + cy * (*m)[1][0] +
+                                VIEW_W / 2 + LAYER_MARGIN;
+                        ly[i] = cx * (*m)[0][1] + cy * (*m)[1][1] +
+                                VIEW_H / 2 + LAYER_MARGIN;
+                }
 
-                                        SDL_SetTextureAlphaMod(textures
-                                                               [TEXTURE_GRASS],
-                                                               255);
-                                }
+                /* Take in everything the tiles between them can cover. */
+                clip.x = (min(lx[0], lx[1]) - max(ly[0], ly[1])) *
+                        TILE_WIDTH_HALF + LAYER_OFFSET;
+                clip.y = (min(lx[0], lx[1]) + min(ly[0], ly[1])) *
+                        TILE_HEIGHT_HALF;
+                clip.w = (abs(lx[1] - lx[0]) + abs(ly[1] - ly[0]) + 2) *
+                        TILE_WIDTH_HALF;
+                clip.h = (abs(lx[1] - lx[0]) + abs(ly[1] - ly[0]) + 2) *
+                        TILE_HEIGHT_HALF + LAYER_TOP;
+                if (SDL_IntersectRect(&clip, &bounds, &clip)) {
+                        render_layer(atlas, session, layer, level, &clip);
+                }
+                layer_clean(layer);
+        }
 
-                                SDL_RenderCopy(renderer,
-                                               textures[TEXTURE_GRASS],
-                                               &src, &dst);
-                                break;
-                        default:
-                                model_index = PIXEL_MODEL(pixel);
-                                if (model_index >= N_MODELS) {
-                                        printf
-                                                ("Unknown pixel value: 0x%08x at (%d, %d, %d) model %d\n",
-                                                 pixel, map_x, map_y,
-                                                 view_z, model_index);
-                                } else {
-                                        model = &models[model_index];
-                                        if (session->transparency &&
-                                            blocks_fov(view_x, view_y,
-                                                       model->tile_h)) {
-                                                flags |=
-                                                        MODEL_RENDER_FLAG_TRANSPARENT;
-                                        }
+        lv->layer = layer;
+        lv->dx = dx;
+        lv->dy = dy;
+        lv->px = (dx - dy) * TILE_WIDTH_HALF + LAYER_OFFSET - VIEW_OFFSET;
+        lv->py = (2 * LAYER_MARGIN + dx + dy) * TILE_HEIGHT_HALF + LAYER_TOP +
+                (L2Z(level) - view->cursor[Z]) * TILE_HEIGHT;
+
+        return true;
+}
+
+/**
+ * Mark the screen cells where a tile doesn't look like it does in the layer.
+ * Its draws start at `first`.
+ */
+static void layer_mark_tile(session_t * session, layer_view_t * lv,
+                            int view_x, int view_y, int first)
+{
+        draw_list_t *draws = &session->draws;
+        int lx = view_x + LAYER_MARGIN + lv->dx;
+        int ly = view_y + LAYER_MARGIN + lv->dy;
+        SDL_Rect rect = lv->layer->rects[ly * LAYER_TILES + lx];
+
+        rect.x -= lv->px;
+        rect.y -= lv->py;
+        layer_cells_mark(&session->layers, &rect);
+        for (int i = first; i < draws->n_draws; i++) {
+                layer_cells_mark(&session->layers, &draws->draws[i].dst);
+        }
+}
 
-                                        if (PIXEL_IS_OPAQUE(pixel) &&
-                                            !PIXEL_IS_STAIRS(pixel)) {
+/**
+ * Mark the screen cells where tiles the layer has but the view doesn't
+ * show up.
+ */
+static void layer_mark_outside(session_t * session, layer_view_t * lv)
+{
+        for (int ly = 0; ly < LAYER_TILES; ly++) {
+                int view_y = ly - LAYER_MARGIN - lv->dy;
+                for (int lx = 0; lx < LAYER_TILES; lx++) {
+                        int view_x = lx - LAYER_MARGIN - lv->dx;
+                        SDL_Rect rect = lv->layer->rects[ly * LAYER_TILES + lx];
+
+                        if ((between_inc(view_x, 0, VIEW_W - 1) &&
+                             between_inc(view_y, 0, VIEW_H - 1)) || !rect.w) {
+                                continue;
+                        }
+                        rect.x -= lv->px;
+                        rect.y -= lv->py;
+                        layer_cells_mark(&session->layers, &rect);
+                }
+        }
+}
 
-                                                /* Cut away walls if they are on the same level as the cursor. */
-                                                bool cutaway = enable_cutaway && cutaway_at(vloc);
+/**
+ * Decide what a view tile draws on `level`, from its spot on the map and its
+ * pixels. Those are needed from `level` up to the one above it or the
+ * cursor's, whichever is higher, with 0 where there is no level. Returns
+ * false if it draws nothing.
+ */
+static bool tile_plan(session_t * session, int level, int index,
+                      point_t mloc, const pixel_t * pixels,
+                      tile_plan_t * tile)
+{
+        view_t *view = &session->view;
+        area_t *area = &session->area;
+        int cursor_level = Z2L(view->cursor[Z]);
+        int cursor_top_z = view->cursor[Z] + Z_PER_LEVEL;
+        int map_z = L2Z(level);
+        point_t vloc = { index % VIEW_W, index / VIEW_W, 0 };
+        point_t floc = { mloc[X], mloc[Y], map_z };
+        pixel_t pixel = pixels[level];
+
+        tile->index = index;
+        tile->pixel = pixel;
+        tile->fog = false;
+        tile->cutaway = false;
+        tile->model = -1;
+        tile->tile_h = 1;
+        tile->cursor = -1;
+        tile->cursor_z = 0;
+        tile->clipped_pillar = false;
+        tile->top_of_stairs = false;
+
+        if (!view_in_fov(view, floc)) {
+                tile->fog = true;
+                return true;
+        }
 
-                                                if (cutaway) {
+        /* Hidden under a level up to the cursor's. */
+        for (int l = level + 1; l <= cursor_level && area_has_level(area, l);
+             l++) {
+                if (pixels[l]) {
+                        return false;
+                }
+        }
 
-                                                        /* Use truncated model. */
-                                                        model = &models [MODEL_INTERIOR];
+        if (pixel && pixel != PIXEL_VALUE_GRASS) {
+                int model_index = PIXEL_MODEL(pixel);
+                if (model_index >= N_MODELS) {
+                        printf
+                            ("Unknown pixel value: 0x%08x at (%d, %d, %d) model %d\n",
+                             pixel, mloc[X], mloc[Y], map_z - view->cursor[Z],
+                             model_index);
+                } else {
+                        tile->model = model_index;
+                        tile->tile_h = models[model_index].tile_h;
+                }
+        }
 
-                                                        /* Check for a ceiling on a clipped wall. */
-                                                        if (!clipped_pillar && map_level == cursor_level) {
-                                                                map_t *map = area_get_map_at_level(area, map_level + 1);
-                                                                if (map && map_get_pixel (map, map_x, map_y)) {
-                                                                        clipped_pillar = true;
-                                                                }
-                                                        }
-                                                }
-                                        }
+        /* Cut away walls if they are on the same level as the cursor. */
+        if (tile->model >= 0 && PIXEL_IS_OPAQUE(pixel) &&
+            !PIXEL_IS_STAIRS(pixel) &&
+            (cursor_level == level || cursor_top_z > map_z) &&
+            cutaway_at(vloc)) {
+                tile->model = MODEL_INTERIOR;
+                tile->cutaway = true;
+
+                /* Check for a ceiling on a clipped wall. */
+                tile->clipped_pillar = (level == cursor_level &&
+                                        area_has_level(area, level + 1) &&
+                                        pixels[level + 1]);
+        }
 
-                                        model_render(renderer, model,
-                                                     view_x, view_y,
-                                                     view_z,
-                                                     PIXEL_RED(pixel),
-                                                     PIXEL_GREEN(pixel),
-                                                     PIXEL_BLUE(pixel),
-                                                     flags);
-                                }
-                                break;
-                        }
-                        view_set_rendered(view_x, view_y,
-                                          model ? model->tile_h : 1);
-
-                draw_cursor:
-                        /* Draw the cursor if this is where it is. */
-                        if (cursor_top_z > map_z &&
-                            map_level >= cursor_level &&
-                            map_x == view->cursor[X] &&
-                            map_y == view->cursor[Y]) {
-                                int off_z = 0;
-
-                                /* Model is sticking up from map below, shorten it. */
-                                if (view->cursor[Z] < map_z) {
-                                        model = &models[MODEL_H2I(cursor_top_z - map_z)];
-                                } else {
-                                        model = &models[MODEL_5x1x1];
-                                        off_z = view->cursor[Z] - map_z;
-                                }
+        /* Draw the cursor if this is where it is. */
+        if (cursor_top_z > map_z && level >= cursor_level &&
+            mloc[X] == view->cursor[X] && mloc[Y] == view->cursor[Y]) {
 
-                                /* If cursor is on the stairs offset it up. Note
-                                 * if it is on top of the stairs, we'll show
-                                 * the next level in that case. */
-                                if (PIXEL_IS_STAIRS(pixel)) {
-                                        if (PIXEL_HEIGHT(pixel) > 1) {
-                                                top_of_stairs = true;
-                                        }
-                                }
-                                model_render(renderer,
-                                             model,
-                                             view_x, view_y,
-                                             view_z + off_z, 255, 128,
-                                             64, 0);
-                        }
+                /* Model is sticking up from map below, shorten it. */
+                if (view->cursor[Z] < map_z) {
+                        tile->cursor = MODEL_H2I(cursor_top_z - map_z);
+                } else {
+                        tile->cursor = MODEL_5x1x1;
+                        tile->cursor_z = view->cursor[Z] - map_z;
                 }
+
+                /* If cursor is on the stairs offset it up. Note if it is on
+                 * top of the stairs, we'll show the next level in that
+                 * case. */
+                tile->top_of_stairs = (PIXEL_IS_STAIRS(pixel) &&
+                                       PIXEL_HEIGHT(pixel) > 1);
         }
 
-        return !clipped_pillar || top_of_stairs;
+        return pixel || tile->cursor >= 0;
 }
 
-static void render(SDL_Renderer * renderer, SDL_Texture ** textures,
-                   session_t * session)
+/**
+ * Add the draws a tile planned to `draws`, for a level `screen_z` pixels up
+ * the screen. What is in front of the fov is made see-through, going by what
+ * `rendered` says was drawn before. Returns true if the draws can differ
+ * from the ones in the level's layer.
+ */
+static bool tile_emit(atlas_t * atlas, session_t * session,
+                      const tile_plan_t * tile, int screen_z,
+                      draw_list_t * draws)
 {
-        clear_screen(renderer);
+        sprite_cache_t *sprites = session_sprites(session);
+        int view_x = tile->index % VIEW_W;
+        int view_y = tile->index / VIEW_W;
+        int screen_x = view_screen[tile->index].x;
+        int screen_y = view_screen[tile->index].y - screen_z;
+        pixel_t pixel = tile->pixel;
+        SDL_Rect dst = { screen_x, screen_y, TILE_WIDTH, TILE_HEIGHT };
+        bool dynamic = tile->cutaway;
+
+        if (tile->fog) {
+                draw_list_add(draws, &atlas->rects[TEXTURE_TOP], &dst,
+                              0, 0, 16, 255);
+                return true;
+        }
+
+        if (pixel == PIXEL_VALUE_GRASS) {
+                Uint8 alpha = (session->transparency &&
+                               blocks_fov(view_x, view_y, 1)) ? 128 : 255;
+                draw_list_add(draws, &atlas->rects[TEXTURE_GRASS], &dst,
+                              255, 255, 255, alpha);
+                view_set_rendered(view_x, view_y, 1);
+                dynamic |= alpha != 255;
+        } else if (tile->model >= 0) {
+                model_t *model = &models[tile->model];
+                int flags = 0;
+
+                if (session->transparency &&
+                    blocks_fov(view_x, view_y, tile->tile_h)) {
+                        flags |= MODEL_RENDER_FLAG_TRANSPARENT;
+                        dynamic = true;
+                }
+                model_render(draws, sprites, model, screen_x, screen_y,
+                             PIXEL_RED(pixel), PIXEL_GREEN(pixel),
+                             PIXEL_BLUE(pixel), flags);
+                view_set_rendered(view_x, view_y, model->tile_h);
+        } else if (pixel) {
+                view_set_rendered(view_x, view_y, 1);
+        }
+
+        if (tile->cursor >= 0) {
+                model_render(draws, sprites, &models[tile->cursor], screen_x,
+                             screen_y - tile->cursor_z * TILE_HEIGHT,
+                             255, 128, 64, 0);
+                dynamic = true;
+        }
+
+        return dynamic;
+}
 
+/**
+ * Add the draws for a strip of a level to `draws`. The tiles go in painter's
+ * order. A tile only depends on the ones before it on its own diagonal,
+ * through what `rendered` says is in front of it, so different strips can be
+ * done at the same time.
+ */
+static void render_strip(level_pass_t * pass, strip_t * strip,
+                         draw_list_t * draws)
+{
+        session_t *session = pass->session;
+        area_t *area = pass->area;
+        int map_level = pass->map_level;
+        layer_view_t *lv = pass->lv;
         view_t *view = &session->view;
         int cursor_level = Z2L(view->cursor[Z]);
+        int top_level = min(max(cursor_level, map_level + 1),
+                            area->n_maps - 1);
+        int screen_z = (L2Z(map_level) - view->cursor[Z]) * TILE_HEIGHT;
+        bool clipped_pillar = false;
+        bool top_of_stairs = false;
+        point_t qcursor = { 0, 0, 0 };
 
-        /* Clear the rendered buffer */
-        view_clear_rendered();
+        if (session->prerotated) {
+                rotmap_to_rotated(&session->rotmap, view->rotation,
+                                  view->cursor, qcursor);
+        }
 
-        /* Recompute fov based on player's position */
-        view_calc_fov(view);
+        /* Render the map as a tiled view */
+        for (int view_y = 0; view_y < VIEW_H; view_y++) {
+                int x0 = max(0, strip->d0 + view_y);
+                int x1 = min(VIEW_W, strip->d1 + view_y);
+                for (int view_x = x0, index = view_y * VIEW_W + x0;
+                     view_x < x1; view_x++, index++) {
+                        point_t mloc = { 0, 0, 0 };
+                        point_t qloc = { view_to_camera_x(view_x) + qcursor[X],
+                                         view_to_camera_y(view_y) + qcursor[Y],
+                                         0 };
+                        pixel_t pixels[N_MAPS] = { 0 };
+                        int first = draws->n_draws;
+                        tile_plan_t tile;
+                        bool dynamic;   /* not as in the layer */
+
+                        if (pass->spans) {
+                                tile_span_t *span = &pass->spans[index];
+                                span->strip = strip->index;
+                                span->first = first;
+                                span->n = 0;
+                                span->dynamic = false;
+                        }
 
-        /* Render the maps in z order */
-        for (int i = 0; i < session->area.n_maps; i++) {
-                map_t *map = session->area.maps[i];
-
-                /* But if the cursor is now directly underneath a tile on a
-                 * higher level, stop rendering higher levels. This implements
-                 * roof clipping. What if the cursor is standing under a hole?
-                 * The roof won't get clipped, I think, when it probably
-                 * should. */
-                if ((i > cursor_level) &&
-                    map_get_pixel(map, view->cursor[X], view->cursor[Y])) {
-                        break;
-                }
+                        view_index_to_map(view, index, mloc);
+                        if (!(area_contains(area, mloc[X], mloc[Y]))) {
+                                continue;
+                        }
 
-                /* Or if the rendering says to stop, then clip the higher
-                 * levels. */
-                if (!render_level(renderer, textures, session, &session->area, i)) {
-                        break;
+                        for (int l = map_level; l <= top_level; l++) {
+                                pixels[l] = level_pixel_at(session, l, mloc,
+                                                           qloc);
+                        }
+                        if (!tile_plan(session, map_level, index, mloc,
+                                       pixels, &tile)) {
+                                continue;
+                        }
+                        dynamic = tile_emit(pass->atlas, session, &tile,
+                                            screen_z, draws);
+                        clipped_pillar |= tile.clipped_pillar;
+                        top_of_stairs |= tile.top_of_stairs;
+
+                        if (pass->spans) {
+                                pass->spans[index].n = draws->n_draws - first;
+                                pass->spans[index].dynamic = dynamic;
+                        } else if (lv && dynamic) {
+                                layer_mark_tile(session, lv, view_x, view_y,
+                                                first);
+                        }
                 }
-
         }
 
-        /* Paint the grid */
-        SDL_SetRenderDrawColor(renderer, 0, 64, 64, 128);
-        iso_grid(renderer, VIEW_W, VIEW_H);
+        strip->clipped_pillar = clipped_pillar;
+        strip->top_of_stairs = top_of_stairs;
+}
 
-        /* Paint a red square for a cursor position */
-        point_t vloc;
-        map_to_view(vloc, view->cursor, view->cursor);
-        SDL_SetRenderDrawColor(renderer, 255, 0, 0, SDL_ALPHA_OPAQUE);
-        iso_square(renderer, VIEW_H, vloc[X], vloc[Y]);
+static void render_strip_job(void *data, int job)
+{
+        level_pass_t *pass = data;
+        strip_t *strip = &pass->session->strips[job];
 
-        SDL_RenderPresent(renderer);
+        draw_list_clear(&strip->draws);
+        render_strip(pass, strip, &strip->draws);
 }
 
-static SDL_Texture *load_texture(SDL_Renderer * renderer, const char *filename)
+/**
+ * Add the draws for a level to the frame, on the pool if there is one.
+ * Returns false if higher levels should not be drawn.
+ */
+static bool render_level(atlas_t * atlas, session_t * session, area_t *area,
+                         int map_level, layer_view_t * lv)
 {
-        SDL_Surface *surface = NULL;
-        SDL_Texture *texture = NULL;
-
-        if (!(surface = IMG_Load(filename))) {
-                printf("%s:IMG_Load:%s\n", __FUNCTION__, SDL_GetError());
-                return NULL;
+        level_pass_t pass = { atlas, session, area, map_level, lv, NULL };
+        bool clipped_pillar = false, top_of_stairs = false;
+
+        /* Compressed areas decode through a shared cache. */
+        if (!session->pool || area->store) {
+                strip_t whole = { .index = -1, .d0 = 1 - VIEW_H,
+                        .d1 = VIEW_W };
+                render_strip(&pass, &whole, &session->draws);
+                return !whole.clipped_pillar || whole.top_of_stairs;
         }
 
-        if (!(texture = SDL_CreateTextureFromSurface(renderer, surface))) {
-                printf("%s:SDL_CreateTextureFromSurface:%s\n",
-                       __FUNCTION__, SDL_GetError());
-        }
+        pass.spans = session->spans;
+        pool_run(session->pool, render_strip_job, &pass, session->n_strips);
 
-        printf("%s %dx%d\n", filename, surface->w, surface->h);
+        /* Gather the tiles back into painter's order. */
+        for (int view_y = 0, index = 0; view_y < VIEW_H; view_y++) {
+                for (int view_x = 0; view_x < VIEW_W; view_x++, index++) {
+                        tile_span_t *span = &session->spans[index];
+                        int first = session->draws.n_draws;
+
+                        if (span->n) {
+                                strip_t *strip = &session->strips[span->strip];
+                                draw_list_append(&session->draws,
+                                                 &strip->draws.draws
+                                                 [span->first], span->n);
+                        }
+                        if (lv && span->dynamic) {
+                                layer_mark_tile(session, lv, view_x, view_y,
+                                                first);
+                        }
+                }
+        }
 
-        SDL_FreeSurface(surface);
+        for (int i = 0; i < session->n_strips; i++) {
+                clipped_pillar |= session->strips[i].clipped_pillar;
+                top_of_stairs |= session->strips[i].top_of_stairs;
+        }
 
-        return texture;
+        return !clipped_pillar || top_of_stairs;
 }
 
 /**
- * Handle button clicks.
+ * Count the levels that get drawn, those under the first roof over the
+ * cursor above its own level. This implements roof clipping. What if the
+ * cursor is standing under a hole? The roof won't get clipped, I think, when
+ * it probably should.
  */
-void on_mouse_button(SDL_MouseButtonEvent * event, session_t * session)
+static int levels_under_roof(session_t * session)
 {
         view_t *view = &session->view;
-        point_t vloc = { 0, 0, 0 };
-        vloc[X] = screen_to_view_x(event->x, event->y);
-        vloc[Y] = screen_to_view_y(event->x, event->y);
-        int cam_x = view_to_camera_x(vloc[X]);
-        int cam_y = view_to_camera_y(vloc[Y]);
-        point_t mloc = { 0, 0, 0 };
-        view_to_map(view, vloc, mloc);
-        bool cutaway = cutaway_at(vloc);
 
-        printf("s(%d, %d)->v(%d, %d)->c(%d, %d)->m(%d, %d)->%c %c\n",
-               event->x, event->y,
-               vloc[X], vloc[Y],
-               cam_x, cam_y,
-               mloc[X], mloc[Y],
-               view_rendered_at(vloc[X], vloc[Y]) ? 't' : 'f',
-               cutaway ? 't' : 'f');
+        for (int l = max(0, Z2L(view->cursor[Z]) + 1);
+             l < session->area.n_maps; l++) {
+                if (area_get_pixel(&session->area, l, view->cursor[X],
+                                   view->cursor[Y])) {
+                        return l;
+                }
+        }
+
+        return session->area.n_maps;
 }
 
-bool move_cursor(area_t *area, view_t * view, const point_t dir)
+/**
+ * Call `fn` on each level under the roof from the bottom up, stopping early
+ * if it says to.
+ */
+static void walk_levels(atlas_t * atlas, session_t * session, level_fn fn,
+                        void *data)
 {
-        point_t newcur, rdir;
-        map_t *map;
+        int n_levels = levels_under_roof(session);
 
-        /* Figure out where the new point is, at least horizontally. */
-        point_copy(newcur, view->cursor);
-        point_copy(rdir, dir);
-        rdir[Z] = L2Z(dir[Z]);  /* dir z is # levels */
-        point_rotate(rdir, view->rotation);
-        point_translate(newcur, rdir);
-
-        /* While there is a map at this level that contains the (x, y)
-         * coordinates...  */
-        while ((map = area_get_map_at_level(area, Z2L(newcur[Z]))) &&
-               map_contains(map, newcur[X], newcur[Y])) {
-
-                /* Find the terrain there. */
-                pixel_t pix = map_get_pixel(map, newcur[X], newcur[Y]);
-                if (! pix) {
-                        /* If there's a hole there, try the next level down... */
-                        newcur[Z] -= Z_PER_LEVEL;
-                } else {
-                        /* Else if it's passable */
-                        if (PIXEL_IS_IMPASSABLE(pix)) {
-                                if (! PIXEL_IS_STAIRS(pix)) {
-                                        return false;
-                                }
-                                int lvl_z = L2Z(Z2L(newcur[Z]));
-                                int new_z =  (PIXEL_HEIGHT(pix) + lvl_z);
-                                if ((new_z - view->cursor[Z]) > 1) {
-                                        return false; /* Can't climb more than 1 step at a time */
-                                }
-                                if (!(map = area_get_map_at_level(area, Z2L(new_z))) ||
-                                    !map_contains(map, newcur[X], newcur[Y])) {
-                                        return false;
-                                }
-                                point_copy(view->cursor, newcur);
-                                view->cursor[Z] = new_z;
-                                return true;
-                        }
-                        int new_z = L2Z(Z2L(newcur[Z]));
-                        point_copy(view->cursor, newcur);
-                        view->cursor[Z] = new_z;
-                        return true;
+        for (int l = 0; l < n_levels; l++) {
+                if (!fn(atlas, session, l, data)) {
+                        break;
                 }
         }
-        return false;
 }
 
-
 /**
- * Handle key presses.
+ * Start a pool of `n_threads` (zero for one per CPU) to draw levels in
+ * strips, a few per thread so the busy middle diagonals get shared out.
  */
-void on_keydown(SDL_KeyboardEvent * event, int *quit, session_t * session)
+static int session_strips_init(session_t * session, SDL_Texture * texture,
+                               int n_threads)
 {
-        area_t *area = &session->area;
-        view_t *view = &session->view;
-        static const point_t directions[N_DIR] = {
-                {-1, 0, 0},     /* left */
-                {1, 0, 0},      /* right */
-                {0, -1, 0},     /* up */
-                {0, 1, 0},      /* down */
-                {0, 0, 1},      /* vert up */
-                {0, 0, -1}      /* vert down */
-        };
+        int n_diagonals = VIEW_W + VIEW_H - 1, res, d, count;
 
-        switch (event->keysym.sym) {
-        case SDLK_LEFT:
-                move_cursor(area, view, directions[DIR_XLEFT]);
+        if (!(session->pool = calloc(1, sizeof (pool_t)))) {
+                return ERROR_ALLOC;
+        }
+        if ((res = pool_init(session->pool, n_threads))) {
+                free(session->pool);
+                session->pool = NULL;
+                return res;
+        }
+
+        session->n_strips = min(4 * pool_size(session->pool), n_diagonals);
+        if (!(session->strips = calloc(session->n_strips, sizeof (strip_t)))) {
+                return ERROR_ALLOC;
+        }
+
+        /* Cut the diagonals into strips with about as many tiles each. */
+        d = 1 - VIEW_H;
+        count = 0;
+        for (int i = 0; i < session->n_strips; i++) {
+                strip_t *strip = &session->strips[i];
+                int goal = (i + 1) * VIEW_W * VIEW_H / session->n_strips;
+
+                if ((res = draw_list_init(&strip->draws, texture, NULL))) {
+                        return res;
+                }
+                strip->index = i;
+                strip->d0 = d;
+                while (d < VIEW_W && (count < goal ||
+                                      i == session->n_strips - 1)) {
+                        count += min(VIEW_H, VIEW_W - d) - max(0, -d);
+                        d++;
+                }
+                strip->d1 = d;
+        }
+
+        return 0;
+}
+
+static void session_strips_deinit(session_t * session)
+{
+        if (session->pool) {
+                pool_deinit(session->pool);
+                free(session->pool);
+        }
+        for (int i = 0; i < session->n_strips; i++) {
+                draw_list_deinit(&session->strips[i].draws);
+        }
+        free(session->strips);
+        session->pool = NULL;
+        session->strips = NULL;
+        session->n_strips = 0;
+}
+
+/**
+ * Walk the view once, going up each tile's stack of levels, and put what the
+ * tile has to draw in each level's bucket. The map lookups are done once per
+ * tile instead of once per tile and level. Only the levels under the roof
+ * get buckets.
+ */
+static void fused_walk(session_t * session)
+{
+        fused_t *fused = session->fused;
+        view_t *view = &session->view;
+        area_t *area = &session->area;
+        int n_levels = levels_under_roof(session);
+        point_t qcursor = { 0, 0, 0 };
+
+        if (session->prerotated) {
+                rotmap_to_rotated(&session->rotmap, view->rotation,
+                                  view->cursor, qcursor);
+        }
+
+        for (int l = 0; l < n_levels; l++) {
+                fused->counts[l] = 0;
+                fused->clipped_pillar[l] = false;
+                fused->top_of_stairs[l] = false;
+        }
+
+        for (int view_y = 0, index = 0; view_y < VIEW_H; view_y++) {
+                for (int view_x = 0; view_x < VIEW_W; view_x++, index++) {
+                        point_t mloc = { 0, 0, 0 };
+                        point_t qloc = { view_to_camera_x(view_x) + qcursor[X],
+                                         view_to_camera_y(view_y) + qcursor[Y],
+                                         0 };
+                        pixel_t pixels[N_MAPS] = { 0 };
+
+                        view_index_to_map(view, index, mloc);
+                        if (!area_contains(area, mloc[X], mloc[Y])) {
+                                continue;
+                        }
+                        for (int l = 0; l < area->n_maps; l++) {
+                                pixels[l] = level_pixel_at(session, l, mloc,
+                                                           qloc);
+                        }
+
+                        for (int l = 0; l < n_levels; l++) {
+                                tile_plan_t *tile =
+                                    &fused->tiles[l][fused->counts[l]];
+
+                                if (!tile_plan(session, l, index, mloc,
+                                               pixels, tile)) {
+                                        continue;
+                                }
+                                fused->counts[l]++;
+                                fused->clipped_pillar[l] |=
+                                    tile->clipped_pillar;
+                                fused->top_of_stairs[l] |= tile->top_of_stairs;
+                        }
+                }
+        }
+}
+
+/**
+ * Turn a level's bucket into draws. All that is left to decide is what
+ * depends on the tiles drawn before it, the transparency.
+ */
+static void fused_emit(atlas_t * atlas, session_t * session, int level)
+{
+        fused_t *fused = session->fused;
+        int screen_z = (L2Z(level) - session->view.cursor[Z]) * TILE_HEIGHT;
+
+        for (int i = 0; i < fused->counts[level]; i++) {
+                tile_emit(atlas, session, &fused->tiles[level][i], screen_z,
+                          &session->draws);
+        }
+}
+
+static bool fused_level(atlas_t * atlas, session_t * session, int level,
+                        void *data)
+{
+        fused_emit(atlas, session, level);
+        return (!session->fused->clipped_pillar[level] ||
+                session->fused->top_of_stairs[level]);
+}
+
+/**
+ * Add the draws for every level to the frame from one walk over the view.
+ * They come out the same and in the same order as from render_level() on
+ * each level in turn.
+ */
+static void render_fused(atlas_t * atlas, session_t * session)
+{
+        fused_walk(session);
+        walk_levels(atlas, session, fused_level, NULL);
+}
+
+/**
+ * Draw the tiles in the list and empty it.
+ */
+static void submit_draws(SDL_Renderer * renderer, session_t * session)
+{
+        session->n_draws += session->draws.n_draws;
+        if (session->use_blit) {
+                /* Let SDL finish what it was asked to draw first. */
+#if SDL_VERSION_ATLEAST(2, 0, 10)
+                SDL_RenderFlush(renderer);
+#endif
+                blit_draws(&session->blit, &session->draws);
+        } else if (session->batch) {
+                session->calls += draw_list_geometry(&session->draws,
+                                                     renderer);
+        } else {
+                session->calls += draw_list_copy(&session->draws, renderer);
+        }
+        draw_list_clear(&session->draws);
+}
+
+/**
+ * Draw the tiles in the list over the last frame, moved by however far the
+ * cursor went since it was drawn, and empty it.
+ */
+static void submit_scrolled(atlas_t * atlas, session_t * session,
+                            const frame_state_t * last)
+{
+        view_t *view = &session->view;
+        point_t step = { last->cursor[X] - view->cursor[X],
+                         last->cursor[Y] - view->cursor[Y], 0 };
+        bool moved = (last->rotation == view->rotation &&
+                      session->scroll_version == atlas->version);
+        int dx, dy;
+
+        /* Undo the camera rotation to get the step across the view. */
+        point_rotate(step, (N_ROTATIONS - view->rotation) % N_ROTATIONS);
+        dx = (step[X] - step[Y]) * TILE_WIDTH_HALF;
+        dy = (step[X] + step[Y]) * TILE_HEIGHT_HALF +
+            (view->cursor[Z] - last->cursor[Z]) * TILE_HEIGHT;
+
+        session->n_draws += session->draws.n_draws;
+        session->calls += scroll_draw(&session->scroll, &session->draws, moved,
+                                      dx, dy);
+        session->scroll_version = atlas->version;
+        draw_list_clear(&session->draws);
+}
+
+static void frame_state_get(session_t * session, frame_state_t * state)
+{
+        point_copy(state->cursor, session->view.cursor);
+        state->rotation = session->view.rotation;
+        state->transparency = session->transparency;
+        state->version = session->area.version;
+        state->zoom = session->zoom;
+}
+
+/**
+ * Check if the screen is out of date.
+ */
+static bool session_is_dirty(session_t * session)
+{
+        frame_state_t state;
+
+        if (session->exposed) {
+                return true;
+        }
+        frame_state_get(session, &state);
+        return (!point_equal(state.cursor, session->drawn.cursor) ||
+                state.rotation != session->drawn.rotation ||
+                state.transparency != session->drawn.transparency ||
+                state.version != session->drawn.version ||
+                state.zoom != session->drawn.zoom);
+}
+
+/**
+ * Color a map location as seen from above: the top level with anything on
+ * it, darker the lower it is.
+ */
+static Uint32 terrain_color(void *data, area_t * area, int x, int y)
+{
+        for (int l = area->n_maps - 1; l >= 0; l--) {
+                pixel_t pixel = area_get_pixel(area, l, x, y);
+                int shade = 255 - (N_MAPS - 1 - l) * 32;
+
+                if (!pixel) {
+                        continue;
+                }
+                if (pixel == PIXEL_VALUE_GRASS) {
+                        return 0xff000000 | (0x30 * shade / 255) << 16 |
+                            (0xa0 * shade / 255) << 8 | (0x30 * shade / 255);
+                }
+                return (0xff000000 | (PIXEL_RED(pixel) * shade / 255) << 16 |
+                        (PIXEL_GREEN(pixel) * shade / 255) << 8 |
+                        (PIXEL_BLUE(pixel) * shade / 255));
+        }
+
+        return 0;
+}
+
+/**
+ * Find where the view goes on the screen zoomed out, in unscaled pixels, so
+ * the cursor stays in the middle.
+ */
+static void zoom_view_origin(int zoom, int *ox, int *oy)
+{
+        int center = (VIEW_H / 2) * VIEW_W + VIEW_W / 2;
+
+        *ox = (SCREEN_W << zoom) / 2 - view_screen[center].x - TILE_WIDTH_HALF;
+        *oy = (SCREEN_H << zoom) / 2 - view_screen[center].y -
+            TILE_HEIGHT_HALF;
+}
+
+/**
+ * Add a level's draws to the frame, through its layer if it has one. Levels
+ * with a layer are drawn one at a time.
+ */
+static bool frame_level(atlas_t * atlas, session_t * session, int level,
+                        void *data)
+{
+        SDL_Renderer *renderer = data;
+        layer_view_t lv, *use = NULL;
+        bool more;
+
+        if (session->use_layers) {
+                submit_draws(renderer, session);
+                if (layer_line_up(atlas, session, level, &lv)) {
+                        use = &lv;
+                        layer_cells_clear(&session->layers);
+                }
+        }
+
+        more = render_level(atlas, session, &session->area, level, use);
+
+        if (use) {
+                layer_mark_outside(session, use);
+                session->n_draws += session->draws.n_draws;
+                session->calls += layer_composite(&session->layers, lv.layer,
+                                                  lv.px, lv.py,
+                                                  &session->draws);
+                draw_list_clear(&session->draws);
+        }
+
+        return more;
+}
+
+/**
+ * Zoomed out, scale the screen down, draw the terrain around the view from
+ * the mip pyramid as flat quads on the cursor's level, and leave the
+ * viewport where the view goes. Returns false if not zoomed out.
+ */
+static bool render_overview(SDL_Renderer * renderer, session_t * session)
+{
+        int span = 1 << session->zoom;
+        SDL_Rect near = { 0, 0, SCREEN_W, SCREEN_H };
+
+        if (!session->zoom) {
+                return false;
+        }
+        zoom_view_origin(session->zoom, &near.x, &near.y);
+
+        SDL_RenderSetScale(renderer, 1.0f / span, 1.0f / span);
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        view_t *view = &session->view;
+        area_t *area = &session->area;
+        int center = (VIEW_H / 2) * VIEW_W + VIEW_W / 2;
+        rotation_t inverse = (N_ROTATIONS - view->rotation) % N_ROTATIONS;
+        int screen_z = (L2Z(Z2L(view->cursor[Z])) - view->cursor[Z]) *
+            TILE_HEIGHT;
+        int reach = ZOOM_REACH * span, half = VIEW_W / 2;
+        SDL_Texture *texture = NULL;
+        SDL_Vertex verts[4 * 4];
+        int indices[4 * 6], n = 0;
+
+        /* Coarser levels are smaller, so try those if a texture is too big
+         * for the renderer. */
+        for (int l = max(0, session->zoom - ZOOM_MIP_LAG);
+             !texture && l < session->mip.n_levels; l++) {
+                texture = mip_get(&session->mip, l);
+        }
+        if (!texture) {
+                goto near_view;
+        }
+
+        /* Where the map is in camera coordinates, counting tile corners
+         * from the cursor tile's top one. Doubling keeps the rotation about
+         * the middle of the cursor tile in whole numbers. */
+        point_t c0 = { -2 * view->cursor[X] - 1, -2 * view->cursor[Y] - 1, 0 };
+        point_t c1 = { 2 * (area_w(area) - view->cursor[X]) - 1,
+                       2 * (area_h(area) - view->cursor[Y]) - 1, 0 };
+        point_rotate(c0, inverse);
+        point_rotate(c1, inverse);
+        int ca0 = (min(c0[X], c1[X]) + 1) / 2;
+        int ca1 = (max(c0[X], c1[X]) + 1) / 2;
+        int cb0 = (min(c0[Y], c1[Y]) + 1) / 2;
+        int cb1 = (max(c0[Y], c1[Y]) + 1) / 2;
+
+        /* The ring around the view, as four rects of tile corners. */
+        const int bands[4][4] = {
+                {-reach, -reach, reach + 1, -half},
+                {-reach, half + 1, reach + 1, reach + 1},
+                {-reach, -half, -half, half + 1},
+                {half + 1, -half, reach + 1, half + 1},
+        };
+
+        for (int b = 0; b < 4; b++) {
+                int a0 = max(bands[b][0], ca0), b0 = max(bands[b][1], cb0);
+                int a1 = min(bands[b][2], ca1), b1 = min(bands[b][3], cb1);
+                const int corners[4][2] = {
+                        {a0, b0}, {a1, b0}, {a1, b1}, {a0, b1}
+                };
+                SDL_Vertex *v = &verts[n * 4];
+                int *index = &indices[n * 6];
+
+                if (a0 >= a1 || b0 >= b1) {
+                        continue;
+                }
+                for (int i = 0; i < 4; i++) {
+                        int a = corners[i][0], b = corners[i][1];
+                        point_t m = { 2 * a - 1, 2 * b - 1, 0 };
+
+                        point_rotate(m, view->rotation);
+                        v[i].position.x = (a - b) * TILE_WIDTH_HALF +
+                            view_screen[center].x + TILE_WIDTH_HALF + near.x;
+                        v[i].position.y = (a + b) * TILE_HEIGHT_HALF +
+                            view_screen[center].y - screen_z + near.y;
+                        v[i].tex_coord.x = (m[X] + 2 * view->cursor[X] + 1) /
+                            (2.0f * area_w(area));
+                        v[i].tex_coord.y = (m[Y] + 2 * view->cursor[Y] + 1) /
+                            (2.0f * area_h(area));
+                        v[i].color.r = v[i].color.g = v[i].color.b = 255;
+                        v[i].color.a = SDL_ALPHA_OPAQUE;
+                }
+                index[0] = n * 4;
+                index[1] = n * 4 + 1;
+                index[2] = n * 4 + 2;
+                index[3] = n * 4;
+                index[4] = n * 4 + 2;
+                index[5] = n * 4 + 3;
+                n++;
+        }
+        if (n) {
+                SDL_RenderGeometry(renderer, texture, verts, n * 4, indices,
+                                   n * 6);
+                session->calls++;
+        }
+
+near_view:
+#endif
+        SDL_RenderSetViewport(renderer, &near);
+        return true;
+}
+
+static void render(SDL_Renderer * renderer, atlas_t * atlas,
+                   session_t * session)
+{
+        frame_state_t last = session->drawn;
+
+        frame_state_get(session, &session->drawn);
+        session->exposed = false;
+        session->pick.valid = false;
+
+        clear_screen(renderer);
+
+        view_t *view = &session->view;
+
+        /* Clear the rendered buffer */
+        view_clear_rendered();
+        draw_list_clear(&session->draws);
+        session->n_draws = 0;
+        session->calls = 0;
+        session->state.issued = 0;
+        session->state.skipped = 0;
+
+        /* Zoomed out, the view goes in the middle of the terrain. */
+        bool zoomed = render_overview(renderer, session);
+
+        /* Recompute fov based on player's position */
+        view_calc_fov(view);
+
+        /* Render the maps in z order, all from one walk if fused */
+        if (session->fused) {
+                render_fused(atlas, session);
+        } else {
+                walk_levels(atlas, session, frame_level, renderer);
+        }
+
+        /* Make the sprites that were missing before anything can use their
+         * slots. */
+        if (session->use_sprites) {
+                sprite_cache_update(&session->sprites);
+        }
+
+        /* Draw the tiles */
+        if (session->cull) {
+                cover_cull(&session->cover, &session->draws);
+        }
+        if (session->use_scroll) {
+                submit_scrolled(atlas, session, &last);
+        } else {
+                submit_draws(renderer, session);
+        }
+
+        /* Paint the grid */
+        SDL_SetRenderDrawColor(renderer, 0, 64, 64, 128);
+        iso_grid(renderer, VIEW_W, VIEW_H);
+
+        /* Paint a red square for a cursor position */
+        point_t vloc;
+        map_to_view(vloc, view->cursor, view->cursor);
+        SDL_SetRenderDrawColor(renderer, 255, 0, 0, SDL_ALPHA_OPAQUE);
+        iso_square(renderer, VIEW_H, vloc[X], vloc[Y]);
+
+        if (zoomed) {
+                SDL_RenderSetViewport(renderer, NULL);
+                SDL_RenderSetScale(renderer, 1.0f, 1.0f);
+        }
+
+        SDL_RenderPresent(renderer);
+}
+
+/**
+ * Render a fixed number of frames at each camera rotation, drawing the tiles
+ * each way, and report the average frame time and SDL calls of each.
+ */
+static void bench_rotate(SDL_Renderer * renderer, atlas_t * atlas,
+                         session_t * session)
+{
+        view_t *view = &session->view;
+        rotation_t rotation = view->rotation;
+        bool batch = session->batch;
+        double freq = SDL_GetPerformanceFrequency();
+
+        printf("%d frames per rotation, pre-rotated maps %s\n", BENCH_FRAMES,
+               session->prerotated ? "on" : "off");
+
+        for (int r = 0; r < N_ROTATIONS; r++) {
+                view->rotation = r;
+                for (int b = 0; b < 2; b++) {
+                        session->batch = b;
+                        render(renderer, atlas, session);       /* warm up */
+
+                        Uint64 start = SDL_GetPerformanceCounter();
+                        for (int i = 0; i < BENCH_FRAMES; i++) {
+                                render(renderer, atlas, session);
+                        }
+                        Uint64 end = SDL_GetPerformanceCounter();
+
+                        printf("rotation %3d %-8s: %f msecs avg frame time, "
+                               "%d draws, %d SDL calls per frame "
+                               "(%d mod changes, %d skipped)\n", r * 90,
+                               b ? "geometry" : "copy",
+                               ((end - start) * 1000.0 / freq) / BENCH_FRAMES,
+                               session->n_draws, session->calls,
+                               session->state.issued, session->state.skipped);
+                }
+        }
+
+        view->rotation = rotation;
+        session->batch = batch;
+}
+
+/**
+ * Render a fixed number of frames offscreen at each camera rotation, drawing
+ * the tiles with SDL's software renderer and then with each blitter kernel
+ * the CPU has, and report the average frame time of each and how far the
+ * blitter's pixels are from SDL's.
+ */
+static void bench_blit(SDL_Renderer * renderer, SDL_Surface * surface,
+                       atlas_t * atlas, session_t * session)
+{
+        view_t *view = &session->view;
+        rotation_t rotation = view->rotation;
+        bool use_blit = session->use_blit;
+        blit_kernel_t kernel = session->blit.kernel;
+        double freq = SDL_GetPerformanceFrequency();
+        Uint8 *want;
+
+        if (!surface || !session->blit.surface) {
+                printf("bench-blit draws offscreen, run it with -x\n");
+                return;
+        }
+        if (session->use_layers) {
+                printf("Can't blit with layers\n");
+                return;
+        }
+        if (!(want = malloc(surface->h * surface->pitch))) {
+                printf("Failed to allocate a copy of the screen!\n");
+                return;
+        }
+
+        printf("%d frames per rotation, SDL drawing with %s\n", BENCH_FRAMES,
+               session->batch ? "geometry" : "copy");
+
+        for (int r = 0; r < N_ROTATIONS; r++) {
+                view->rotation = r;
+                for (int k = -1; k < N_BLIT_KERNELS; k++) {
+                        int off = 0, most = 0;
+
+                        if (k >= 0 && !blit_kernel_supported(k)) {
+                                continue;
+                        }
+                        session->use_blit = k >= 0;
+                        session->blit.kernel = max(k, 0);
+                        render(renderer, atlas, session);       /* warm up */
+
+                        Uint64 start = SDL_GetPerformanceCounter();
+                        for (int i = 0; i < BENCH_FRAMES; i++) {
+                                render(renderer, atlas, session);
+                        }
+                        Uint64 end = SDL_GetPerformanceCounter();
+
+                        /* Compare each pixel's channels with SDL's. */
+                        for (int y = 0; y < surface->h; y++) {
+                                Uint8 *got = (Uint8 *) surface->pixels +
+                                    y * surface->pitch;
+                                Uint8 *sdl = want + y * surface->pitch;
+                                if (k < 0) {
+                                        memcpy(sdl, got, surface->pitch);
+                                        continue;
+                                }
+                                for (int x = 0; x < surface->w; x++) {
+                                        int diff = 0;
+                                        for (int c = 0; c < 4; c++) {
+                                                diff = max(diff,
+                                                           abs(got[x * 4 + c] -
+                                                               sdl[x * 4 + c]));
+                                        }
+                                        off += diff != 0;
+                                        most = max(most, diff);
+                                }
+                        }
+
+                        printf("rotation %3d %-6s: %f msecs avg frame time, "
+                               "%d draws", r * 90,
+                               k < 0 ? "SDL" : blit_kernel_name(k),
+                               ((end - start) * 1000.0 / freq) / BENCH_FRAMES,
+                               session->n_draws);
+                        if (k >= 0) {
+                                printf(", %d pixels off SDL's by up to %d",
+                                       off, most);
+                        }
+                        printf("\n");
+                }
+        }
+
+        free(want);
+        view->rotation = rotation;
+        session->use_blit = use_blit;
+        session->blit.kernel = kernel;
+}
+
+static bool traverse_level(atlas_t * atlas, session_t * session, int level,
+                           void *data)
+{
+        return render_level(atlas, session, &session->area, level, NULL);
+}
+
+/**
+ * Walk the levels the way render() does, leaving every level's draws in the
+ * session's list.
+ */
+static void traverse_levels(atlas_t * atlas, session_t * session)
+{
+        view_clear_rendered();
+        if (session->fused) {
+                render_fused(atlas, session);
+        } else {
+                walk_levels(atlas, session, traverse_level, NULL);
+        }
+}
+
+/**
+ * Check that the strips give the same draws as the serial walk at every
+ * rotation, with and without transparency, on the maps as they are and with
+ * the tallest model along the left edge of the view, where a model's shadow
+ * in `rendered` is cut off. For the walls the cursor goes to the middle of
+ * the maps, or as far right of it as puts the left edge on them. Returns
+ * false and says where if they don't.
+ */
+static bool check_strips(atlas_t * atlas, session_t * session)
+{
+        static const pixel_t wall = (PIXEL_TYPE_WALL | MODEL_5x1x1 << 24 |
+                                     PIXEL_MASK_OPAQUE | 0xff);
+        view_t *view = &session->view;
+        rotation_t rotation = view->rotation;
+        bool transparency = session->transparency;
+        int shift = VIEW_W / 2 - min(VIEW_W / 2, (min(area_w(&session->area),
+                                                       area_h(&session->area))
+                                                   - 1) / 2);
+        pixel_t saved[N_MAPS][VIEW_H];
+        point_t cursor;
+        pool_t *pool = session->pool;
+        draw_list_t serial;
+        bool same = true;
+
+        if (draw_list_init(&serial, session->draws.texture, NULL)) {
+                printf("Failed to allocate draw list!\n");
+                return false;
+        }
+
+        point_copy(cursor, view->cursor);
+        for (int walls = 0; walls < 2 && same; walls++) {
+                for (int k = 0; k < 2 * N_ROTATIONS && same; k++) {
+                        view->rotation = k % N_ROTATIONS;
+                        session->transparency = k / N_ROTATIONS;
+                        if (walls) {
+                                point_t step = { shift, 0, 0 };
+                                point_rotate(step, view->rotation);
+                                view->cursor[X] =
+                                    area_w(&session->area) / 2 + step[X];
+                                view->cursor[Y] =
+                                    area_h(&session->area) / 2 + step[Y];
+                        }
+                        view_calc_fov(view);
+
+                        /* Wall the left edge on every level for this
+                         * rotation, keeping what was there. */
+                        for (int l = 0; walls && l < session->area.n_maps;
+                             l++) {
+                                for (int y = 0; y < VIEW_H; y++) {
+                                        point_t mloc;
+                                        view_index_to_map(view, y * VIEW_W,
+                                                          mloc);
+                                        if (!area_contains(&session->area,
+                                                           mloc[X], mloc[Y])) {
+                                                continue;
+                                        }
+                                        saved[l][y] = area_get_pixel(
+                                            &session->area, l, mloc[X],
+                                            mloc[Y]);
+                                        area_set_pixel(&session->area, l,
+                                                       mloc[X], mloc[Y],
+                                                       wall);
+                                }
+                        }
+
+                        session->pool = NULL;
+                        traverse_levels(atlas, session);
+                        draw_list_clear(&serial);
+                        draw_list_append(&serial, session->draws.draws,
+                                         session->draws.n_draws);
+                        draw_list_clear(&session->draws);
+
+                        session->pool = pool;
+                        traverse_levels(atlas, session);
+                        if (serial.n_draws != session->draws.n_draws ||
+                            memcmp(serial.draws, session->draws.draws,
+                                   serial.n_draws * sizeof (draw_t))) {
+                                printf("strips differ from the serial walk "
+                                       "at rotation %d%s%s: %d draws "
+                                       "against %d\n", view->rotation * 90,
+                                       session->transparency ?
+                                       ", transparent" : "",
+                                       walls ? ", walled left edge" : "",
+                                       session->draws.n_draws,
+                                       serial.n_draws);
+                                same = false;
+                        }
+                        draw_list_clear(&session->draws);
+
+                        for (int l = 0; walls && l < session->area.n_maps;
+                             l++) {
+                                for (int y = 0; y < VIEW_H; y++) {
+                                        point_t mloc;
+                                        view_index_to_map(view, y * VIEW_W,
+                                                          mloc);
+                                        if (!area_contains(&session->area,
+                                                           mloc[X], mloc[Y])) {
+                                                continue;
+                                        }
+                                        area_set_pixel(&session->area, l,
+                                                       mloc[X], mloc[Y],
+                                                       saved[l][y]);
+                                }
+                        }
+                }
+        }
+
+        point_copy(view->cursor, cursor);
+        view->rotation = rotation;
+        session->transparency = transparency;
+        draw_list_deinit(&serial);
+        return same;
+}
+
+/**
+ * Time the walk over the view that turns the maps into a frame's draws, at
+ * each camera rotation, without submitting the draws or redoing the fov.
+ */
+static void bench_traverse(atlas_t * atlas, session_t * session)
+{
+        view_t *view = &session->view;
+        rotation_t rotation = view->rotation;
+        double freq = SDL_GetPerformanceFrequency();
+
+        printf("%d traversals per rotation, pre-rotated maps %s, %d threads%s\n",
+               BENCH_TRAVERSALS, session->prerotated ? "on" : "off",
+               session->pool ? pool_size(session->pool) : 1,
+               session->fused ? ", fused" : "");
+
+        if (session->pool && !session->area.store && !session->fused &&
+            check_strips(atlas, session)) {
+                printf("strips give the same draws as the serial walk\n");
+        }
+
+        view_calc_fov(view);
+        for (int r = 0; r < N_ROTATIONS; r++) {
+                int n_draws = 0;
+
+                view->rotation = r;
+                Uint64 start = SDL_GetPerformanceCounter();
+                for (int i = 0; i < BENCH_TRAVERSALS; i++) {
+                        traverse_levels(atlas, session);
+                        n_draws = session->draws.n_draws;
+                        draw_list_clear(&session->draws);
+                }
+                Uint64 end = SDL_GetPerformanceCounter();
+
+                printf("rotation %3d: %f msecs avg traversal, %d draws\n",
+                       r * 90, ((end - start) * 1000.0 / freq) /
+                       BENCH_TRAVERSALS, n_draws);
+        }
+
+        view->rotation = rotation;
+}
+
+/**
+ * Print how many times each visible pixel got drawn, on average, with and
+ * without the hidden draws.
+ */
+static void print_overdraw(cover_t * cover)
+{
+        if (!cover->frames || !cover->total_visible) {
+                return;
+        }
+        printf("overdraw: %.2f draws per visible pixel, %.2f after leaving "
+               "out %.1f hidden faces avg per frame\n",
+               (double)cover->total_drawn / cover->total_visible,
+               (double)cover->total_kept / cover->total_visible,
+               (double)cover->total_culled / cover->frames);
+}
+
+/**
+ * Print how many models were drawn as one sprite.
+ */
+static void print_sprites(sprite_cache_t * cache)
+{
+        int hits = SDL_AtomicGet(&cache->hits);
+        int misses = SDL_AtomicGet(&cache->misses);
+
+        printf("sprites: %d made, %d evicted, %.1f%% of models drawn as one "
+               "quad\n", cache->builds, cache->evictions,
+               100.0 * hits / max(hits + misses, 1));
+}
+
+/**
+ * Print how much of the frames kept from the last one got drawn again.
+ */
+static void print_scroll(scroll_t * scroll)
+{
+        printf("scroll: %d frames moved, %d drawn whole, %.1f%% of cells and "
+               "%.1f draws avg drawn again in the moved ones\n",
+               scroll->scrolled, scroll->redrawn,
+               100.0 * scroll->marked_cells /
+               max(scroll->marked_cells + scroll->clean_cells, 1),
+               (double)scroll->scrolled_draws / max(scroll->scrolled, 1));
+}
+
+/**
+ * Render frames offscreen, turning the camera after each quarter of them, and
+ * report how fast that went. If `prefix` isn't NULL each frame is saved as a
+ * PNG file too, which isn't counted in the time.
+ */
+static void run_headless(SDL_Renderer * renderer, SDL_Surface * surface,
+                         atlas_t * atlas, session_t * session, int n_frames,
+                         const char *prefix)
+{
+        view_t *view = &session->view;
+        rotation_t rotation = view->rotation;
+        double freq = SDL_GetPerformanceFrequency();
+        double total_draws = 0, total_calls = 0;
+        Uint64 ticks = 0;
+        int frames, saved = 0;
+
+        for (frames = 0; frames < n_frames; frames++) {
+                view->rotation = (frames * N_ROTATIONS) / n_frames;
+
+                Uint64 start = SDL_GetPerformanceCounter();
+                render(renderer, atlas, session);
+                ticks += SDL_GetPerformanceCounter() - start;
+                total_draws += session->n_draws;
+                total_calls += session->calls;
+
+                if (prefix) {
+                        char path[256];
+                        snprintf(path, sizeof (path), "%s%04d.png", prefix,
+                                 frames);
+                        if (IMG_SavePNG(surface, path)) {
+                                printf("IMG_SavePNG:%s:%s\n", path,
+                                       SDL_GetError());
+                        } else {
+                                saved++;
+                        }
+                }
+        }
+
+        view->rotation = rotation;
+
+        if (!frames || !ticks) {
+                return;
+        }
+        printf("%d frames in %f secs: %2.2f FPS, %f msecs avg frame time\n",
+               frames, ticks / freq, frames * freq / ticks,
+               ticks * 1000.0 / freq / frames);
+        printf("%f draws, %f SDL calls avg per frame (%s)\n",
+               total_draws / frames, total_calls / frames,
+               session->use_blit ? blit_kernel_name(session->blit.kernel) :
+               session->batch ? "geometry" : "copy");
+        if (session->cull) {
+                print_overdraw(&session->cover);
+        }
+        if (session->use_sprites) {
+                print_sprites(&session->sprites);
+        }
+        if (session->use_scroll) {
+                print_scroll(&session->scroll);
+        }
+        if (prefix) {
+                printf("%d frames saved to %s*.png\n", saved, prefix);
+        }
+}
+
+/**
+ * Find which face an atlas image is drawn as.
+ */
+static int texture_face(atlas_t * atlas, const SDL_Rect * src)
+{
+        for (int i = 0; i < N_TEXTURES; i++) {
+                if (src->x == atlas->rects[i].x &&
+                    src->y == atlas->rects[i].y) {
+                        return texture_faces[i];
+                }
+        }
+        return MODEL_FACE_TOP;
+}
+
+/**
+ * Put a level's faces in the pick buffer, each under its own id.
+ */
+static bool pick_level(atlas_t * atlas, session_t * session, int level,
+                       void *data)
+{
+        pick_t *pick = data;
+        draw_list_t *draws = &session->draws;
+        level_pass_t pass = { atlas, session, &session->area, level, NULL,
+                session->spans
+        };
+        strip_t whole = { .index = -1, .d0 = 1 - VIEW_H, .d1 = VIEW_W };
+
+        draw_list_clear(draws);
+        render_strip(&pass, &whole, draws);
+
+        /* The tiles are in painter's order, like their draws. */
+        for (int index = 0; index < VIEW_W * VIEW_H; index++) {
+                tile_span_t *span = &session->spans[index];
+                for (int i = span->first; i < span->first + span->n; i++) {
+                        draw_t *draw = &draws->draws[i];
+                        int face = texture_face(atlas, &draw->src);
+                        pick_draw(pick, draw, PICK_ID(level, index, face));
+                }
+        }
+
+        return !whole.clipped_pillar || whole.top_of_stairs;
+}
+
+/**
+ * Fill the pick buffer with what the screen shows, going through the levels
+ * like render() does, but with every face a draw of its own so each can be
+ * told apart. Returns false if the buffer can't be had.
+ */
+static bool pick_fill(session_t * session)
+{
+        pick_t *pick = &session->pick;
+        view_t *view = &session->view;
+        bool use_sprites = session->use_sprites;
+
+        if (pick->valid) {
+                return true;
+        }
+        if (pick_clear(pick)) {
+                printf("Failed to allocate pick buffer!\n");
+                return false;
+        }
+
+        session->use_sprites = false;
+        view_clear_rendered();
+        view_calc_fov(view);
+        walk_levels(pick->atlas, session, pick_level, pick);
+        draw_list_clear(&session->draws);
+        session->use_sprites = use_sprites;
+
+        pick->valid = true;
+        return true;
+}
+
+/**
+ * Handle button clicks.
+ */
+void on_mouse_button(SDL_MouseButtonEvent * event, session_t * session)
+{
+        view_t *view = &session->view;
+        point_t vloc = { 0, 0, 0 };
+        point_t mloc = { 0, 0, 0 };
+        Uint32 id;
+        int level, index, face;
+        int x = event->x, y = event->y;
+
+        /* Zoomed out, only the view in the middle can be picked. */
+        if (session->zoom) {
+                int ox, oy;
+                zoom_view_origin(session->zoom, &ox, &oy);
+                x = (x << session->zoom) - ox;
+                y = (y << session->zoom) - oy;
+        }
+
+        if (!pick_fill(session)) {
+                return;
+        }
+        if ((id = pick_at(&session->pick, x, y)) == PICK_NONE) {
+                printf("s(%d, %d)->nothing\n", x, y);
+                return;
+        }
+
+        id--;
+        face = id % N_MODEL_FACES;
+        index = (id / N_MODEL_FACES) % (VIEW_W * VIEW_H);
+        level = id / N_MODEL_FACES / (VIEW_W * VIEW_H);
+        vloc[X] = index % VIEW_W;
+        vloc[Y] = index / VIEW_W;
+        view_index_to_map(view, index, mloc);
+        int cam_x = view_to_camera_x(vloc[X]);
+        int cam_y = view_to_camera_y(vloc[Y]);
+        bool cutaway = cutaway_at(vloc);
+
+        printf("s(%d, %d)->v(%d, %d)->c(%d, %d)->m(%d, %d, level %d) %s "
+               "face->%c %c\n",
+               x, y,
+               vloc[X], vloc[Y],
+               cam_x, cam_y,
+               mloc[X], mloc[Y], level, face_names[face],
+               view_rendered_at(vloc[X], vloc[Y]) ? 't' : 'f',
+               cutaway ? 't' : 'f');
+
+        /* Summarize the 5x5 block around it on its level. */
+        if (session->regions.area && area_has_level(&session->area, level)) {
+                region_index_t *regions = &session->regions;
+                int x = mloc[X] - 2, y = mloc[Y] - 2;
+                printf("5x5: opaque=%d impassable=%d terrain=%d "
+                       "passable=%c\n",
+                       region_count(regions, level, REGION_OPAQUE, x, y, 5, 5),
+                       region_count(regions, level, REGION_IMPASSABLE, x, y,
+                                    5, 5),
+                       region_count(regions, level, REGION_TERRAIN, x, y, 5,
+                                    5),
+                       region_is_passable(regions, level, x, y, 5, 5) ? 't' :
+                       'f');
+        }
+}
+
+bool move_cursor(area_t *area, view_t * view, const point_t dir)
+{
+        point_t newcur, rdir;
+
+        point_copy(rdir, dir);
+        point_rotate(rdir, view->rotation);
+        if (!move_step(area, view->cursor, rdir, newcur)) {
+                return false;
+        }
+        point_copy(view->cursor, newcur);
+        return true;
+}
+
+/* Small deterministic generator, so the checks take the same steps each
+ * run. */
+static uint32_t demo_rand(uint32_t * state)
+{
+        *state = *state * 1664525u + 1013904223u;
+        return *state >> 8;
+}
+
+/**
+ * Take the cursor on a random walk that also turns the camera, goes up and
+ * down and flips the transparency. Draw each frame over the last one and
+ * then whole, and count the frames where the screens differ.
+ */
+static void check_scroll(SDL_Renderer * renderer, SDL_Surface * surface,
+                         atlas_t * atlas, session_t * session)
+{
+        view_t *view = &session->view;
+        rotation_t rotation = view->rotation;
+        bool transparency = session->transparency;
+        uint32_t rng = 1;
+        int frames = 0, most = 0;
+        Uint8 *kept;
+        point_t start;
+
+        if (!(kept = malloc(surface->h * surface->pitch))) {
+                printf("Failed to allocate a copy of the screen!\n");
+                return;
+        }
+
+        point_copy(start, view->cursor);
+        for (int i = 0; i < BENCH_FRAMES; i++) {
+                int k = demo_rand(&rng) % 16, off = 0;
+
+                if (k < 12) {
+                        move_cursor(&session->area, view,
+                                    move_directions[demo_rand(&rng) % N_DIR]);
+                } else if (k < 14) {
+                        view->rotation = demo_rand(&rng) % N_ROTATIONS;
+                } else {
+                        session->transparency = !session->transparency;
+                }
+
+                session->use_scroll = true;
+                render(renderer, atlas, session);
+                memcpy(kept, surface->pixels, surface->h * surface->pitch);
+                session->use_scroll = false;
+                render(renderer, atlas, session);
+
+                for (int y = 0; y < surface->h; y++) {
+                        Uint32 *got = (Uint32 *) (kept + y * surface->pitch);
+                        Uint32 *want = (Uint32 *) ((Uint8 *) surface->pixels +
+                                                   y * surface->pitch);
+                        for (int x = 0; x < surface->w; x++) {
+                                off += got[x] != want[x];
+                        }
+                }
+                frames += off != 0;
+                most = max(most, off);
+        }
+        printf("%d of %d kept frames differ from the whole ones, by up to %d "
+               "pixels\n", frames, BENCH_FRAMES, most);
+
+        free(kept);
+        point_copy(view->cursor, start);
+        view->rotation = rotation;
+        session->transparency = transparency;
+}
+
+/**
+ * Walk the cursor around a square a tile a frame, drawing each frame whole
+ * and then over the last one, and report the average frame time and what
+ * got drawn each way. Offscreen, check the kept frames against whole ones
+ * too.
+ */
+static void bench_scroll(SDL_Renderer * renderer, SDL_Surface * surface,
+                         atlas_t * atlas, session_t * session)
+{
+        static const int sides[] = { DIR_XRIGHT, DIR_YDOWN, DIR_XLEFT,
+                DIR_YUP
+        };
+        view_t *view = &session->view;
+        scroll_t *scroll = &session->scroll;
+        bool use_scroll = session->use_scroll;
+        double freq = SDL_GetPerformanceFrequency();
+        point_t start;
+
+        if (!scroll->renderer) {
+                printf("bench-scroll keeps frames, run it with -k\n");
+                return;
+        }
+
+        printf("%d frames walking around a %d tile square\n", BENCH_FRAMES,
+               BENCH_SCROLL_SIDE);
+        point_copy(start, view->cursor);
+
+        for (int k = 0; k < 2; k++) {
+                double draws = 0;
+                Uint64 cells = scroll->marked_cells + scroll->clean_cells;
+                Uint64 marked = scroll->marked_cells;
+                Uint64 scrolled = scroll->scrolled_draws;
+
+                session->use_scroll = k;
+                point_copy(view->cursor, start);
+                render(renderer, atlas, session);       /* warm up */
+
+                Uint64 begin = SDL_GetPerformanceCounter();
+                for (int i = 0; i < BENCH_FRAMES; i++) {
+                        int side = (i / BENCH_SCROLL_SIDE) % 4;
+                        move_cursor(&session->area, view,
+                                    move_directions[sides[side]]);
+                        render(renderer, atlas, session);
+                        draws += session->n_draws;
+                }
+                Uint64 end = SDL_GetPerformanceCounter();
+
+                printf("%-6s: %f msecs avg frame time, ",
+                       k ? "moved" : "whole",
+                       ((end - begin) * 1000.0 / freq) / BENCH_FRAMES);
+                if (k) {
+                        cells = scroll->marked_cells + scroll->clean_cells -
+                            cells;
+                        printf("%.1f draws avg drawn again, %.1f%% of "
+                               "cells\n", (double)(scroll->scrolled_draws -
+                                                   scrolled) / BENCH_FRAMES,
+                               100.0 * (scroll->marked_cells - marked) /
+                               max(cells, 1));
+                } else {
+                        printf("%.1f draws avg\n", draws / BENCH_FRAMES);
+                }
+        }
+
+        point_copy(view->cursor, start);
+        if (surface) {
+                check_scroll(renderer, surface, atlas, session);
+        }
+        session->use_scroll = use_scroll;
+}
+
+/**
+ * Render frames at each zoom step, turning the camera each frame, and report
+ * how many tiles wide the screen is, the average frame time, and the draws
+ * and SDL calls each took.
+ */
+static void bench_zoom(SDL_Renderer * renderer, atlas_t * atlas,
+                       session_t * session)
+{
+        view_t *view = &session->view;
+        rotation_t rotation = view->rotation;
+        int zoom = session->zoom;
+        double freq = SDL_GetPerformanceFrequency();
+
+        if (!session->mip.area) {
+                printf("bench-zoom needs the mip levels, run it with -m\n");
+                return;
+        }
+
+        printf("%d frames per zoom step\n", BENCH_ZOOM_FRAMES);
+        for (int z = 0; z <= ZOOM_MAX; z++) {
+                double draws = 0, calls = 0;
+
+                session->zoom = z;
+                render(renderer, atlas, session);       /* warm up */
+
+                Uint64 start = SDL_GetPerformanceCounter();
+                for (int i = 0; i < BENCH_ZOOM_FRAMES; i++) {
+                        view->rotation = i % N_ROTATIONS;
+                        render(renderer, atlas, session);
+                        draws += session->n_draws;
+                        calls += session->calls;
+                }
+                Uint64 end = SDL_GetPerformanceCounter();
+
+                printf("zoom %d: %4d tiles wide, %f msecs avg frame time, "
+                       "%.1f draws, %.1f SDL calls avg\n", z,
+                       (SCREEN_W << z) / TILE_WIDTH,
+                       ((end - start) * 1000.0 / freq) / BENCH_ZOOM_FRAMES,
+                       draws / BENCH_ZOOM_FRAMES, calls / BENCH_ZOOM_FRAMES);
+        }
+
+        view->rotation = rotation;
+        session->zoom = zoom;
+}
+
+
+/**
+ * Handle key presses.
+ */
+void on_keydown(SDL_KeyboardEvent * event, int *quit, session_t * session)
+{
+        area_t *area = &session->area;
+        view_t *view = &session->view;
+        const point_t *directions = move_directions;
+
+        switch (event->keysym.sym) {
+        case SDLK_LEFT:
+                move_cursor(area, view, directions[DIR_XLEFT]);
                 break;
         case SDLK_RIGHT:
                 move_cursor(area, view, directions[DIR_XRIGHT]);
@@ -705,34 +2441,220 @@ void on_keydown(SDL_KeyboardEvent * event, int *quit, session_t * session)
                 view->rotation = (view->rotation + 1) % N_ROTATIONS;
                 break;
         case SDLK_COMMA:
-                view->rotation = (view->rotation - 1) % N_ROTATIONS;
+                view->rotation = (view->rotation + N_ROTATIONS - 1) % N_ROTATIONS;
+                break;
+        case SDLK_MINUS:
+                if (session->mip.area) {
+                        session->zoom = min(session->zoom + 1, ZOOM_MAX);
+                }
+                break;
+        case SDLK_EQUALS:
+                if (session->mip.area) {
+                        session->zoom = max(session->zoom - 1, 0);
+                }
+                break;
+        default:
+                break;
+        }
+}
+
+/**
+ * Make the textures again after the renderer lost all of them, and point
+ * whatever draws from the atlas at its new texture. Returns 0 or -1.
+ */
+static int session_textures_lost(SDL_Renderer * renderer, atlas_t * atlas,
+                                 session_t * session)
+{
+        draw_state_forget(&session->state, atlas->texture);
+        if (atlas_reload(atlas, renderer)) {
+                return -1;
+        }
+        for (size_t i = 0; i < N_MODELS; i++) {
+                models[i].texture = atlas->texture;
+        }
+        draw_list_set_texture(&session->draws, atlas->texture);
+        for (int i = 0; i < session->n_strips; i++) {
+                draw_list_set_texture(&session->strips[i].draws,
+                                      atlas->texture);
+        }
+        layer_cache_lost(&session->layers, atlas->texture);
+        scroll_lost(&session->scroll, atlas->texture);
+        mip_lost(&session->mip);
+        session->pick.valid = false;
+        return 0;
+}
+
+/**
+ * Handle one event from the queue.
+ */
+static void on_event(SDL_Event * event, int *quit, SDL_Renderer * renderer,
+                     atlas_t * atlas, session_t * session)
+{
+        switch (event->type) {
+        case SDL_QUIT:
+                *quit = 1;
+                break;
+        case SDL_KEYDOWN:
+                on_keydown(&event->key, quit, session);
+                break;
+        case SDL_WINDOWEVENT:
+                switch (event->window.event) {
+                case SDL_WINDOWEVENT_SHOWN:
+                case SDL_WINDOWEVENT_EXPOSED:
+                case SDL_WINDOWEVENT_RESIZED:
+                case SDL_WINDOWEVENT_SIZE_CHANGED:
+                case SDL_WINDOWEVENT_RESTORED:
+                        session->exposed = true;
+                        break;
+                default:
+                        break;
+                }
+                break;
+        case SDL_MOUSEBUTTONDOWN:
+                on_mouse_button(&event->button, session);
+                break;
+        case SDL_RENDER_TARGETS_RESET:
+                /* What was drawn into target textures is gone. */
+                layer_cache_reset(&session->layers);
+                scroll_reset(&session->scroll);
+                session->exposed = true;
+                break;
+        case SDL_RENDER_DEVICE_RESET:
+                /* So are the textures themselves. */
+                if (session_textures_lost(renderer, atlas, session)) {
+                        printf("Failed to make the textures again!\n");
+                        *quit = 1;
+                }
+                session->exposed = true;
                 break;
         default:
                 break;
         }
 }
 
+/**
+ * Load the maps named in the args into the area.
+ */
+static int load_area(area_t * area, struct args *args)
+{
+        map_t *map;
+        if (!
+            (map =
+             map_from_image(args->filenames[0] ? args->
+                            filenames[0] : "map.png"))) {
+                return -1;
+        }
+
+        area_add(area, map);
+
+        for (int i = 1; i < N_MAPS && args->filenames[i]; i++) {
+
+                if (!(map = map_from_image(args->filenames[i]))) {
+                        return -1;
+                }
+                if ((map_w(map) != area_w(area)) ||
+                    (map_h(map) != area_h(area))) {
+                        printf("Maps must be same size!\n");
+                        map_free(map);
+                        return -1;
+                }
+                area_add(area, map);
+        }
+
+        if (args->compress) {
+                if (area_compress(area)) {
+                        printf("Failed to compress maps!\n");
+                        return -1;
+                }
+                printf("Compressed maps: %zu bytes -> %zu bytes\n",
+                       (size_t)area->n_maps * area_w(area) * area_h(area) *
+                       sizeof (pixel_t), chunk_store_bytes(area->store));
+        }
+
+        return 0;
+}
+
+/**
+ * Run a command that only needs the maps, not a window. Returns false if the
+ * command isn't one of those.
+ */
+static bool run_area_command(struct args *args)
+{
+        /* How many queries or agents to use on the loaded maps and on each
+         * of the generated maps. */
+        static const struct {
+                const char *cmd;
+                void (*run)(area_t *, const char *, int);
+                int n_maps, n_synth[2];
+        } commands[] = {
+                {"bench-path", bench_path, 1000, {1000, 200}},
+                {"bench-flow", bench_flow, 1000, {1000, 1000}},
+                {"bench-crowd", bench_crowd, 500, {10000, 100000}},
+        };
+        static const int synth[] = { 256, 1024 };
+        area_t area;
+        char name[32];
+
+        for (size_t c = 0; c < sizeof (commands) / sizeof (commands[0]); c++) {
+                if (strcmp(args->cmd, commands[c].cmd)) {
+                        continue;
+                }
+
+                memset(&area, 0, sizeof (area));
+                if (!load_area(&area, args)) {
+                        commands[c].run(&area, "maps", commands[c].n_maps);
+                }
+                area_deinit(&area);
+
+                for (size_t i = 0; i < sizeof (synth) / sizeof (synth[0]);
+                     i++) {
+                        memset(&area, 0, sizeof (area));
+                        snprintf(name, sizeof (name), "synth%d", synth[i]);
+                        if (!bench_synth_area(&area, synth[i], synth[i],
+                                              N_MAPS, 1)) {
+                                commands[c].run(&area, name,
+                                                commands[c].n_synth[i]);
+                        }
+                        area_deinit(&area);
+                }
+
+                return true;
+        }
+
+        return false;
+}
+
 int main(int argc, char **argv)
 {
         SDL_Event event;
         SDL_Window *window = NULL;
         SDL_Renderer *renderer = NULL;
-        SDL_Texture *textures[N_TEXTURES] = { 0 };
+        SDL_Surface *surface = NULL;
+        atlas_t atlas;
         session_t session;
 
         int done = 0;
-        Uint32 start_ticks, end_ticks, frames = 0, pre_tick;
-        double total_delay = 0, total_used = 0;
+        Uint32 frames = 0, skipped = 0;
+        int screen_w, screen_h;
+        double total_calls = 0;
+        pace_t pace;
+        double total_issued = 0, total_skipped = 0;
         struct args args;
 
         memset(&session, 0, sizeof (session));
+        memset(&atlas, 0, sizeof (atlas));
 
         parse_args(argc, argv, &args);
 
+        if (args.cmd && run_area_command(&args)) {
+                return 0;
+        }
+
         session.transparency = args.transparency;
 
-        /* Init SDL */
-        if (SDL_Init(SDL_INIT_VIDEO)) {
+        /* Init SDL. Headless needs no video, so it works without a
+         * display. */
+        if (SDL_Init(args.headless ? 0 : SDL_INIT_VIDEO)) {
                 printf("SDL_Init: %s\n", SDL_GetError());
                 return -1;
         }
@@ -740,131 +2662,315 @@ int main(int argc, char **argv)
         /* Cleanup SDL on exit. */
         atexit(SDL_Quit);
 
-        /* Create the main window */
-        if (!(window = SDL_CreateWindow("Demo", SDL_WINDOWPOS_UNDEFINED,
-                                        SDL_WINDOWPOS_UNDEFINED, 640 * 2,
-                                        480 * 2,
-                                        SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN)))
-        {
-                printf("SDL_CreateWindow: %s\n", SDL_GetError());
-                return -1;
-        }
+        if (args.headless) {
+                /* Draw into a surface in memory instead of a window. */
+                if (!(surface = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_W,
+                                                               SCREEN_H, 32,
+                                                               SDL_PIXELFORMAT_ARGB8888)))
+                {
+                        printf("SDL_CreateRGBSurfaceWithFormat: %s\n",
+                               SDL_GetError());
+                        return -1;
+                }
+                if (!(renderer = SDL_CreateSoftwareRenderer(surface))) {
+                        printf("SDL_CreateSoftwareRenderer: %s\n",
+                               SDL_GetError());
+                        goto destroy_window;
+                }
+        } else {
+                /* Create the main window */
+                if (!(window = SDL_CreateWindow("Demo",
+                                                SDL_WINDOWPOS_UNDEFINED,
+                                                SDL_WINDOWPOS_UNDEFINED,
+                                                SCREEN_W, SCREEN_H,
+                                                SDL_WINDOW_OPENGL |
+                                                SDL_WINDOW_SHOWN))) {
+                        printf("SDL_CreateWindow: %s\n", SDL_GetError());
+                        return -1;
+                }
 
-        /* Create the renderer. */
-        if (!(renderer = SDL_CreateRenderer(window, -1, 0))) {
-                printf("SDL_CreateRenderer: %s\n", SDL_GetError());
-                goto destroy_window;
+                /* Create the renderer. */
+                Uint32 flags = args.vsync ? SDL_RENDERER_PRESENTVSYNC : 0;
+                if (!(renderer = SDL_CreateRenderer(window, -1, flags))) {
+                        printf("SDL_CreateRenderer: %s\n", SDL_GetError());
+                        goto destroy_window;
+                }
         }
 
+        SDL_GetRendererOutputSize(renderer, &screen_w, &screen_h);
+
         /* Load the textures */
-        for (int i = 0; i < N_TEXTURES; i++) {
-                if (!(textures[i] = load_texture(renderer, texture_files[i]))) {
-                        goto destroy_textures;
-                }
+        if (atlas_init(&atlas, renderer, texture_files, N_TEXTURES,
+                       args.sprites ? SPRITE_SPARE_H : 0)) {
+                printf("Failed to load textures!\n");
+                goto destroy_textures;
         }
 
+        draw_state_init(&session.state);
+        if (draw_list_init(&session.draws, atlas.texture, &session.state)) {
+                printf("Failed to allocate draw list!\n");
+                goto destroy_textures;
+        }
+        session.batch = !args.copy;
+
+        view_screen_init();
+
         /* Setup the models */
         for (size_t i = 0; i < N_MODELS; i++) {
-                model_init(&models[i], textures, texture_indices[i],
+                model_init(&models[i], &atlas, texture_indices[i],
                            TILE_HEIGHT);
         }
 
-        map_t *map;
-        if (!
-            (map =
-             map_from_image(args.filenames[0] ? args.
-                            filenames[0] : "map.png"))) {
-                goto destroy_textures;
+        if (args.sprites) {
+                int res = sprite_cache_init(&session.sprites, &atlas, models,
+                                            N_MODELS);
+                if (res == ERROR_ALLOC) {
+                        printf("Failed to allocate sprites!\n");
+                        goto destroy_textures;
+                } else if (res) {
+                        printf("Can't make sprites in this atlas\n");
+                } else {
+                        session.use_sprites = true;
+                }
         }
 
-        area_add(&session.area, map);
+        if (load_area(&session.area, &args)) {
+                goto destroy_maps;
+        }
 
-        for (int i = 1; args.filenames[i]; i++) {
+        view_init(&session.view, &session.area, args.fov);
+        pick_init(&session.pick, &atlas, screen_w, screen_h);
 
-                if (!(map = map_from_image(args.filenames[i]))) {
+        /* The index takes several times the memory of the maps. */
+        if (args.regions) {
+                if (region_init(&session.regions, &session.area)) {
+                        printf("Failed to index maps!\n");
                         goto destroy_maps;
                 }
-                if ((map_w(map) != area_w(&session.area)) ||
-                    (map_h(map) != area_h(&session.area))) {
-                        printf("Maps must be same size!\n");
+                printf("Region index: %zu bytes\n",
+                       region_bytes(&session.regions));
+        }
+
+        if (args.prerotate) {
+                if (rotmap_init(&session.rotmap, &session.area)) {
+                        printf("Failed to rotate maps!\n");
                         goto destroy_maps;
                 }
-                area_add(&session.area, map);
+                session.prerotated = true;
         }
 
-        view_init(&session.view, &session.area, args.fov);
-        session.view.cursor[Z] = Z_PER_LEVEL * MAP_FLOOR1;
-
-        start_ticks = SDL_GetTicks();
-        pre_tick = SDL_GetTicks();
+        if (args.layers) {
+                if (layer_cache_init(&session.layers, &session.area, renderer,
+                                     atlas.texture, &session.state,
+                                     LAYER_PIXEL_W, LAYER_PIXEL_H,
+                                     LAYER_TILES * LAYER_TILES, screen_w,
+                                     screen_h)) {
+                        printf("Can't cache layers on this renderer\n");
+                } else {
+                        session.use_layers = true;
+                }
+        }
 
-        while (!done) {
-                while (SDL_PollEvent(&event)) {
-                        switch (event.type) {
-                        case SDL_QUIT:
-                                done = 1;
-                                break;
-                        case SDL_KEYDOWN:
-                                on_keydown(&event.key, &done, &session);
-                                break;
-                        case SDL_WINDOWEVENT:
-                                frames++;
-                                render(renderer, textures, &session);
-                                break;
-                        case SDL_MOUSEBUTTONDOWN:
-                                on_mouse_button(&event.button, &session);
-                        default:
-                                break;
-                        }
+        if (args.cull) {
+                if (session.use_layers) {
+                        printf("Can't leave out hidden faces with layers\n");
+                } else if (cover_init(&session.cover, &atlas, screen_w,
+                                      screen_h)) {
+                        printf("Failed to allocate coverage buffer!\n");
+                        goto destroy_maps;
+                } else {
+                        session.cull = true;
                 }
+        }
 
-                render(renderer, textures, &session);
+        if (args.fused) {
+                if (session.use_layers) {
+                        printf("Can't walk levels together with layers\n");
+                } else if (!(session.fused = malloc(sizeof (fused_t)))) {
+                        printf("Failed to allocate fused walk!\n");
+                        goto destroy_maps;
+                }
+        }
 
-                frames++;
-                Uint32 post_tick = SDL_GetTicks();
-                Uint32 used = post_tick - pre_tick;
-                pre_tick = post_tick;
-                total_used += used;
-
-                if (args.delay) {
-                        int delay = TICK_PER_FRAME - used;
-                        if (delay > 0) {
-                                SDL_Delay(delay);
-                                total_delay += delay;
-                        }
+        /* Offscreen the tiles can be drawn straight into the surface. */
+        if (args.headless) {
+                int res = blit_init(&session.blit, &atlas, surface);
+                if (res == ERROR_ALLOC) {
+                        printf("Failed to allocate blitter!\n");
+                        goto destroy_maps;
+                } else if (res) {
+                        printf("Can't blit to this surface\n");
+                } else if (args.blit && session.use_layers) {
+                        printf("Can't blit with layers\n");
+                } else {
+                        session.use_blit = args.blit;
                 }
+        } else if (args.blit) {
+                printf("The blitter only draws offscreen, with -x\n");
         }
 
-        end_ticks = SDL_GetTicks();
-        printf("Frames: %d\n", frames);
-        if (end_ticks > start_ticks) {
-                printf("%2.2f FPS\n",
-                       ((double)frames * 1000) / (end_ticks - start_ticks)
-                        );
-                printf("%f msecs avg loop times\n", (total_used / frames));
-                if (args.delay) {
-                        printf("%f msecs avg delay\n", (total_delay / frames));
+        if (args.scroll) {
+                int res;
+                if (session.use_layers || session.use_blit) {
+                        printf("Can't keep frames with layers or the "
+                               "blitter\n");
+                } else if ((res = scroll_init(&session.scroll, renderer,
+                                              atlas.texture, &session.state,
+                                              screen_w, screen_h)) ==
+                           ERROR_ALLOC) {
+                        printf("Failed to allocate frames!\n");
+                        goto destroy_maps;
+                } else if (res) {
+                        printf("Can't keep frames on this renderer\n");
+                } else {
+                        session.use_scroll = true;
                 }
         }
-destroy_maps:
-        for (int i = 0; i < N_MAPS; i++) {
-                if (session.area.maps[i]) {
-                        map_free(session.area.maps[i]);
+
+        if (args.zoom >= 0) {
+                if (session.use_layers || session.use_blit ||
+                    session.use_scroll) {
+                        printf("Can't zoom out with layers, the blitter or "
+                               "kept frames\n");
+                } else if (mip_init(&session.mip, &session.area, renderer,
+                                    terrain_color, NULL)) {
+                        printf("Failed to allocate mip levels!\n");
+                        goto destroy_maps;
+                } else {
+                        session.zoom = args.zoom;
                 }
         }
 
-destroy_textures:
-        for (int i = 0; i < N_TEXTURES; i++) {
-                if (textures[i]) {
-                        SDL_DestroyTexture(textures[i]);
+        if (args.threads >= 0 && session.fused) {
+                printf("Not drawing in strips, levels are walked together\n");
+        } else if (args.threads >= 0 &&
+                   session_strips_init(&session, atlas.texture, args.threads)) {
+                printf("Failed to start threads!\n");
+                goto destroy_maps;
+        }
+
+        session.view.cursor[Z] = Z_PER_LEVEL * MAP_FLOOR1;
+
+        if (args.cmd) {
+                if (!strcmp(args.cmd, "bench-rotate")) {
+                        bench_rotate(renderer, &atlas, &session);
+                } else if (!strcmp(args.cmd, "bench-blit")) {
+                        bench_blit(renderer, surface, &atlas, &session);
+                } else if (!strcmp(args.cmd, "bench-scroll")) {
+                        bench_scroll(renderer, surface, &atlas, &session);
+                } else if (!strcmp(args.cmd, "bench-traverse")) {
+                        bench_traverse(&atlas, &session);
+                } else if (!strcmp(args.cmd, "bench-zoom")) {
+                        bench_zoom(renderer, &atlas, &session);
                 } else {
+                        printf("Unknown command: %s\n", args.cmd);
+                        print_usage();
+                }
+                goto destroy_maps;
+        }
+
+        if (args.headless) {
+                run_headless(renderer, surface, &atlas, &session,
+                             args.headless_frames, args.png_prefix);
+                goto destroy_maps;
+        }
+
+        session.exposed = true;
+        pace_init(&pace, args.rate);
+
+        while (!done) {
+                /* With nothing new to show, sleep until something happens
+                 * instead of drawing the same frame again. */
+                if (!args.always && !session_is_dirty(&session)) {
+                        if (SDL_WaitEvent(&event)) {
+                                on_event(&event, &done, renderer, &atlas,
+                                         &session);
+                        }
+                        pace_idle(&pace);
+                }
+
+                while (SDL_PollEvent(&event)) {
+                        on_event(&event, &done, renderer, &atlas,
+                                 &session);
+                }
+
+                if (done) {
                         break;
                 }
+
+                if (!args.always && !session_is_dirty(&session)) {
+                        skipped++;
+                        continue;
+                }
+
+                render(renderer, &atlas, &session);
+                total_calls += session.calls;
+                total_issued += session.state.issued;
+                total_skipped += session.state.skipped;
+
+                frames++;
+                pace_frame(&pace);
+        }
+
+        printf("Frames: %d (%d wakeups with nothing to draw)\n", frames,
+               skipped);
+        if (frames) {
+                pace_print(&pace);
+                printf("%f SDL calls avg per frame to draw tiles (%s)\n",
+                       total_calls / frames,
+                       session.batch ? "geometry" : "copy");
+                printf("%f texture mod changes avg per frame, %f skipped as "
+                       "redundant\n", total_issued / frames,
+                       total_skipped / frames);
+                if (session.cull) {
+                        print_overdraw(&session.cover);
+                }
+                if (session.use_sprites) {
+                        print_sprites(&session.sprites);
+                }
+                if (session.use_scroll) {
+                        print_scroll(&session.scroll);
+                }
+                if (session.use_layers) {
+                        layer_cache_t *cache = &session.layers;
+                        printf("layers: %d drawn, %d patched, %.1f%% of "
+                               "cells from layers\n", cache->builds,
+                               cache->patches,
+                               100.0 * cache->clean_cells /
+                               max(cache->clean_cells + cache->marked_cells,
+                                   1));
+                }
+                if (session.area.store) {
+                        printf("%f chunk decodes avg per frame\n",
+                               (double)session.area.store->decodes / frames);
+                }
         }
+destroy_maps:
+        mip_deinit(&session.mip);
+        scroll_deinit(&session.scroll);
+        blit_deinit(&session.blit);
+        pick_deinit(&session.pick);
+        cover_deinit(&session.cover);
+        session_strips_deinit(&session);
+        free(session.fused);
+        layer_cache_deinit(&session.layers);
+        rotmap_deinit(&session.rotmap);
+        region_deinit(&session.regions);
+        area_deinit(&session.area);
+
+destroy_textures:
+        sprite_cache_deinit(&session.sprites);
+        draw_list_deinit(&session.draws);
+        atlas_deinit(&atlas);
 //destroy_renderer:
         SDL_DestroyRenderer(renderer);
 destroy_window:
-        SDL_DestroyWindow(window);
+        if (window) {
+                SDL_DestroyWindow(window);
+        }
+        if (surface) {
+                SDL_FreeSurface(surface);
+        }
 
         return 0;
 }
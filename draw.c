@@ -0,0 +1,296 @@
+/**
+ * A list of textured quads to draw, in order.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "draw.h"
+#include "error.h"
+#include "log.h"
+
+/* Draws the list starts out with room for. */
+#define DRAW_LIST_MIN 1024
+
+/* Most quads in one geometry call, so the scratch stays small. */
+#define DRAW_MAX_BATCH 16384
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+void draw_state_init(draw_state_t * state)
+{
+        memset(state, 0, sizeof (*state));
+}
+
+void draw_state_forget(draw_state_t * state, SDL_Texture * texture)
+{
+        for (int i = 0; i < state->n_textures; i++) {
+                if (state->textures[i].texture == texture) {
+                        state->textures[i] =
+                            state->textures[--state->n_textures];
+                        state->next = 0;
+                        return;
+                }
+        }
+}
+
+int draw_state_mod(draw_state_t * state, SDL_Texture * texture, SDL_Color mod)
+{
+        SDL_Color *cur = NULL;
+        int i, calls = 0;
+
+        if (!state) {
+                SDL_SetTextureAlphaMod(texture, mod.a);
+                SDL_SetTextureColorMod(texture, mod.r, mod.g, mod.b);
+                return 2;
+        }
+
+        for (i = 0; i < state->n_textures; i++) {
+                if (state->textures[i].texture == texture) {
+                        cur = &state->textures[i].mod;
+                        break;
+                }
+        }
+
+        if (!cur) {
+                /* Unknown, so set both and remember them. */
+                if (state->n_textures < DRAW_STATE_TEXTURES) {
+                        i = state->n_textures++;
+                } else {
+                        i = state->next;
+                        state->next = (i + 1) % DRAW_STATE_TEXTURES;
+                }
+                state->textures[i].texture = texture;
+                cur = &state->textures[i].mod;
+                SDL_SetTextureAlphaMod(texture, mod.a);
+                SDL_SetTextureColorMod(texture, mod.r, mod.g, mod.b);
+                calls = 2;
+        } else {
+                if (cur->a != mod.a) {
+                        SDL_SetTextureAlphaMod(texture, mod.a);
+                        calls++;
+                }
+                if (cur->r != mod.r || cur->g != mod.g || cur->b != mod.b) {
+                        SDL_SetTextureColorMod(texture, mod.r, mod.g, mod.b);
+                        calls++;
+                }
+        }
+        *cur = mod;
+
+        state->issued += calls;
+        state->skipped += 2 - calls;
+
+        return calls;
+}
+
+int draw_list_init(draw_list_t * list, SDL_Texture * texture,
+                   draw_state_t * state)
+{
+        memset(list, 0, sizeof (*list));
+        draw_list_set_texture(list, texture);
+        list->state = state;
+
+        if (!(list->draws = malloc(DRAW_LIST_MIN * sizeof (draw_t)))) {
+                return ERROR_ALLOC;
+        }
+        list->max_draws = DRAW_LIST_MIN;
+
+        return 0;
+}
+
+void draw_list_deinit(draw_list_t * list)
+{
+        free(list->draws);
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        free(list->verts);
+        free(list->indices);
+#endif
+        memset(list, 0, sizeof (*list));
+}
+
+void draw_list_set_texture(draw_list_t * list, SDL_Texture * texture)
+{
+        list->texture = texture;
+        if (texture) {
+                SDL_QueryTexture(texture, NULL, NULL, &list->tex_w,
+                                 &list->tex_h);
+        }
+}
+
+/* Make room for `n` more draws. */
+static void draw_list_grow(draw_list_t * list, int n)
+{
+        int max_draws = list->max_draws;
+        draw_t *draws;
+
+        if (list->n_draws + n <= max_draws) {
+                return;
+        }
+        while (list->n_draws + n > max_draws) {
+                max_draws *= 2;
+        }
+        if (!(draws = realloc(list->draws, max_draws * sizeof (draw_t)))) {
+                log_critical("%s:out of memory\n", __FUNCTION__);
+                abort();
+        }
+        list->draws = draws;
+        list->max_draws = max_draws;
+}
+
+void draw_list_add(draw_list_t * list, const SDL_Rect * src,
+                   const SDL_Rect * dst, Uint8 red, Uint8 grn, Uint8 blu,
+                   Uint8 alpha)
+{
+        draw_t *draw;
+
+        draw_list_grow(list, 1);
+        draw = &list->draws[list->n_draws++];
+        draw->src = *src;
+        draw->dst = *dst;
+        draw->color.r = red;
+        draw->color.g = grn;
+        draw->color.b = blu;
+        draw->color.a = alpha;
+}
+
+void draw_list_append(draw_list_t * list, const draw_t * draws, int n)
+{
+        draw_list_grow(list, n);
+        memcpy(&list->draws[list->n_draws], draws, n * sizeof (draw_t));
+        list->n_draws += n;
+}
+
+bool draw_clip(const draw_t * draw, const SDL_Rect * clip, draw_t * out)
+{
+        SDL_Rect dst;
+
+        if (!SDL_IntersectRect(&draw->dst, clip, &dst)) {
+                return false;
+        }
+
+        *out = *draw;
+        out->dst = dst;
+        out->src.x += (dst.x - draw->dst.x) * draw->src.w / draw->dst.w;
+        out->src.y += (dst.y - draw->dst.y) * draw->src.h / draw->dst.h;
+        out->src.w = dst.w * draw->src.w / draw->dst.w;
+        out->src.h = dst.h * draw->src.h / draw->dst.h;
+
+        return out->src.w > 0 && out->src.h > 0;
+}
+
+int draw_list_copy(draw_list_t * list, SDL_Renderer * renderer)
+{
+        int calls = list->n_draws;
+
+        for (int i = 0; i < list->n_draws; i++) {
+                draw_t *draw = &list->draws[i];
+                calls += draw_state_mod(list->state, list->texture,
+                                        draw->color);
+                SDL_RenderCopy(renderer, list->texture, &draw->src,
+                               &draw->dst);
+        }
+        return calls;
+}
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+
+/* Make sure the scratch holds a batch. */
+static bool draw_list_reserve(draw_list_t * list, int n_quads)
+{
+        SDL_Vertex *verts;
+        int *indices;
+
+        if (n_quads <= list->max_quads) {
+                return true;
+        }
+        if (!(verts = realloc(list->verts, n_quads * 4 * sizeof (SDL_Vertex)))) {
+                return false;
+        }
+        list->verts = verts;
+        if (!(indices = realloc(list->indices, n_quads * 6 * sizeof (int)))) {
+                return false;
+        }
+        list->indices = indices;
+
+        /* The indices only depend on the quad number. */
+        for (int q = list->max_quads; q < n_quads; q++) {
+                int *index = &indices[q * 6], v = q * 4;
+                index[0] = v;
+                index[1] = v + 1;
+                index[2] = v + 2;
+                index[3] = v + 2;
+                index[4] = v + 3;
+                index[5] = v;
+        }
+        list->max_quads = n_quads;
+
+        return true;
+}
+
+int draw_list_geometry(draw_list_t * list, SDL_Renderer * renderer)
+{
+        static const SDL_Color white = { 255, 255, 255, 255 };
+        int batch = min(list->n_draws, DRAW_MAX_BATCH), calls = 0;
+        float sx = 1.0f / list->tex_w, sy = 1.0f / list->tex_h;
+
+        if (!list->n_draws) {
+                return 0;
+        }
+        if (!draw_list_reserve(list, batch)) {
+                return draw_list_copy(list, renderer);
+        }
+
+        /* The colors are in the vertices, so clear what copies left. */
+        calls += draw_state_mod(list->state, list->texture, white);
+
+        for (int first = 0; first < list->n_draws; first += batch) {
+                int n = min(batch, list->n_draws - first);
+
+                for (int i = 0; i < n; i++) {
+                        draw_t *draw = &list->draws[first + i];
+                        SDL_Vertex *v = &list->verts[i * 4];
+                        float x0 = draw->dst.x, y0 = draw->dst.y;
+                        float x1 = x0 + draw->dst.w, y1 = y0 + draw->dst.h;
+                        float u0 = draw->src.x * sx, v0 = draw->src.y * sy;
+                        float u1 = (draw->src.x + draw->src.w) * sx;
+                        float v1 = (draw->src.y + draw->src.h) * sy;
+
+                        /* Clockwise from the top left. */
+                        v[0].position.x = x0;
+                        v[0].position.y = y0;
+                        v[0].tex_coord.x = u0;
+                        v[0].tex_coord.y = v0;
+                        v[1].position.x = x1;
+                        v[1].position.y = y0;
+                        v[1].tex_coord.x = u1;
+                        v[1].tex_coord.y = v0;
+                        v[2].position.x = x1;
+                        v[2].position.y = y1;
+                        v[2].tex_coord.x = u1;
+                        v[2].tex_coord.y = v1;
+                        v[3].position.x = x0;
+                        v[3].position.y = y1;
+                        v[3].tex_coord.x = u0;
+                        v[3].tex_coord.y = v1;
+                        v[0].color = v[1].color = v[2].color = v[3].color =
+                            draw->color;
+                }
+
+                SDL_RenderGeometry(renderer, list->texture, list->verts, n * 4,
+                                   list->indices, n * 6);
+                calls++;
+        }
+
+        return calls;
+}
+
+#else
+
+int draw_list_geometry(draw_list_t * list, SDL_Renderer * renderer)
+{
+        return draw_list_copy(list, renderer);
+}
+
+#endif
@@ -0,0 +1,124 @@
+/**
+ * A list of textured quads to draw, in order.
+ *
+ * Rendering a frame decides what goes where first and draws it after. Each
+ * draw copies a rect of one texture to a rect of the screen, modulated by a
+ * color whose alpha is the alpha modulation. The list can be submitted a
+ * draw at a time with `SDL_RenderCopy`, like drawing directly would, or all
+ * at once as triangles with `SDL_RenderGeometry`. Either way the draws land
+ * in list order, so later ones cover earlier ones.
+ *
+ * Lists that draw from the same textures can share a state tracker, which
+ * remembers the mods last set on each texture and skips setting them again to
+ * what they already are.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef draw_h
+#define draw_h
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+typedef struct {
+        SDL_Rect src;
+        SDL_Rect dst;
+        SDL_Color color;
+} draw_t;
+
+/* Textures a state tracker remembers at once. */
+#define DRAW_STATE_TEXTURES 8
+
+typedef struct {
+        struct {
+                SDL_Texture *texture;
+                SDL_Color mod;  /* color mod, with the alpha mod in a */
+        } textures[DRAW_STATE_TEXTURES];
+        int n_textures;
+        int next;               /* replaced when all are in use */
+
+        /* Statistics, for the caller to clear. */
+        int issued, skipped;
+} draw_state_t;
+
+typedef struct {
+        SDL_Texture *texture;   /* every draw is from this */
+        draw_state_t *state;    /* may be NULL */
+        int tex_w, tex_h;
+
+        draw_t *draws;
+        int n_draws, max_draws;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        /* Scratch for submitting geometry. */
+        SDL_Vertex *verts;
+        int *indices;
+        int max_quads;
+#endif
+} draw_list_t;
+
+/**
+ * Set up a tracker that knows nothing about any texture.
+ */
+void draw_state_init(draw_state_t * state);
+
+/**
+ * Forget what a texture's mods are, like before destroying it.
+ */
+void draw_state_forget(draw_state_t * state, SDL_Texture * texture);
+
+/**
+ * Set a texture's color and alpha mods, skipping whichever it already has.
+ * Returns the number of SDL calls made.
+ */
+int draw_state_mod(draw_state_t * state, SDL_Texture * texture, SDL_Color mod);
+
+/**
+ * Set up/tear down an empty list of draws from `texture`, tracking mods with
+ * `state` if it isn't NULL.
+ */
+int draw_list_init(draw_list_t * list, SDL_Texture * texture,
+                   draw_state_t * state);
+void draw_list_deinit(draw_list_t * list);
+
+#define draw_list_clear(l) ((l)->n_draws = 0)
+
+/**
+ * Switch the texture the draws are from.
+ */
+void draw_list_set_texture(draw_list_t * list, SDL_Texture * texture);
+
+/**
+ * Add a draw to the end of the list.
+ */
+void draw_list_add(draw_list_t * list, const SDL_Rect * src,
+                   const SDL_Rect * dst, Uint8 red, Uint8 grn, Uint8 blu,
+                   Uint8 alpha);
+
+/**
+ * Add copies of `n` draws to the end of the list.
+ */
+void draw_list_append(draw_list_t * list, const draw_t * draws, int n);
+
+/**
+ * Clip a draw to a rect, cutting its source rect in proportion. Returns false
+ * if nothing is left.
+ */
+bool draw_clip(const draw_t * draw, const SDL_Rect * clip, draw_t * out);
+
+/**
+ * Draw the list with a `SDL_RenderCopy` per draw, setting the texture's mods
+ * before each where they change. Returns the number of SDL calls made.
+ */
+int draw_list_copy(draw_list_t * list, SDL_Renderer * renderer);
+
+/**
+ * Draw the list as triangles with as few `SDL_RenderGeometry` calls as
+ * possible, which is one unless memory runs short. Falls back on
+ * `draw_list_copy` if SDL is too old for that. Returns the number of SDL
+ * calls made.
+ */
+int draw_list_geometry(draw_list_t * list, SDL_Renderer * renderer);
+
+#endif
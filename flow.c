@@ -0,0 +1,281 @@
+/**
+ * Flow fields built in parallel over all the levels of an area.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "flow.h"
+
+/* Nodes per job in each wave, and when pointing the way. */
+#define FLOW_WAVE_JOB 256
+#define FLOW_NEXT_JOB 4096
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+typedef struct {
+        flow_cache_t *cache;
+        flow_field_t *field;
+        int n;                  /* nodes in the wave */
+        int dist;               /* distance of the wave */
+} flow_wave_t;
+
+static void flow_node_loc(flow_field_t * field, int node, point_t loc)
+{
+        int w = area_w(field->area);
+        loc[X] = node % w;
+        loc[Y] = (node / w) % area_h(field->area);
+        loc[Z] = field->z[node];
+}
+
+/* Claim every unclaimed location that steps into the wave. The claims are
+ * atomic, so the next wave is the same whatever order the jobs run in. */
+static void flow_wave_job(void *data, int job)
+{
+        flow_wave_t *wave = data;
+        flow_cache_t *cache = wave->cache;
+        flow_field_t *field = wave->field;
+        int end = min((job + 1) * FLOW_WAVE_JOB, wave->n);
+
+        for (int i = job * FLOW_WAVE_JOB; i < end; i++) {
+                point_t loc, preds[MOVE_MAX_PREDS];
+                int dirs[MOVE_MAX_PREDS], n;
+
+                flow_node_loc(field, cache->wave[i], loc);
+                n = move_preds(field->area, loc, preds, dirs);
+                for (int j = 0; j < n; j++) {
+                        int node = move_node(field->area, preds[j]);
+                        if (SDL_AtomicCAS(&field->dist[node], -1,
+                                          wave->dist + 1)) {
+                                field->z[node] = preds[j][Z];
+                                cache->next_wave[SDL_AtomicAdd
+                                                 (&cache->next_n, 1)] = node;
+                        }
+                }
+        }
+}
+
+/* Point each location at the first direction that gets closer. Doing this
+ * after the search, instead of remembering which claim won, keeps the field
+ * independent of thread timing. */
+static void flow_next_job(void *data, int job)
+{
+        flow_field_t *field = data;
+        int n_nodes = move_n_nodes(field->area);
+        int end = min((job + 1) * FLOW_NEXT_JOB, n_nodes);
+
+        for (int node = job * FLOW_NEXT_JOB; node < end; node++) {
+                int dist = field->dist[node].value;
+                point_t loc, to;
+
+                field->next[node] = -1;
+                if (dist <= 0) {
+                        continue;
+                }
+                flow_node_loc(field, node, loc);
+                for (int dir = 0; dir < N_DIR; dir++) {
+                        if (move_step(field->area, loc, move_directions[dir],
+                                      to) &&
+                            field->dist[move_node(field->area, to)].value ==
+                            dist - 1) {
+                                field->next[node] = dir;
+                                break;
+                        }
+                }
+        }
+}
+
+static void flow_run(flow_cache_t * cache, pool_fn fn, void *data, int n_jobs)
+{
+        if (cache->pool && !cache->area->store) {
+                pool_run(cache->pool, fn, data, n_jobs);
+        } else {
+                for (int job = 0; job < n_jobs; job++) {
+                        fn(data, job);
+                }
+        }
+}
+
+static void flow_build(flow_cache_t * cache, flow_field_t * field)
+{
+        int n_nodes = move_n_nodes(cache->area);
+        flow_wave_t wave = { cache, field, 0, 0 };
+
+        memset(field->dist, 0xff, n_nodes * sizeof (SDL_atomic_t));
+        field->x0 = area_w(cache->area);
+        field->y0 = area_h(cache->area);
+        field->x1 = field->y1 = 0;
+
+        for (int i = 0; i < field->n_goals; i++) {
+                int node = move_node(cache->area, field->goals[i]);
+                if (field->dist[node].value < 0) {
+                        field->dist[node].value = 0;
+                        field->z[node] = field->goals[i][Z];
+                        cache->wave[wave.n++] = node;
+                }
+        }
+
+        while (wave.n) {
+                int *swap;
+
+                /* Track the reach of the field for invalidation. */
+                for (int i = 0; i < wave.n; i++) {
+                        int x = cache->wave[i] % area_w(cache->area);
+                        int y = ((cache->wave[i] / area_w(cache->area)) %
+                                 area_h(cache->area));
+                        field->x0 = min(field->x0, x);
+                        field->y0 = min(field->y0, y);
+                        field->x1 = max(field->x1, x + 1);
+                        field->y1 = max(field->y1, y + 1);
+                }
+
+                SDL_AtomicSet(&cache->next_n, 0);
+                flow_run(cache, flow_wave_job, &wave,
+                         (wave.n + FLOW_WAVE_JOB - 1) / FLOW_WAVE_JOB);
+
+                swap = cache->wave;
+                cache->wave = cache->next_wave;
+                cache->next_wave = swap;
+                wave.n = SDL_AtomicGet(&cache->next_n);
+                wave.dist++;
+        }
+
+        flow_run(cache, flow_next_job, field,
+                 (n_nodes + FLOW_NEXT_JOB - 1) / FLOW_NEXT_JOB);
+
+        field->valid = true;
+        cache->builds++;
+}
+
+static void flow_on_change(void *data, int level, int x, int y, pixel_t old,
+                           pixel_t pixel)
+{
+        flow_cache_t *cache = data;
+
+        /* A change beside the reach of a field can open a way into it. */
+        for (int i = 0; i < cache->n_fields; i++) {
+                flow_field_t *field = &cache->fields[i];
+                if (field->valid &&
+                    x >= field->x0 - 1 && x <= field->x1 &&
+                    y >= field->y0 - 1 && y <= field->y1) {
+                        field->valid = false;
+                }
+        }
+}
+
+int flow_cache_init(flow_cache_t * cache, area_t * area, pool_t * pool,
+                    int n_fields)
+{
+        int n_nodes = move_n_nodes(area);
+
+        memset(cache, 0, sizeof (*cache));
+        cache->pool = pool;
+        cache->n_fields = n_fields;
+
+        if (!(cache->fields = calloc(n_fields, sizeof (flow_field_t))) ||
+            !(cache->wave = malloc(n_nodes * sizeof (int))) ||
+            !(cache->next_wave = malloc(n_nodes * sizeof (int)))) {
+                flow_cache_deinit(cache);
+                return ERROR_ALLOC;
+        }
+
+        if (!area_listen(area, flow_on_change, cache)) {
+                flow_cache_deinit(cache);
+                return ERROR_ALLOC;
+        }
+        cache->area = area;
+
+        return 0;
+}
+
+void flow_cache_deinit(flow_cache_t * cache)
+{
+        if (cache->area) {
+                area_unlisten(cache->area, flow_on_change, cache);
+        }
+        if (cache->fields) {
+                for (int i = 0; i < cache->n_fields; i++) {
+                        free(cache->fields[i].goals);
+                        free(cache->fields[i].dist);
+                        free(cache->fields[i].next);
+                        free(cache->fields[i].z);
+                }
+                free(cache->fields);
+        }
+        free(cache->wave);
+        free(cache->next_wave);
+        memset(cache, 0, sizeof (*cache));
+}
+
+static bool flow_same_goals(flow_field_t * field, const point_t * goals,
+                            int n_goals)
+{
+        if (field->n_goals != n_goals) {
+                return false;
+        }
+        for (int i = 0; i < n_goals; i++) {
+                if (!point_equal(field->goals[i], goals[i])) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+flow_field_t *flow_get(flow_cache_t * cache, const point_t * goals,
+                       int n_goals)
+{
+        int n_nodes = move_n_nodes(cache->area);
+        flow_field_t *field = NULL;
+
+        /* Look for the goals, else take an unused or the least recently used
+         * field. */
+        for (int i = 0; i < cache->n_fields; i++) {
+                flow_field_t *f = &cache->fields[i];
+                if (f->goals && flow_same_goals(f, goals, n_goals)) {
+                        field = f;
+                        break;
+                }
+                if (!field || (field->goals && (!f->goals ||
+                                                f->stamp < field->stamp))) {
+                        field = f;
+                }
+        }
+        field->stamp = ++cache->clock;
+
+        if (field->valid && flow_same_goals(field, goals, n_goals)) {
+                cache->hits++;
+                return field;
+        }
+
+        if (!flow_same_goals(field, goals, n_goals)) {
+                point_t *copy = malloc(n_goals * sizeof (point_t));
+                if (!copy) {
+                        return NULL;
+                }
+                memcpy(copy, goals, n_goals * sizeof (point_t));
+                free(field->goals);
+                field->goals = copy;
+                field->n_goals = n_goals;
+                field->valid = false;
+        }
+
+        if (!field->dist) {
+                field->area = cache->area;
+                if (!(field->dist = malloc(n_nodes * sizeof (SDL_atomic_t))) ||
+                    !(field->next = malloc(n_nodes)) ||
+                    !(field->z = malloc(n_nodes))) {
+                        free(field->dist);
+                        free(field->next);
+                        field->dist = NULL;
+                        field->next = NULL;
+                        return NULL;
+                }
+        }
+
+        flow_build(cache, field);
+        return field;
+}
@@ -0,0 +1,95 @@
+/**
+ * Flow fields: the distance from every location to the nearest of a set of
+ * goals, and the direction to step to get closer.
+ *
+ * Fields are built breadth-first backward from the goals over the steps
+ * `move_step` allows, so falls and stair climbs are followed the right way
+ * around. Each wave of the search is spread over a thread pool. Once built, a
+ * field tells any number of agents heading for the same goals where to step
+ * next with a single lookup.
+ *
+ * A cache keeps the fields for recently used goals. A change to the terrain
+ * within or beside the part of the area a field reached invalidates it, and
+ * it is rebuilt the next time it is asked for.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef flow_h
+#define flow_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+#include "map.h"
+#include "move.h"
+#include "point.h"
+#include "pool.h"
+
+typedef struct {
+        area_t *area;
+        point_t *goals;
+        int n_goals;
+
+        /* Per-node state. */
+        SDL_atomic_t *dist;     /* steps to the nearest goal, or -1 */
+        int8_t *next;           /* direction to step, or -1 */
+        int8_t *z;              /* z of the location, where dist >= 0 */
+
+        /* Tiles in [x0, x1) x [y0, y1) were reached. */
+        int x0, y0, x1, y1;
+        bool valid;
+        uint32_t stamp;         /* last use, for eviction */
+} flow_field_t;
+
+typedef struct {
+        area_t *area;
+        pool_t *pool;
+        flow_field_t *fields;
+        int n_fields;
+        uint32_t clock;
+
+        /* Scratch for the waves of the search. */
+        int *wave, *next_wave;
+        SDL_atomic_t next_n;
+
+        /* Statistics. */
+        int builds, hits;
+} flow_cache_t;
+
+/**
+ * Set up/tear down a cache of up to `n_fields` fields. Builds use the pool if
+ * there is one, except on compressed areas, whose pixel cache is not thread
+ * safe.
+ */
+int flow_cache_init(flow_cache_t * cache, area_t * area, pool_t * pool,
+                    int n_fields);
+void flow_cache_deinit(flow_cache_t * cache);
+
+/**
+ * Get the field for a set of goals, building it if it isn't cached or the
+ * terrain has changed. The field stays good until the next call. Returns NULL
+ * if out of memory.
+ */
+flow_field_t *flow_get(flow_cache_t * cache, const point_t * goals,
+                       int n_goals);
+
+/**
+ * Steps from a location to the nearest goal, or -1 if no goal is reachable.
+ */
+static inline int flow_dist(flow_field_t * field, const point_t loc)
+{
+        return field->dist[move_node(field->area, loc)].value;
+}
+
+/**
+ * Direction of the next step toward the nearest goal, for `move_step`. -1 at
+ * a goal or where no goal is reachable.
+ */
+static inline int flow_next(flow_field_t * field, const point_t loc)
+{
+        return field->next[move_node(field->area, loc)];
+}
+
+#endif
@@ -0,0 +1,665 @@
+/**
+ * Hierarchical pathfinding (HPA*) over all the levels of an area.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "hpa.h"
+#include "move.h"
+
+/* Per-cluster update flags. */
+#define HPA_DIRTY  0x1          /* terrain changed */
+#define HPA_RELINK 0x2          /* crossings out of it may have changed */
+#define HPA_RENODE 0x4          /* entrances may have changed */
+
+/* Runs of crossings at least this long get an entrance at each end instead of
+ * one in the middle. */
+#define HPA_LONG_RUN 6
+
+/* Each border tile on each level crosses at most once per side. */
+#define HPA_MAX_LINKS (4 * HPA_CLUSTER_SIZE * N_MAPS)
+#define HPA_MAX_ENTRANCES (2 * HPA_MAX_LINKS)
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+static const int hpa_sides[] = { DIR_XLEFT, DIR_XRIGHT, DIR_YUP, DIR_YDOWN };
+
+static inline int hpa_cluster_of(hpa_t * hpa, const point_t loc)
+{
+        return ((loc[Y] / HPA_CLUSTER_SIZE) * hpa->clusters_w +
+                loc[X] / HPA_CLUSTER_SIZE);
+}
+
+/* Limit the path finder to one cluster. */
+static void hpa_bound(hpa_t * hpa, int c)
+{
+        int x0 = (c % hpa->clusters_w) * HPA_CLUSTER_SIZE;
+        int y0 = (c / hpa->clusters_w) * HPA_CLUSTER_SIZE;
+
+        path_set_bounds(&hpa->pf, x0, y0,
+                        min(x0 + HPA_CLUSTER_SIZE, area_w(hpa->area)),
+                        min(y0 + HPA_CLUSTER_SIZE, area_h(hpa->area)));
+}
+
+/* Set flags on a cluster and the clusters beside it. */
+static void hpa_mark(hpa_t * hpa, int c, uint8_t flags)
+{
+        int cx = c % hpa->clusters_w, cy = c / hpa->clusters_w;
+
+        hpa->clusters[c].flags |= flags;
+        for (int s = 0; s < 4; s++) {
+                const int *dir = move_directions[hpa_sides[s]];
+                int nx = cx + dir[X], ny = cy + dir[Y];
+                if (nx >= 0 && nx < hpa->clusters_w &&
+                    ny >= 0 && ny < hpa->clusters_h) {
+                        hpa->clusters[ny * hpa->clusters_w + nx].flags |=
+                            flags;
+                }
+        }
+}
+
+static void hpa_on_change(void *data, int level, int x, int y, pixel_t old,
+                          pixel_t pixel)
+{
+        hpa_t *hpa = data;
+        point_t loc = { x, y, 0 };
+
+        hpa->clusters[hpa_cluster_of(hpa, loc)].flags |= HPA_DIRTY;
+        hpa->dirty = true;
+}
+
+/* Find the crossing from the i'th tile along one side of a cluster on the
+ * given level, if there is one. */
+static bool hpa_crossing(hpa_t * hpa, int c, int side, int i, int level,
+                         hpa_link_t * link)
+{
+        const int *dir = move_directions[hpa_sides[side]];
+        int x0 = (c % hpa->clusters_w) * HPA_CLUSTER_SIZE;
+        int y0 = (c / hpa->clusters_w) * HPA_CLUSTER_SIZE;
+        int x1 = min(x0 + HPA_CLUSTER_SIZE, area_w(hpa->area));
+        int y1 = min(y0 + HPA_CLUSTER_SIZE, area_h(hpa->area));
+        int x, y;
+
+        if (dir[X]) {
+                x = dir[X] < 0 ? x0 : x1 - 1;
+                y = y0 + i;
+        } else {
+                x = x0 + i;
+                y = dir[Y] < 0 ? y0 : y1 - 1;
+        }
+
+        if (x >= x1 || y >= y1 ||
+            !move_stand(hpa->area, x, y, level, link->from_loc) ||
+            !move_step(hpa->area, link->from_loc, dir, link->to_loc)) {
+                return false;
+        }
+
+        link->cluster = hpa_cluster_of(hpa, link->to_loc);
+        return true;
+}
+
+/* Add a link unless it is already there. */
+static int hpa_add_link(hpa_link_t * links, int n, const hpa_link_t * link)
+{
+        for (int i = 0; i < n; i++) {
+                if (point_equal(links[i].from_loc, link->from_loc) &&
+                    point_equal(links[i].to_loc, link->to_loc)) {
+                        return n;
+                }
+        }
+        links[n] = *link;
+        return n + 1;
+}
+
+/* Find the crossings out of a cluster. */
+static int hpa_link(hpa_t * hpa, int c)
+{
+        hpa_cluster_t *cluster = &hpa->clusters[c];
+        hpa_link_t links[HPA_MAX_LINKS], run[HPA_CLUSTER_SIZE];
+        int n = 0;
+
+        for (int side = 0; side < 4; side++) {
+                for (int level = 0; level < hpa->area->n_maps; level++) {
+                        int n_run = 0;
+                        for (int i = 0; i <= HPA_CLUSTER_SIZE; i++) {
+                                hpa_link_t link;
+                                bool found = (i < HPA_CLUSTER_SIZE &&
+                                              hpa_crossing(hpa, c, side, i,
+                                                           level, &link));
+
+                                /* A run is a line of crossings that start and
+                                 * end at the same heights. */
+                                if (n_run &&
+                                    (!found ||
+                                     run[n_run - 1].from_loc[Z] !=
+                                     link.from_loc[Z] ||
+                                     run[n_run - 1].to_loc[Z] !=
+                                     link.to_loc[Z])) {
+                                        if (n_run < HPA_LONG_RUN) {
+                                                n = hpa_add_link(links, n,
+                                                                 &run[n_run /
+                                                                      2]);
+                                        } else {
+                                                n = hpa_add_link(links, n,
+                                                                 &run[0]);
+                                                n = hpa_add_link(links, n,
+                                                                 &run[n_run -
+                                                                      1]);
+                                        }
+                                        n_run = 0;
+                                }
+                                if (found) {
+                                        run[n_run++] = link;
+                                }
+                        }
+                }
+        }
+
+        free(cluster->links);
+        cluster->links = NULL;
+        cluster->n_links = 0;
+        if (n) {
+                if (!(cluster->links = malloc(n * sizeof (hpa_link_t)))) {
+                        return ERROR_ALLOC;
+                }
+                memcpy(cluster->links, links, n * sizeof (hpa_link_t));
+                cluster->n_links = n;
+        }
+
+        return 0;
+}
+
+/* Get the index of an entrance, adding it if it is new. */
+static int hpa_add_entrance(point_t * entrances, int *n, const point_t loc)
+{
+        for (int i = 0; i < *n; i++) {
+                if (point_equal(entrances[i], loc)) {
+                        return i;
+                }
+        }
+        point_copy(entrances[*n], loc);
+        return (*n)++;
+}
+
+/* Collect the entrances of a cluster from the crossings into and out of it,
+ * then find the costs between them. */
+static int hpa_build(hpa_t * hpa, int c)
+{
+        hpa_cluster_t *cluster = &hpa->clusters[c];
+        point_t entrances[HPA_MAX_ENTRANCES];
+        int n = 0;
+
+        for (int i = 0; i < cluster->n_links; i++) {
+                hpa_link_t *link = &cluster->links[i];
+                link->from = hpa_add_entrance(entrances, &n, link->from_loc);
+        }
+        for (int s = 0; s < 4; s++) {
+                const int *dir = move_directions[hpa_sides[s]];
+                int nx = c % hpa->clusters_w + dir[X];
+                int ny = c / hpa->clusters_w + dir[Y];
+                hpa_cluster_t *other;
+
+                if (nx < 0 || nx >= hpa->clusters_w ||
+                    ny < 0 || ny >= hpa->clusters_h) {
+                        continue;
+                }
+                other = &hpa->clusters[ny * hpa->clusters_w + nx];
+                for (int i = 0; i < other->n_links; i++) {
+                        hpa_link_t *link = &other->links[i];
+                        if (link->cluster == c) {
+                                link->to =
+                                    hpa_add_entrance(entrances, &n,
+                                                     link->to_loc);
+                        }
+                }
+        }
+
+        free(cluster->entrances);
+        free(cluster->costs);
+        cluster->entrances = NULL;
+        cluster->costs = NULL;
+        cluster->n_entrances = 0;
+        if (!n) {
+                return 0;
+        }
+
+        if (!(cluster->entrances = malloc(n * sizeof (point_t))) ||
+            !(cluster->costs = malloc(n * n * sizeof (int)))) {
+                return ERROR_ALLOC;
+        }
+        memcpy(cluster->entrances, entrances, n * sizeof (point_t));
+        cluster->n_entrances = n;
+
+        hpa_bound(hpa, c);
+        for (int i = 0; i < n; i++) {
+                path_flood(&hpa->pf, entrances[i]);
+                for (int j = 0; j < n; j++) {
+                        cluster->costs[i * n + j] =
+                            path_cost(&hpa->pf, entrances[j]);
+                }
+        }
+
+        return 0;
+}
+
+/* Number the entrances as nodes of the abstract graph. */
+static int hpa_number(hpa_t * hpa)
+{
+        int n_clusters = hpa->clusters_w * hpa->clusters_h;
+        int n = 2;
+
+        for (int c = 0; c < n_clusters; c++) {
+                hpa->clusters[c].base = n - 2;
+                n += hpa->clusters[c].n_entrances;
+        }
+
+        if (n != hpa->n_ids) {
+                free(hpa->id_cluster);
+                free(hpa->g);
+                free(hpa->parent);
+                free(hpa->seen);
+                free(hpa->closed);
+                free(hpa->chain);
+                hpa->n_ids = 0;
+                hpa->gen = 0;
+                if (!(hpa->id_cluster = malloc(n * sizeof (int))) ||
+                    !(hpa->g = malloc(n * sizeof (int))) ||
+                    !(hpa->parent = malloc(n * sizeof (int))) ||
+                    !(hpa->seen = calloc(n, sizeof (uint32_t))) ||
+                    !(hpa->closed = calloc(n, sizeof (uint32_t))) ||
+                    !(hpa->chain = malloc(n * sizeof (int)))) {
+                        return ERROR_ALLOC;
+                }
+                hpa->n_ids = n;
+        }
+
+        for (int c = 0; c < n_clusters; c++) {
+                hpa_cluster_t *cluster = &hpa->clusters[c];
+                for (int i = 0; i < cluster->n_entrances; i++) {
+                        hpa->id_cluster[cluster->base + i] = c;
+                }
+        }
+
+        return 0;
+}
+
+int hpa_update(hpa_t * hpa)
+{
+        int n_clusters = hpa->clusters_w * hpa->clusters_h;
+        int result;
+
+        if (!hpa->dirty) {
+                return 0;
+        }
+
+        /* A change can alter the crossings into the cluster as well as out of
+         * it, and new crossings can add entrances on either side. */
+        for (int c = 0; c < n_clusters; c++) {
+                if (hpa->clusters[c].flags & HPA_DIRTY) {
+                        hpa_mark(hpa, c, HPA_RELINK);
+                }
+        }
+        for (int c = 0; c < n_clusters; c++) {
+                if (hpa->clusters[c].flags & HPA_RELINK) {
+                        if ((result = hpa_link(hpa, c))) {
+                                return result;
+                        }
+                        hpa_mark(hpa, c, HPA_RENODE);
+                }
+        }
+
+        hpa->rebuilt = 0;
+        for (int c = 0; c < n_clusters; c++) {
+                if (hpa->clusters[c].flags & HPA_RENODE) {
+                        if ((result = hpa_build(hpa, c))) {
+                                return result;
+                        }
+                        hpa->rebuilt++;
+                }
+        }
+
+        if ((result = hpa_number(hpa))) {
+                return result;
+        }
+
+        for (int c = 0; c < n_clusters; c++) {
+                hpa->clusters[c].flags = 0;
+        }
+        hpa->dirty = false;
+
+        return 0;
+}
+
+int hpa_init(hpa_t * hpa, area_t * area)
+{
+        int n_clusters;
+
+        memset(hpa, 0, sizeof (*hpa));
+        hpa->clusters_w = (area_w(area) + HPA_CLUSTER_SIZE - 1) /
+            HPA_CLUSTER_SIZE;
+        hpa->clusters_h = (area_h(area) + HPA_CLUSTER_SIZE - 1) /
+            HPA_CLUSTER_SIZE;
+        n_clusters = hpa->clusters_w * hpa->clusters_h;
+
+        if (!(hpa->clusters = calloc(n_clusters, sizeof (hpa_cluster_t))) ||
+            path_init(&hpa->pf, area)) {
+                hpa_deinit(hpa);
+                return ERROR_ALLOC;
+        }
+
+        if (!area_listen(area, hpa_on_change, hpa)) {
+                hpa_deinit(hpa);
+                return ERROR_ALLOC;
+        }
+        hpa->area = area;
+
+        for (int c = 0; c < n_clusters; c++) {
+                hpa->clusters[c].flags = HPA_DIRTY;
+        }
+        hpa->dirty = true;
+
+        if (hpa_update(hpa)) {
+                hpa_deinit(hpa);
+                return ERROR_ALLOC;
+        }
+
+        return 0;
+}
+
+void hpa_deinit(hpa_t * hpa)
+{
+        if (hpa->area) {
+                area_unlisten(hpa->area, hpa_on_change, hpa);
+        }
+        if (hpa->clusters) {
+                for (int c = 0; c < hpa->clusters_w * hpa->clusters_h; c++) {
+                        free(hpa->clusters[c].entrances);
+                        free(hpa->clusters[c].costs);
+                        free(hpa->clusters[c].links);
+                }
+                free(hpa->clusters);
+        }
+        path_deinit(&hpa->pf);
+        free(hpa->id_cluster);
+        free(hpa->g);
+        free(hpa->parent);
+        free(hpa->seen);
+        free(hpa->closed);
+        free(hpa->chain);
+        free(hpa->open);
+        memset(hpa, 0, sizeof (*hpa));
+}
+
+/* Order the open list by f, breaking ties toward the deeper node. */
+static inline bool hpa_less(const hpa_open_t * a, const hpa_open_t * b)
+{
+        return a->f < b->f || (a->f == b->f && a->g > b->g);
+}
+
+/* Open an abstract node, or reopen it with a lower cost. Stale entries stay
+ * in the heap and are skipped when popped. */
+static int hpa_push(hpa_t * hpa, int id, int g, int parent, int h)
+{
+        hpa_open_t entry = { g + h, g, id };
+        int i;
+
+        if (hpa->closed[id] == hpa->gen ||
+            (hpa->seen[id] == hpa->gen && g >= hpa->g[id])) {
+                return 0;
+        }
+        hpa->seen[id] = hpa->gen;
+        hpa->g[id] = g;
+        hpa->parent[id] = parent;
+
+        if (hpa->open_n == hpa->open_cap) {
+                int cap = hpa->open_cap ? hpa->open_cap * 2 : 256;
+                hpa_open_t *open = realloc(hpa->open, cap * sizeof (*open));
+                if (!open) {
+                        return ERROR_ALLOC;
+                }
+                hpa->open = open;
+                hpa->open_cap = cap;
+        }
+
+        for (i = hpa->open_n++; i > 0; i = (i - 1) / 2) {
+                if (!hpa_less(&entry, &hpa->open[(i - 1) / 2])) {
+                        break;
+                }
+                hpa->open[i] = hpa->open[(i - 1) / 2];
+        }
+        hpa->open[i] = entry;
+
+        return 0;
+}
+
+static int hpa_pop(hpa_t * hpa)
+{
+        while (hpa->open_n) {
+                hpa_open_t top = hpa->open[0];
+                hpa_open_t last = hpa->open[--hpa->open_n];
+                int i = 0;
+
+                for (;;) {
+                        int child = i * 2 + 1;
+                        if (child >= hpa->open_n) {
+                                break;
+                        }
+                        if (child + 1 < hpa->open_n &&
+                            hpa_less(&hpa->open[child + 1],
+                                     &hpa->open[child])) {
+                                child++;
+                        }
+                        if (!hpa_less(&hpa->open[child], &last)) {
+                                break;
+                        }
+                        hpa->open[i] = hpa->open[child];
+                        i = child;
+                }
+                hpa->open[i] = last;
+
+                if (hpa->closed[top.id] != hpa->gen &&
+                    top.g == hpa->g[top.id]) {
+                        hpa->closed[top.id] = hpa->gen;
+                        return top.id;
+                }
+        }
+        return -1;
+}
+
+static const int *hpa_id_loc(hpa_t * hpa, int id)
+{
+        hpa_cluster_t *cluster = &hpa->clusters[hpa->id_cluster[id]];
+        return cluster->entrances[id - cluster->base];
+}
+
+static inline int hpa_distance(const point_t a, const point_t b)
+{
+        return abs(a[X] - b[X]) + abs(a[Y] - b[Y]);
+}
+
+/* Search the abstract graph from `from` in cluster `cs` to `to` in cluster
+ * `cg`, given the costs from the start to the entrances of `cs` and from the
+ * entrances of `cg` to the goal. Returns the goal node if it was reached. */
+static int hpa_search(hpa_t * hpa, const point_t to, int cs, const int *start,
+                      int cg, const int *goal)
+{
+        int s_id = hpa->n_ids - 2, g_id = hpa->n_ids - 1;
+        int id;
+
+        if (++hpa->gen == 0) {
+                memset(hpa->seen, 0, hpa->n_ids * sizeof (uint32_t));
+                memset(hpa->closed, 0, hpa->n_ids * sizeof (uint32_t));
+                hpa->gen = 1;
+        }
+        hpa->open_n = 0;
+
+        if (hpa_push(hpa, s_id, 0, -1, 0)) {
+                return -1;
+        }
+
+        while ((id = hpa_pop(hpa)) >= 0) {
+                hpa_cluster_t *cluster;
+                int i, n, g = hpa->g[id], result = 0;
+
+                if (id == g_id) {
+                        return id;
+                }
+                hpa->expanded++;
+
+                if (id == s_id) {
+                        cluster = &hpa->clusters[cs];
+                        for (int j = 0; j < cluster->n_entrances; j++) {
+                                if (start[j] >= 0) {
+                                        result |= hpa_push(hpa,
+                                                           cluster->base + j,
+                                                           start[j], id,
+                                                           hpa_distance(cluster->
+                                                                 entrances[j],
+                                                                 to));
+                                }
+                        }
+                        if (result) {
+                                return -1;
+                        }
+                        continue;
+                }
+
+                cluster = &hpa->clusters[hpa->id_cluster[id]];
+                i = id - cluster->base;
+                n = cluster->n_entrances;
+
+                for (int j = 0; j < n; j++) {
+                        int cost = cluster->costs[i * n + j];
+                        if (j != i && cost >= 0) {
+                                result |= hpa_push(hpa, cluster->base + j,
+                                                   g + cost, id,
+                                                   hpa_distance(cluster->entrances[j],
+                                                         to));
+                        }
+                }
+
+                for (int k = 0; k < cluster->n_links; k++) {
+                        hpa_link_t *link = &cluster->links[k];
+                        if (link->from == i) {
+                                result |= hpa_push(hpa,
+                                                   hpa->clusters[link->cluster].
+                                                   base + link->to, g + 1, id,
+                                                   hpa_distance(link->to_loc, to));
+                        }
+                }
+
+                if (hpa->id_cluster[id] == cg && goal[i] >= 0) {
+                        result |= hpa_push(hpa, g_id, g + goal[i], id, 0);
+                }
+
+                if (result) {
+                        return -1;
+                }
+        }
+
+        return -1;
+}
+
+/* Find the local path between two locations in a cluster and append it to the
+ * path so far, which ends at `from`. Returns the new length. */
+static int hpa_refine(hpa_t * hpa, int c, const point_t from,
+                      const point_t to, point_t * path, int len, int max_path)
+{
+        int room = max_path - (len - 1);
+        int n;
+
+        hpa_bound(hpa, c);
+        n = path_find(&hpa->pf, from, to, room > 0 ? path + len - 1 : NULL,
+                      room > 0 ? room : 0);
+        hpa->expanded += hpa->pf.expanded;
+
+        return n < 0 ? -1 : len + n - 1;
+}
+
+int hpa_find(hpa_t * hpa, const point_t from, const point_t to,
+             point_t * path, int max_path)
+{
+        int start[HPA_MAX_ENTRANCES], goal[HPA_MAX_ENTRANCES];
+        int cs, cg, id, n_chain, len;
+        hpa_cluster_t *cluster;
+
+        hpa->expanded = 0;
+        if (hpa_update(hpa)) {
+                return -1;
+        }
+
+        cs = hpa_cluster_of(hpa, from);
+        cg = hpa_cluster_of(hpa, to);
+
+        /* Nearby goals usually don't need the abstract graph. */
+        if (cs == cg && (len = hpa_refine(hpa, cs, from, to, path, 1,
+                                          max_path)) > 0) {
+                return len;
+        }
+
+        /* Connect the start and goal to the entrances of their clusters. */
+        cluster = &hpa->clusters[cs];
+        hpa_bound(hpa, cs);
+        path_flood(&hpa->pf, from);
+        hpa->expanded += hpa->pf.expanded;
+        for (int i = 0; i < cluster->n_entrances; i++) {
+                start[i] = path_cost(&hpa->pf, cluster->entrances[i]);
+        }
+
+        cluster = &hpa->clusters[cg];
+        hpa_bound(hpa, cg);
+        for (int i = 0; i < cluster->n_entrances; i++) {
+                goal[i] = path_find(&hpa->pf, cluster->entrances[i], to, NULL,
+                                    0);
+                hpa->expanded += hpa->pf.expanded;
+                if (goal[i] > 0) {
+                        goal[i]--;
+                }
+        }
+
+        if ((id = hpa_search(hpa, to, cs, start, cg, goal)) < 0) {
+                return -1;
+        }
+
+        /* Walk back from the goal to list the abstract path in order. */
+        n_chain = 0;
+        for (; id >= 0; id = hpa->parent[id]) {
+                n_chain++;
+        }
+        id = hpa->n_ids - 1;
+        for (int i = n_chain - 1; i >= 0; i--, id = hpa->parent[id]) {
+                hpa->chain[i] = id;
+        }
+
+        /* Refine each hop. Hops between clusters are single steps. */
+        if (max_path > 0) {
+                point_copy(path[0], from);
+        }
+        len = 1;
+        for (int i = 1; i < n_chain && len > 0; i++) {
+                int prev = hpa->chain[i - 1], next = hpa->chain[i];
+                const int *a = (i == 1) ? from : hpa_id_loc(hpa, prev);
+                const int *b = (i == n_chain - 1) ? to : hpa_id_loc(hpa, next);
+
+                if (i == 1) {
+                        len = hpa_refine(hpa, cs, a, b, path, len, max_path);
+                } else if (i == n_chain - 1) {
+                        len = hpa_refine(hpa, cg, a, b, path, len, max_path);
+                } else if (hpa->id_cluster[prev] == hpa->id_cluster[next]) {
+                        len = hpa_refine(hpa, hpa->id_cluster[prev], a, b,
+                                         path, len, max_path);
+                } else {
+                        if (len < max_path) {
+                                point_copy(path[len], b);
+                        }
+                        len++;
+                }
+        }
+
+        path_clear_bounds(&hpa->pf);
+        return len;
+}
@@ -0,0 +1,94 @@
+/**
+ * Hierarchical pathfinding (HPA*) over all the levels of an area.
+ *
+ * The area is cut into square clusters that span every level. Wherever
+ * `move_step` can cross from one cluster into the next, a run of neighboring
+ * crossings is collapsed into one or two entrances, and the cost between each
+ * pair of entrances inside a cluster is found with a search bounded to that
+ * cluster. A query searches this small abstract graph first and then refines
+ * each hop with a local search, so paths are near-shortest rather than
+ * shortest.
+ *
+ * Terrain changes mark their cluster dirty through an area listener, and the
+ * next query rebuilds only the dirty clusters and their neighbors.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef hpa_h
+#define hpa_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "map.h"
+#include "path.h"
+#include "point.h"
+
+#define HPA_CLUSTER_SIZE 16
+
+/* A crossing from an entrance of one cluster to one of its neighbor's. */
+typedef struct {
+        point_t from_loc, to_loc;
+        int from;               /* entrance index in this cluster */
+        int cluster;            /* neighbor cluster */
+        int to;                 /* entrance index in the neighbor */
+} hpa_link_t;
+
+typedef struct {
+        point_t *entrances;
+        int n_entrances;
+        int *costs;             /* n_entrances squared, -1 if unreachable */
+        hpa_link_t *links;      /* crossings out of this cluster */
+        int n_links;
+        int base;               /* abstract node of the first entrance */
+        uint8_t flags;
+} hpa_cluster_t;
+
+typedef struct {
+        int f, g, id;
+} hpa_open_t;
+
+typedef struct {
+        area_t *area;
+        int clusters_w, clusters_h;
+        hpa_cluster_t *clusters;
+        bool dirty;
+        path_finder_t pf;
+
+        /* Abstract search state: one node per entrance, plus the start and
+         * goal of the query. */
+        int n_ids;
+        int *id_cluster;
+        int *g, *parent;
+        uint32_t *seen, *closed;
+        uint32_t gen;
+        int *chain;             /* abstract path being refined */
+        hpa_open_t *open;
+        int open_n, open_cap;
+
+        /* Statistics. */
+        int rebuilt;            /* clusters rebuilt by the last update */
+        int expanded;           /* nodes expanded by the last query */
+} hpa_t;
+
+/**
+ * Build/free the abstract graph for the area. It stays current with changes
+ * to the area until `hpa_deinit`.
+ */
+int hpa_init(hpa_t * hpa, area_t * area);
+void hpa_deinit(hpa_t * hpa);
+
+/**
+ * Rebuild the clusters changed since the last update. Queries do this
+ * automatically.
+ */
+int hpa_update(hpa_t * hpa);
+
+/**
+ * Find a path like `path_find` does. The path may be a little longer than the
+ * shortest one.
+ */
+int hpa_find(hpa_t * hpa, const point_t from, const point_t to,
+             point_t * path, int max_path);
+
+#endif
@@ -0,0 +1,405 @@
+/**
+ * Jump point search over all the levels of an area.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "jps.h"
+#include "move.h"
+
+/* Direction of a jump that was not made, so every way out gets scanned. */
+#define JPS_ANY -1
+
+static inline uint64_t *jps_row(uint64_t * plane, int words, int row)
+{
+        return plane + row * words;
+}
+
+static inline bool jps_get(const uint64_t * plane, int words, int row,
+                           int col)
+{
+        return (plane[row * words + (col >> 6)] >> (col & 63)) & 1;
+}
+
+static inline void jps_put(uint64_t * plane, int words, int row, int col,
+                           bool on)
+{
+        uint64_t bit = 1ull << (col & 63);
+
+        if (on) {
+                plane[row * words + (col >> 6)] |= bit;
+        } else {
+                plane[row * words + (col >> 6)] &= ~bit;
+        }
+}
+
+/* Set a bit in a plane and its transpose. */
+static void jps_set(jps_t * jps, uint64_t ** planes, uint64_t ** planes_t,
+                    int level, int x, int y, bool on)
+{
+        jps_put(planes[level], jps->words_w, y, x, on);
+        jps_put(planes_t[level], jps->words_h, x, y, on);
+}
+
+/* Can a jump cross this tile? */
+static bool jps_simple(area_t * area, int x, int y, int level)
+{
+        pixel_t pix = area_get_pixel(area, level, x, y);
+        point_t loc = { x, y, L2Z(level) }, to;
+
+        if (!pix || PIXEL_IS_IMPASSABLE(pix)) {
+                return false;
+        }
+        if ((move_step(area, loc, move_directions[DIR_ZUP], to) &&
+             !point_equal(to, loc)) ||
+            (move_step(area, loc, move_directions[DIR_ZDOWN], to) &&
+             !point_equal(to, loc))) {
+                return false;
+        }
+        return true;
+}
+
+/* Does this simple tile lead anywhere a jump can't follow? */
+static bool jps_gate(jps_t * jps, int x, int y, int level)
+{
+        point_t loc = { x, y, L2Z(level) }, to;
+
+        for (int dir = DIR_XLEFT; dir <= DIR_YDOWN; dir++) {
+                const int *d = move_directions[dir];
+                int nx = x + d[X], ny = y + d[Y];
+                if (area_contains(jps->area, nx, ny) &&
+                    !jps_get(jps->open[level], jps->words_w, ny, nx) &&
+                    move_step(jps->area, loc, d, to)) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static void jps_classify(jps_t * jps, int x, int y)
+{
+        for (int level = 0; level < jps->area->n_maps; level++) {
+                jps_set(jps, jps->open, jps->open_t, level, x, y,
+                        jps_simple(jps->area, x, y, level));
+        }
+}
+
+static void jps_classify_gates(jps_t * jps, int x, int y)
+{
+        for (int level = 0; level < jps->area->n_maps; level++) {
+                jps_set(jps, jps->stop, jps->stop_t, level, x, y,
+                        jps_get(jps->open[level], jps->words_w, y, x) &&
+                        jps_gate(jps, x, y, level));
+        }
+}
+
+/* Only the column itself can change whether it is simple, but its neighbors
+ * can become or stop being gates. */
+static void jps_on_change(void *data, int level, int x, int y, pixel_t old,
+                          pixel_t pixel)
+{
+        jps_t *jps = data;
+
+        jps_classify(jps, x, y);
+        for (int dir = DIR_XLEFT; dir <= DIR_YDOWN; dir++) {
+                int nx = x + move_directions[dir][X];
+                int ny = y + move_directions[dir][Y];
+                if (area_contains(jps->area, nx, ny)) {
+                        jps_classify_gates(jps, nx, ny);
+                }
+        }
+        jps_classify_gates(jps, x, y);
+}
+
+int jps_init(jps_t * jps, area_t * area)
+{
+        int w = area_w(area), h = area_h(area);
+
+        memset(jps, 0, sizeof (*jps));
+        jps->area = area;
+        jps->words_w = (w + 63) / 64;
+        jps->words_h = (h + 63) / 64;
+
+        for (int level = 0; level < area->n_maps; level++) {
+                if (!(jps->open[level] = calloc(h * jps->words_w, 8)) ||
+                    !(jps->stop[level] = calloc(h * jps->words_w, 8)) ||
+                    !(jps->open_t[level] = calloc(w * jps->words_h, 8)) ||
+                    !(jps->stop_t[level] = calloc(w * jps->words_h, 8))) {
+                        goto fail;
+                }
+        }
+        if (!(jps->dirs = malloc(move_n_nodes(area))) ||
+            path_init(&jps->pf, area)) {
+                goto fail;
+        }
+
+        for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                        jps_classify(jps, x, y);
+                }
+        }
+        for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                        jps_classify_gates(jps, x, y);
+                }
+        }
+
+        if (!area_listen(area, jps_on_change, jps)) {
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        jps->area = NULL;
+        jps_deinit(jps);
+        return ERROR_ALLOC;
+}
+
+void jps_deinit(jps_t * jps)
+{
+        if (jps->area) {
+                area_unlisten(jps->area, jps_on_change, jps);
+        }
+        for (int level = 0; level < N_MAPS; level++) {
+                free(jps->open[level]);
+                free(jps->stop[level]);
+                free(jps->open_t[level]);
+                free(jps->stop_t[level]);
+        }
+        free(jps->dirs);
+        path_deinit(&jps->pf);
+        memset(jps, 0, sizeof (*jps));
+}
+
+/* Tiles of a row that open up beside a scan in direction `d` where they
+ * were closed one tile back. Turning there is forced. */
+static inline uint64_t jps_forced(const uint64_t * row, int words, int k, int d)
+{
+        uint64_t back;
+
+        if (d > 0) {
+                back = (row[k] << 1) | (k > 0 ? row[k - 1] >> 63 : 0);
+        } else {
+                back = (row[k] >> 1) | (k + 1 < words ? row[k + 1] << 63 : 0);
+        }
+        return row[k] & ~back;
+}
+
+/* Scan a line of bits from `from` in direction `d` (1 or -1) for the first
+ * tile that is closed or where the jump must stop. Sets `blocked` if it was
+ * closed. The rows on either side, if given, add the forced turns. */
+static int jps_scan(const uint64_t * open, const uint64_t * stop,
+                    const uint64_t * side_a, const uint64_t * side_b,
+                    int words, int from, int d, bool *blocked)
+{
+        int k = from >> 6, b = from & 63;
+        uint64_t mask = d > 0 ? ~((2ull << b) - 1) : (1ull << b) - 1;
+
+        for (; k >= 0 && k < words; k += d, mask = ~0ull) {
+                uint64_t hits = stop[k];
+                if (side_a) {
+                        hits |= jps_forced(side_a, words, k, d);
+                }
+                if (side_b) {
+                        hits |= jps_forced(side_b, words, k, d);
+                }
+                hits = (~open[k] | hits) & mask;
+                if (hits) {
+                        int t = (d > 0 ? __builtin_ctzll(hits) :
+                                 63 - __builtin_clzll(hits));
+                        *blocked = !((open[k] >> t) & 1);
+                        return k * 64 + t;
+                }
+        }
+
+        *blocked = true;
+        return d > 0 ? words * 64 : -1;
+}
+
+/* Jump along a row. Returns the x of the jump point or -1. */
+static int jps_jump_x(jps_t * jps, int level, int x, int y, int dx)
+{
+        int ww = jps->words_w;
+        bool blocked;
+        int end;
+
+        end = jps_scan(jps_row(jps->open[level], ww, y),
+                       jps_row(jps->stop[level], ww, y),
+                       y > 0 ? jps_row(jps->open[level], ww, y - 1) : NULL,
+                       (y + 1 < area_h(jps->area) ?
+                        jps_row(jps->open[level], ww, y + 1) : NULL),
+                       ww, x, dx, &blocked);
+        return blocked ? -1 : end;
+}
+
+/* Jump along a column, stopping wherever a jump along a row would find
+ * something. Returns the y of the jump point or -1. */
+static int jps_jump_y(jps_t * jps, int level, int x, int y, int dy)
+{
+        int wh = jps->words_h;
+        bool blocked;
+        int end;
+
+        end = jps_scan(jps_row(jps->open_t[level], wh, x),
+                       jps_row(jps->stop_t[level], wh, x), NULL, NULL, wh, y,
+                       dy, &blocked);
+        for (int t = y + dy; t != end; t += dy) {
+                if (jps_jump_x(jps, level, x, t, 1) >= 0 ||
+                    jps_jump_x(jps, level, x, t, -1) >= 0) {
+                        return t;
+                }
+        }
+        return blocked ? -1 : end;
+}
+
+/* Open a node and remember the direction of the jump if it took. */
+static void jps_push(jps_t * jps, const point_t loc, int g, int parent,
+                     int dir)
+{
+        int node = move_node(jps->area, loc);
+
+        path_push(&jps->pf, loc, g, parent);
+        if (jps->pf.parent[node] == parent && jps->pf.g[node] == g) {
+                jps->dirs[node] = dir;
+        }
+}
+
+static void jps_expand(jps_t * jps, int node)
+{
+        path_finder_t *pf = &jps->pf;
+        int g = pf->g[node], dir = jps->dirs[node];
+        bool scan[N_DIR] = { 0 };
+        point_t loc, next;
+        int level;
+
+        path_node_loc(pf, node, loc);
+        level = Z2L(loc[Z]);
+
+        /* Ordinary expansion off the simple tiles and at gates. */
+        if (loc[Z] != L2Z(level) ||
+            !jps_get(jps->open[level], jps->words_w, loc[Y], loc[X]) ||
+            jps_get(jps->stop[level], jps->words_w, loc[Y], loc[X])) {
+                for (int d = 0; d < N_DIR; d++) {
+                        if (move_step(jps->area, loc, move_directions[d],
+                                      next)) {
+                                jps_push(jps, next, g + 1, node, JPS_ANY);
+                        }
+                }
+                return;
+        }
+
+        /* Paths turn from rows onto columns only where a wall forces them,
+         * but may turn from columns onto rows anywhere. */
+        if (dir == JPS_ANY || dir == DIR_YUP || dir == DIR_YDOWN) {
+                scan[DIR_XLEFT] = scan[DIR_XRIGHT] = true;
+                scan[DIR_YUP] = dir != DIR_YDOWN;
+                scan[DIR_YDOWN] = dir != DIR_YUP;
+        } else {
+                int back = loc[X] - move_directions[dir][X];
+                scan[dir] = true;
+                for (int d = DIR_YUP; d <= DIR_YDOWN; d++) {
+                        int y = loc[Y] + move_directions[d][Y];
+                        scan[d] = (y >= 0 && y < area_h(jps->area) &&
+                                   jps_get(jps->open[level], jps->words_w, y,
+                                           loc[X]) &&
+                                   !jps_get(jps->open[level], jps->words_w, y,
+                                            back));
+                }
+        }
+
+        for (int d = DIR_XLEFT; d <= DIR_YDOWN; d++) {
+                const int *step = move_directions[d];
+                int end;
+
+                if (!scan[d]) {
+                        continue;
+                }
+                point_copy(next, loc);
+                if (step[X]) {
+                        if ((end = jps_jump_x(jps, level, loc[X], loc[Y],
+                                              step[X])) < 0) {
+                                continue;
+                        }
+                        next[X] = end;
+                } else {
+                        if ((end = jps_jump_y(jps, level, loc[X], loc[Y],
+                                              step[Y])) < 0) {
+                                continue;
+                        }
+                        next[Y] = end;
+                }
+                jps_push(jps, next, g + abs(next[X] - loc[X]) +
+                         abs(next[Y] - loc[Y]), node, d);
+        }
+}
+
+/* Store the path to a node, filling in the tiles each jump crossed. */
+static int jps_extract(jps_t * jps, int node, point_t * path, int max_path)
+{
+        path_finder_t *pf = &jps->pf;
+        int len = pf->g[node] + 1, i = len - 1;
+
+        for (int n = node; n >= 0; n = pf->parent[n]) {
+                int parent = pf->parent[n];
+                int steps = parent >= 0 ? pf->g[n] - pf->g[parent] : 1;
+                point_t loc, from, unit = { 0, 0, 0 };
+
+                path_node_loc(pf, n, loc);
+                if (steps > 1) {
+                        path_node_loc(pf, parent, from);
+                        unit[X] = (from[X] > loc[X]) - (from[X] < loc[X]);
+                        unit[Y] = (from[Y] > loc[Y]) - (from[Y] < loc[Y]);
+                }
+                for (int k = 0; k < steps; k++, i--) {
+                        if (i < max_path) {
+                                path[i][X] = loc[X] + k * unit[X];
+                                path[i][Y] = loc[Y] + k * unit[Y];
+                                path[i][Z] = loc[Z];
+                        }
+                }
+        }
+
+        return len;
+}
+
+int jps_find(jps_t * jps, const point_t from, const point_t to,
+             point_t * path, int max_path)
+{
+        path_finder_t *pf = &jps->pf;
+        int goal = move_node(jps->area, to), level = Z2L(to[Z]);
+        bool was_stop, simple;
+        int node, len = -1;
+
+        /* Make the goal a gate so jumps stop there. */
+        simple = (area_has_level(jps->area, level) && to[Z] == L2Z(level) &&
+                  jps_get(jps->open[level], jps->words_w, to[Y], to[X]));
+        was_stop = simple && jps_get(jps->stop[level], jps->words_w, to[Y],
+                                     to[X]);
+        if (simple) {
+                jps_set(jps, jps->stop, jps->stop_t, level, to[X], to[Y],
+                        true);
+        }
+
+        path_begin(pf, to);
+        jps_push(jps, from, 0, -1, JPS_ANY);
+        while ((node = path_pop(pf)) >= 0) {
+                if (node == goal) {
+                        len = jps_extract(jps, node, path, max_path);
+                        break;
+                }
+                pf->expanded++;
+                jps_expand(jps, node);
+        }
+
+        if (simple && !was_stop) {
+                jps_set(jps, jps->stop, jps->stop_t, level, to[X], to[Y],
+                        false);
+        }
+
+        return len;
+}
@@ -0,0 +1,54 @@
+/**
+ * Jump point search over all the levels of an area.
+ *
+ * JPS is for the open, flat parts of a level. A tile is simple if it is
+ * passable, flat, and the only steps out of it stay on its level; bitplanes
+ * of the simple tiles let the search jump across them a 64-bit word at a
+ * time, turning only where a wall forces it to. Everything else, stairs and
+ * holes and the tiles under and over other floors, is left to the ordinary
+ * `move_step` expansion that A* does. A simple tile next to something else is
+ * a gate: jumps stop there and it is expanded the ordinary way too.
+ *
+ * Paths are shortest paths like `path_find`'s. The planes follow changes to
+ * the area until `jps_deinit`.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef jps_h
+#define jps_h
+
+#include <stdint.h>
+
+#include "map.h"
+#include "path.h"
+#include "point.h"
+
+typedef struct {
+        area_t *area;
+        int words_w;            /* 64-bit words per row */
+        int words_h;            /* 64-bit words per column */
+
+        /* Per-level bitplanes, by rows and transposed by columns. */
+        uint64_t *open[N_MAPS];         /* simple tiles */
+        uint64_t *stop[N_MAPS];         /* gates */
+        uint64_t *open_t[N_MAPS];
+        uint64_t *stop_t[N_MAPS];
+
+        int8_t *dirs;           /* per node, the direction of its jump */
+        path_finder_t pf;
+} jps_t;
+
+/**
+ * Build/free the bitplanes for the area.
+ */
+int jps_init(jps_t * jps, area_t * area);
+void jps_deinit(jps_t * jps);
+
+/**
+ * Find a shortest path like `path_find` does. `jps->pf.expanded` has the
+ * number of nodes expanded.
+ */
+int jps_find(jps_t * jps, const point_t from, const point_t to,
+             point_t * path, int max_path);
+
+#endif
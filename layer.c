@@ -0,0 +1,270 @@
+/**
+ * Cached renderings of the static parts of each level.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "layer.h"
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+/* Edits show through the holes in the levels above them, which decide what
+ * gets skipped below, so they dirty their own level and the ones under it. */
+static void layer_on_change(void *data, int level, int x, int y, pixel_t old,
+                            pixel_t pixel)
+{
+        layer_cache_t *cache = data;
+
+        for (int l = 0; l <= level; l++) {
+                for (int r = 0; r < N_ROTATIONS; r++) {
+                        layer_t *layer = &cache->layers[l][r];
+                        if (!layer_is_dirty(layer)) {
+                                layer->x0 = x;
+                                layer->y0 = y;
+                                layer->x1 = x + 1;
+                                layer->y1 = y + 1;
+                        } else {
+                                layer->x0 = min(layer->x0, x);
+                                layer->y0 = min(layer->y0, y);
+                                layer->x1 = max(layer->x1, x + 1);
+                                layer->y1 = max(layer->y1, y + 1);
+                        }
+                }
+        }
+}
+
+int layer_cache_init(layer_cache_t * cache, area_t * area,
+                     SDL_Renderer * renderer, SDL_Texture * texture,
+                     draw_state_t * state, int w, int h, int n_tiles,
+                     int screen_w, int screen_h)
+{
+        SDL_RendererInfo info;
+
+        memset(cache, 0, sizeof (*cache));
+
+        if (SDL_GetRendererInfo(renderer, &info) ||
+            !(info.flags & SDL_RENDERER_TARGETTEXTURE)) {
+                return -1;
+        }
+
+        cache->renderer = renderer;
+        cache->w = w;
+        cache->h = h;
+        cache->n_tiles = n_tiles;
+
+        /* Layers are drawn with ordinary blending onto clear pixels, which
+         * leaves their colors multiplied by alpha already. */
+        cache->blend = SDL_ComposeCustomBlendMode(SDL_BLENDFACTOR_ONE,
+                                                  SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+                                                  SDL_BLENDOPERATION_ADD,
+                                                  SDL_BLENDFACTOR_ONE,
+                                                  SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+                                                  SDL_BLENDOPERATION_ADD);
+
+        if (cells_init(&cache->cells, screen_w, screen_h) ||
+            draw_list_init(&cache->quads, NULL, state) ||
+            draw_list_init(&cache->clipped, texture, state)) {
+                layer_cache_deinit(cache);
+                return ERROR_ALLOC;
+        }
+
+        for (int l = 0; l < N_MAPS; l++) {
+                for (int r = 0; r < N_ROTATIONS; r++) {
+                        if (!(cache->layers[l][r].rects =
+                              calloc(n_tiles, sizeof (SDL_Rect)))) {
+                                layer_cache_deinit(cache);
+                                return ERROR_ALLOC;
+                        }
+                }
+        }
+
+        if (!area_listen(area, layer_on_change, cache)) {
+                layer_cache_deinit(cache);
+                return ERROR_ALLOC;
+        }
+        cache->area = area;
+
+        return 0;
+}
+
+void layer_cache_deinit(layer_cache_t * cache)
+{
+        if (cache->area) {
+                area_unlisten(cache->area, layer_on_change, cache);
+        }
+        for (int l = 0; l < N_MAPS; l++) {
+                for (int r = 0; r < N_ROTATIONS; r++) {
+                        layer_t *layer = &cache->layers[l][r];
+                        if (layer->texture) {
+                                if (cache->quads.state) {
+                                        draw_state_forget(cache->quads.state,
+                                                          layer->texture);
+                                }
+                                SDL_DestroyTexture(layer->texture);
+                        }
+                        free(layer->rects);
+                }
+        }
+        cells_deinit(&cache->cells);
+        draw_list_deinit(&cache->quads);
+        draw_list_deinit(&cache->clipped);
+        memset(cache, 0, sizeof (*cache));
+}
+
+void layer_cache_reset(layer_cache_t * cache)
+{
+        for (int l = 0; l < N_MAPS; l++) {
+                for (int r = 0; r < N_ROTATIONS; r++) {
+                        cache->layers[l][r].valid = false;
+                }
+        }
+}
+
+void layer_cache_lost(layer_cache_t * cache, SDL_Texture * texture)
+{
+        for (int l = 0; l < N_MAPS; l++) {
+                for (int r = 0; r < N_ROTATIONS; r++) {
+                        layer_t *layer = &cache->layers[l][r];
+                        if (layer->texture) {
+                                if (cache->quads.state) {
+                                        draw_state_forget(cache->quads.state,
+                                                          layer->texture);
+                                }
+                                SDL_DestroyTexture(layer->texture);
+                                layer->texture = NULL;
+                        }
+                        layer->valid = false;
+                }
+        }
+        draw_list_set_texture(&cache->clipped, texture);
+}
+
+layer_t *layer_get(layer_cache_t * cache, int level, rotation_t rotation)
+{
+        layer_t *layer = &cache->layers[level][rotation];
+
+        if (!layer->texture) {
+                if (!(layer->texture = SDL_CreateTexture(cache->renderer,
+                                                         SDL_PIXELFORMAT_ARGB8888,
+                                                         SDL_TEXTUREACCESS_TARGET,
+                                                         cache->w,
+                                                         cache->h))) {
+                        return NULL;
+                }
+                if (SDL_SetTextureBlendMode(layer->texture, cache->blend)) {
+                        SDL_SetTextureBlendMode(layer->texture,
+                                                SDL_BLENDMODE_BLEND);
+                }
+                layer->valid = false;
+        }
+
+        return layer;
+}
+
+void layer_draw(layer_cache_t * cache, layer_t * layer, draw_list_t * draws,
+                const SDL_Rect * clip)
+{
+        SDL_Renderer *renderer = cache->renderer;
+
+        SDL_SetRenderTarget(renderer, layer->texture);
+        SDL_RenderSetClipRect(renderer, clip);
+
+        /* Clear without blending so the pixels become transparent. */
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+        SDL_RenderFillRect(renderer, clip);
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+
+        draw_list_geometry(draws, renderer);
+
+        SDL_RenderSetClipRect(renderer, NULL);
+        SDL_SetRenderTarget(renderer, NULL);
+
+        if (clip) {
+                cache->patches++;
+        } else {
+                cache->builds++;
+        }
+}
+
+void layer_cells_clear(layer_cache_t * cache)
+{
+        cells_clear(&cache->cells);
+}
+
+void layer_cells_mark(layer_cache_t * cache, const SDL_Rect * rect)
+{
+        cells_mark(&cache->cells, rect);
+}
+
+/* Add a quad from the layer for a run of unmarked cells, leaving out
+ * whatever is off the layer. */
+static void layer_add_run(layer_cache_t * cache, int row, int c0, int c1,
+                          int dx, int dy)
+{
+        SDL_Rect bounds = { -dx, -dy, cache->w, cache->h }, dst, src;
+
+        cells_run_rect(row, c0, c1, &dst);
+        if (!SDL_IntersectRect(&dst, &bounds, &dst)) {
+                return;
+        }
+        src = dst;
+        src.x += dx;
+        src.y += dy;
+        draw_list_add(&cache->quads, &src, &dst, 255, 255, 255, 255);
+}
+
+int layer_composite(layer_cache_t * cache, layer_t * layer, int dx, int dy,
+                    draw_list_t * draws)
+{
+        cells_t *cells = &cache->cells;
+        int calls;
+
+        /* Whole runs of unmarked cells from the layer. */
+        draw_list_clear(&cache->quads);
+        draw_list_set_texture(&cache->quads, layer->texture);
+        for (int r = 0; r < cells->h; r++) {
+                for (int c = 0; c < cells->w;) {
+                        int end = cells_run_end(cells, r, c, cells->w - 1);
+                        if (!cells_at(cells, c, r)) {
+                                layer_add_run(cache, r, c, end, dx, dy);
+                                cache->clean_cells += end - c;
+                        } else {
+                                cache->marked_cells += end - c;
+                        }
+                        c = end;
+                }
+        }
+
+        /* The frame's draws, cut to the runs of marked cells they cross. */
+        draw_list_clear(&cache->clipped);
+        for (int i = 0; i < draws->n_draws; i++) {
+                draw_t *draw = &draws->draws[i];
+                cells_runs_t runs;
+                SDL_Rect run;
+                draw_t part;
+
+                if (!cells_runs_begin(&runs, cells, &draw->dst)) {
+                        continue;
+                }
+                while (cells_runs_next(&runs, &run)) {
+                        if (draw_clip(draw, &run, &part)) {
+                                draw_list_add(&cache->clipped, &part.src,
+                                              &part.dst, part.color.r,
+                                              part.color.g, part.color.b,
+                                              part.color.a);
+                        }
+                }
+        }
+
+        /* They don't overlap, so the order doesn't matter. */
+        calls = draw_list_geometry(&cache->quads, cache->renderer);
+        calls += draw_list_geometry(&cache->clipped, cache->renderer);
+
+        return calls;
+}
@@ -0,0 +1,125 @@
+/**
+ * Cached renderings of the static parts of each level.
+ *
+ * A layer is a render-target texture holding one level as it looks with
+ * nothing dynamic on it: no cursor, fog, cutaways or transparency. There is
+ * one per level and rotation, drawn around an anchor location so that it
+ * covers the view plus a margin, and it stays good while the cursor wanders
+ * within the margin. Edits to the area mark the part of each layer they
+ * touch, which gets drawn again before the layer is next used.
+ *
+ * A frame is composited a screen cell at a time. Cells that only show tiles
+ * which look the same as in the layer come straight from it; the others are
+ * marked and get the frame's own draws, clipped to them. The two never
+ * overlap, so the result is exactly what drawing every tile would give.
+ *
+ * Knowing where tiles go on screen is up to the caller; this only keeps the
+ * textures, the bookkeeping and the cells.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef layer_h
+#define layer_h
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "cells.h"
+#include "draw.h"
+#include "map.h"
+#include "point.h"
+
+typedef struct {
+        SDL_Texture *texture;   /* created on first use */
+        bool valid;
+        point_t anchor;         /* cursor it was drawn around */
+        int cursor_level;       /* roofs are skipped below this level */
+
+        /* Where each tile of the window was drawn, in layer pixels, or
+         * empty if nothing was. */
+        SDL_Rect *rects;
+
+        /* Map area changed since it was drawn; empty if x0 >= x1. */
+        int x0, y0, x1, y1;
+} layer_t;
+
+typedef struct {
+        area_t *area;
+        SDL_Renderer *renderer;
+        SDL_BlendMode blend;    /* for compositing layers */
+        int w, h;               /* layer texture size */
+        int n_tiles;            /* per layer window */
+        layer_t layers[N_MAPS][N_ROTATIONS];
+
+        /* The screen cells of the level being composited, marked where the
+         * tiles are drawn instead of the layer. */
+        cells_t cells;
+
+        draw_list_t quads;      /* from the layer */
+        draw_list_t clipped;    /* frame draws in the marked cells */
+
+        /* Statistics. */
+        int builds, patches;
+        Uint64 clean_cells, marked_cells;
+} layer_cache_t;
+
+/**
+ * Set up/tear down a cache of `w` by `h` pixel layers, each covering a window
+ * of `n_tiles` tiles, for a `screen_w` by `screen_h` screen. Frame draws come
+ * from `texture`, and texture mods are tracked with `state`, which may be
+ * NULL. Returns -1 if the renderer can't draw to textures.
+ */
+int layer_cache_init(layer_cache_t * cache, area_t * area,
+                     SDL_Renderer * renderer, SDL_Texture * texture,
+                     draw_state_t * state, int w, int h, int n_tiles,
+                     int screen_w, int screen_h);
+void layer_cache_deinit(layer_cache_t * cache);
+
+/**
+ * Forget the contents of every layer, like after the renderer lost them.
+ */
+void layer_cache_reset(layer_cache_t * cache);
+
+/**
+ * Drop the layer textures, like after the renderer lost every texture, and
+ * take frame draws from `texture` instead. The layers are made again when
+ * next used.
+ */
+void layer_cache_lost(layer_cache_t * cache, SDL_Texture * texture);
+
+/**
+ * Get the layer for a level and rotation, creating its texture if needed.
+ * Returns NULL if that fails.
+ */
+layer_t *layer_get(layer_cache_t * cache, int level, rotation_t rotation);
+
+#define layer_is_dirty(l) ((l)->x0 < (l)->x1)
+#define layer_clean(l) ((l)->x0 = (l)->x1 = 0)
+
+/**
+ * Draw a list into part of the layer, or all of it if `clip` is NULL,
+ * after clearing that part.
+ */
+void layer_draw(layer_cache_t * cache, layer_t * layer, draw_list_t * draws,
+                const SDL_Rect * clip);
+
+/**
+ * Start compositing a level with every cell coming from the layer.
+ */
+void layer_cells_clear(layer_cache_t * cache);
+
+/**
+ * Mark the cells a screen rect touches.
+ */
+void layer_cells_mark(layer_cache_t * cache, const SDL_Rect * rect);
+
+/**
+ * Draw the level: the unmarked cells from the layer, whose pixels are offset
+ * from the screen's by (dx, dy), and the marked ones from `draws`. Returns
+ * the number of SDL calls made.
+ */
+int layer_composite(layer_cache_t * cache, layer_t * layer, int dx, int dy,
+                    draw_list_t * draws);
+
+#endif
@@ -6,6 +6,7 @@
  * Copyright (c) 2019 Gordon McNutt
  */
 
+#include "error.h"
 #include "map.h"
 #include <SDL2/SDL_image.h>
 
@@ -29,6 +30,83 @@ bool area_add(area_t * ms, map_t * map)
         return true;
 }
 
+int area_compress(area_t * ms)
+{
+        chunk_store_t *store;
+        int res;
+
+        if (ms->store) {
+                return 0;
+        }
+
+        if (!(store = malloc(sizeof (*store)))) {
+                return ERROR_ALLOC;
+        }
+
+        if ((res = chunk_store_init(store, ms->w, ms->h, ms->n_maps))) {
+                free(store);
+                return res;
+        }
+
+        for (int i = 0; i < ms->n_maps; i++) {
+                map_t *map = ms->maps[i];
+                for (int y = 0; y < ms->h; y++) {
+                        for (int x = 0; x < ms->w; x++) {
+                                pixel_t pixel = map_get_pixel(map, x, y);
+                                if (pixel) {
+                                        chunk_store_set(store, i, x, y, pixel);
+                                }
+                        }
+                }
+                map_free(map);
+                ms->maps[i] = NULL;
+        }
+        chunk_store_flush(store);
+
+        ms->store = store;
+
+        return 0;
+}
+
+void area_deinit(area_t * ms)
+{
+        for (int i = 0; i < N_MAPS; i++) {
+                if (ms->maps[i]) {
+                        map_free(ms->maps[i]);
+                        ms->maps[i] = NULL;
+                }
+        }
+        if (ms->store) {
+                chunk_store_deinit(ms->store);
+                free(ms->store);
+                ms->store = NULL;
+        }
+}
+
+bool area_listen(area_t * ms, area_listener_fn fn, void *data)
+{
+        if (ms->n_listeners >= N_AREA_LISTENERS) {
+                return false;
+        }
+        ms->listeners[ms->n_listeners].fn = fn;
+        ms->listeners[ms->n_listeners].data = data;
+        ms->n_listeners++;
+        return true;
+}
+
+void area_unlisten(area_t * ms, area_listener_fn fn, void *data)
+{
+        for (int i = 0; i < ms->n_listeners; i++) {
+                if (ms->listeners[i].fn == fn && ms->listeners[i].data == data) {
+                        ms->n_listeners--;
+                        memmove(&ms->listeners[i], &ms->listeners[i + 1],
+                                (ms->n_listeners - i) *
+                                sizeof (area_listener_t));
+                        return;
+                }
+        }
+}
+
 map_t *map_from_image(const char *filename)
 {
         SDL_Surface *surface;
@@ -56,3 +134,18 @@ map_t *map_from_image(const char *filename)
 
         return surface;
 }
+
+map_t *map_create(int w, int h)
+{
+        SDL_Surface *surface;
+
+        if (!(surface = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32,
+                                                       SDL_PIXELFORMAT_RGBA8888)))
+        {
+                printf("%s:SDL_CreateRGBSurfaceWithFormat:%s\n", __FUNCTION__,
+                       SDL_GetError());
+                return NULL;
+        }
+
+        return surface;
+}
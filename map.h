@@ -12,6 +12,8 @@
 #include <SDL2/SDL.h>
 #include <stdbool.h>
 
+#include "chunk.h"
+
 typedef uint32_t pixel_t;
 typedef SDL_Surface map_t;
 
@@ -67,14 +69,33 @@ enum {
         N_MAPS
 };
 
+#define N_AREA_LISTENERS 8
+
+/**
+ * Called after a pixel of the area changes.
+ */
+typedef void (*area_listener_fn) (void *data, int level, int x, int y,
+                                  pixel_t old, pixel_t pixel);
+
+typedef struct {
+        area_listener_fn fn;
+        void *data;
+} area_listener_t;
+
 typedef struct {
         map_t *maps[N_MAPS];
         int n_maps;
         int w, h;
+        chunk_store_t *store;   /* compressed pixels, or NULL */
+        area_listener_t listeners[N_AREA_LISTENERS];
+        int n_listeners;
+        uint32_t version;       /* bumped on every change */
 } area_t;
 
 #define area_w(ms) ((ms)->w)
 #define area_h(ms) ((ms)->h)
+#define area_has_level(ms, l) ((l) >= 0 && (l) < (ms)->n_maps)
+#define area_contains(ms, x, y) (((x) >= 0 && (x) < area_w(ms)) && ((y) >= 0 && (y) < area_h(ms)))
 
 #define map_opaque_at(m, x, y) (map_get_pixel((m), (x), (y)) & PIXEL_MASK_OPAQUE)
 #define map_contains(m, x, y) (((x) >= 0 && (x) < map_w(m)) && ((y) >= 0 && (y) < map_h(m)))
@@ -96,6 +117,24 @@ map_t *area_get_map_at_level(area_t * ms, int i);
  */
 bool area_add(area_t * ms, map_t * map);
 
+/**
+ * Move the pixels of all the maps into a compressed chunk store and free the
+ * maps. After this the maps are NULL and pixels must be accessed through
+ * `area_get_pixel` and `area_set_pixel`.
+ */
+int area_compress(area_t * ms);
+
+/**
+ * Free the maps (or the chunk store) of the area.
+ */
+void area_deinit(area_t * ms);
+
+/**
+ * Register/unregister a function to be called when a pixel changes.
+ */
+bool area_listen(area_t * ms, area_listener_fn fn, void *data);
+void area_unlisten(area_t * ms, area_listener_fn fn, void *data);
+
 /**
  * Get the pixel at the given map location.
  */
@@ -111,6 +150,52 @@ static inline pixel_t map_get_pixel(map_t * map, size_t x, size_t y)
         return *pixelptr;
 }
 
+/**
+ * Set the pixel at the given map location.
+ */
+static inline void map_set_pixel(map_t * map, size_t x, size_t y, pixel_t pixel)
+{
+        size_t offset = (y * map->pitch + x * sizeof (pixel_t));
+        uint8_t *byteptr = (uint8_t *) map->pixels;
+        byteptr += offset;
+        *((uint32_t *) byteptr) = pixel;
+}
+
+/**
+ * Get the pixel at the given level and location of the area. The level and
+ * location must be valid.
+ */
+static inline pixel_t area_get_pixel(area_t * ms, int level, int x, int y)
+{
+        if (ms->store) {
+                return chunk_store_get(ms->store, level, x, y);
+        }
+        return map_get_pixel(ms->maps[level], x, y);
+}
+
+/**
+ * Set the pixel at the given level and location of the area and notify the
+ * listeners.
+ */
+static inline void area_set_pixel(area_t * ms, int level, int x, int y,
+                                  pixel_t pixel)
+{
+        pixel_t old = area_get_pixel(ms, level, x, y);
+        if (old == pixel) {
+                return;
+        }
+        if (ms->store) {
+                chunk_store_set(ms->store, level, x, y, pixel);
+        } else {
+                map_set_pixel(ms->maps[level], x, y, pixel);
+        }
+        ms->version++;
+        for (int i = 0; i < ms->n_listeners; i++) {
+                ms->listeners[i].fn(ms->listeners[i].data, level, x, y, old,
+                                    pixel);
+        }
+}
+
 static inline bool map_passable_at_xy(map_t * map, int x, int y)
 {
         pixel_t pix = map_get_pixel(map, x, y);
@@ -124,4 +209,11 @@ static inline bool map_passable_at_xy(map_t * map, int x, int y)
  */
 map_t *map_from_image(const char *filename);
 
+/**
+ * Create an empty map (all pixels zero).
+ *
+ * Use `map_free` when done with it.
+ */
+map_t *map_create(int w, int h);
+
 #endif
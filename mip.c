@@ -0,0 +1,208 @@
+/**
+ * A pyramid of ever smaller pictures of the area seen from above.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "mip.h"
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+#define mip_is_dirty(m) ((m)->x0 < (m)->x1)
+
+/* Any edit can change what shows from above. */
+static void mip_on_change(void *data, int level, int x, int y, pixel_t old,
+                          pixel_t pixel)
+{
+        mip_t *mip = data;
+
+        if (!mip_is_dirty(mip)) {
+                mip->x0 = x;
+                mip->y0 = y;
+                mip->x1 = x + 1;
+                mip->y1 = y + 1;
+        } else {
+                mip->x0 = min(mip->x0, x);
+                mip->y0 = min(mip->y0, y);
+                mip->x1 = max(mip->x1, x + 1);
+                mip->y1 = max(mip->y1, y + 1);
+        }
+}
+
+/* Average the texels under one of a level. Colors are averaged over the ones
+ * that show, and alpha over all of them, so edges fade out. */
+static Uint32 mip_average(const mip_t * mip, int level, int x, int y)
+{
+        const Uint32 *below = mip->texels[level - 1];
+        int w = mip->w[level - 1], h = mip->h[level - 1];
+        int r = 0, g = 0, b = 0, a = 0, n = 0, shown = 0;
+
+        for (int j = 2 * y; j < min(2 * y + 2, h); j++) {
+                for (int i = 2 * x; i < min(2 * x + 2, w); i++) {
+                        Uint32 texel = below[j * w + i];
+                        n++;
+                        if (!(texel >> 24)) {
+                                continue;
+                        }
+                        a += texel >> 24;
+                        r += texel >> 16 & 0xff;
+                        g += texel >> 8 & 0xff;
+                        b += texel & 0xff;
+                        shown++;
+                }
+        }
+
+        if (!shown) {
+                return 0;
+        }
+        return ((Uint32) (a / n) << 24 | (r / shown) << 16 |
+                (g / shown) << 8 | (b / shown));
+}
+
+/* Work out the texels of every level over the map rect [x0, x1) by
+ * [y0, y1). */
+static void mip_fill(mip_t * mip, int x0, int y0, int x1, int y1)
+{
+        for (int y = y0; y < y1; y++) {
+                Uint32 *row = &mip->texels[0][y * mip->w[0]];
+                for (int x = x0; x < x1; x++) {
+                        row[x] = mip->color(mip->data, mip->area, x, y);
+                }
+        }
+
+        for (int l = 1; l < mip->n_levels; l++) {
+                x0 >>= 1;
+                y0 >>= 1;
+                x1 = ((x1 - 1) >> 1) + 1;
+                y1 = ((y1 - 1) >> 1) + 1;
+                for (int y = y0; y < y1; y++) {
+                        Uint32 *row = &mip->texels[l][y * mip->w[l]];
+                        for (int x = x0; x < x1; x++) {
+                                row[x] = mip_average(mip, l, x, y);
+                        }
+                }
+        }
+}
+
+/* Color the part edited since last time, and copy it to the textures that
+ * are already up. */
+static void mip_update(mip_t * mip)
+{
+        int x0 = mip->x0, y0 = mip->y0, x1 = mip->x1, y1 = mip->y1;
+
+        if (!mip_is_dirty(mip)) {
+                return;
+        }
+        mip->x0 = mip->x1 = 0;
+        mip_fill(mip, x0, y0, x1, y1);
+
+        for (int l = 0; l < mip->n_levels; l++) {
+                SDL_Rect rect = { x0, y0, x1 - x0, y1 - y0 };
+                if (mip->uploaded[l]) {
+                        SDL_UpdateTexture(mip->textures[l], &rect,
+                                          &mip->texels[l][y0 * mip->w[l] +
+                                                          x0],
+                                          mip->w[l] * sizeof (Uint32));
+                }
+                x0 >>= 1;
+                y0 >>= 1;
+                x1 = ((x1 - 1) >> 1) + 1;
+                y1 = ((y1 - 1) >> 1) + 1;
+        }
+}
+
+int mip_init(mip_t * mip, area_t * area, SDL_Renderer * renderer,
+             mip_color_fn color, void *data)
+{
+        int w = area_w(area), h = area_h(area);
+
+        memset(mip, 0, sizeof (*mip));
+        mip->renderer = renderer;
+        mip->color = color;
+        mip->data = data;
+
+        /* Halve until one texel is left, or as far as there are levels. */
+        while (mip->n_levels < MIP_LEVELS) {
+                int l = mip->n_levels++;
+                mip->w[l] = w;
+                mip->h[l] = h;
+                if (!(mip->texels[l] = malloc(w * h * sizeof (Uint32)))) {
+                        mip_deinit(mip);
+                        return ERROR_ALLOC;
+                }
+                if (w == 1 && h == 1) {
+                        break;
+                }
+                w = (w + 1) / 2;
+                h = (h + 1) / 2;
+        }
+
+        if (!area_listen(area, mip_on_change, mip)) {
+                mip_deinit(mip);
+                return ERROR_ALLOC;
+        }
+        mip->area = area;
+
+        mip_fill(mip, 0, 0, area_w(area), area_h(area));
+
+        return 0;
+}
+
+void mip_deinit(mip_t * mip)
+{
+        if (mip->area) {
+                area_unlisten(mip->area, mip_on_change, mip);
+        }
+        for (int l = 0; l < mip->n_levels; l++) {
+                if (mip->textures[l]) {
+                        SDL_DestroyTexture(mip->textures[l]);
+                }
+                free(mip->texels[l]);
+        }
+        memset(mip, 0, sizeof (*mip));
+}
+
+void mip_lost(mip_t * mip)
+{
+        for (int l = 0; l < mip->n_levels; l++) {
+                if (mip->textures[l]) {
+                        SDL_DestroyTexture(mip->textures[l]);
+                        mip->textures[l] = NULL;
+                }
+                mip->uploaded[l] = false;
+        }
+}
+
+SDL_Texture *mip_get(mip_t * mip, int level)
+{
+        if (level < 0 || level >= mip->n_levels) {
+                return NULL;
+        }
+
+        mip_update(mip);
+
+        if (!mip->textures[level]) {
+                if (!(mip->textures[level] =
+                      SDL_CreateTexture(mip->renderer,
+                                        SDL_PIXELFORMAT_ARGB8888,
+                                        SDL_TEXTUREACCESS_STATIC,
+                                        mip->w[level], mip->h[level]))) {
+                        return NULL;
+                }
+                SDL_SetTextureBlendMode(mip->textures[level],
+                                        SDL_BLENDMODE_BLEND);
+        }
+        if (!mip->uploaded[level]) {
+                SDL_UpdateTexture(mip->textures[level], NULL,
+                                  mip->texels[level],
+                                  mip->w[level] * sizeof (Uint32));
+                mip->uploaded[level] = true;
+        }
+
+        return mip->textures[level];
+}
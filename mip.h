@@ -0,0 +1,69 @@
+/**
+ * A pyramid of ever smaller pictures of the area seen from above.
+ *
+ * The base level has one texel per map location, colored by a function the
+ * caller gives, and each level above it is half as wide and high, every
+ * texel the average of the four under it. Far enough out a tile is only a
+ * pixel or two on the screen, so the terrain can be drawn from the level
+ * whose texels are about that size, as a few big quads instead of a model
+ * per tile.
+ *
+ * The levels are kept in memory and copied to static textures when first
+ * asked for. Edits to the area mark the part of the base they touch, which
+ * gets colored again, with the texels over it on every level, before the
+ * next texture is handed out.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef mip_h
+#define mip_h
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "map.h"
+
+#define MIP_LEVELS 12
+
+/**
+ * Get the color of a map location, in ARGB8888. Zero alpha leaves it out.
+ */
+typedef Uint32 (*mip_color_fn) (void *data, area_t * area, int x, int y);
+
+typedef struct {
+        area_t *area;
+        SDL_Renderer *renderer;
+        mip_color_fn color;
+        void *data;
+        int n_levels;
+        int w[MIP_LEVELS], h[MIP_LEVELS];
+        Uint32 *texels[MIP_LEVELS];
+        SDL_Texture *textures[MIP_LEVELS];      /* created on first use */
+        bool uploaded[MIP_LEVELS];              /* textures match texels */
+
+        /* Map area changed since colored; empty if x0 >= x1. */
+        int x0, y0, x1, y1;
+} mip_t;
+
+/**
+ * Set up/tear down a pyramid of `area` colored by `color`, for textures from
+ * `renderer`. Returns 0 or ERROR_ALLOC.
+ */
+int mip_init(mip_t * mip, area_t * area, SDL_Renderer * renderer,
+             mip_color_fn color, void *data);
+void mip_deinit(mip_t * mip);
+
+/**
+ * Drop the textures, like after the renderer lost every texture. They are
+ * made again from the levels when next asked for.
+ */
+void mip_lost(mip_t * mip);
+
+/**
+ * Get the texture of a level, with the area's latest edits. Returns NULL if
+ * there is no such level or its texture can't be made.
+ */
+SDL_Texture *mip_get(mip_t * mip, int level);
+
+#endif
@@ -4,15 +4,16 @@
  * XXX: this could be done as a preprocessing step that generates a header
  * file with static declarations of all the model data.
  */
-void model_init(model_t * model, SDL_Texture ** textures,
+void model_init(model_t * model, atlas_t * atlas,
                 const size_t * texture_indices, int tile_h)
 {
-        /* Store the textures and their sizes. */
+        /* Store where the faces are and their sizes. */
+        model->texture = atlas->texture;
         for (size_t i = 0; i < N_MODEL_FACES; i++) {
                 int texture_index = texture_indices[i];
-                model->textures[i] = textures[texture_index];
-                SDL_QueryTexture(model->textures[i], NULL, NULL,
-                                 &model->offsets[i].w, &model->offsets[i].h);
+                model->srcs[i] = atlas->rects[texture_index];
+                model->offsets[i].w = model->srcs[i].w;
+                model->offsets[i].h = model->srcs[i].h;
         }
 
         model->offsets[MODEL_FACE_RIGHT].x = model->offsets[MODEL_FACE_LEFT].w;
@@ -7,6 +7,8 @@
 
 #include <SDL2/SDL.h>
 
+#include "atlas.h"
+
 enum {
         MODEL_FACE_LEFT,
         MODEL_FACE_RIGHT,
@@ -15,8 +17,9 @@ enum {
 };
 
 typedef struct {
-        /* Textures for each face. */
-        SDL_Texture *textures[N_MODEL_FACES];
+        /* The atlas texture and where each face is in it. */
+        SDL_Texture *texture;
+        SDL_Rect srcs[N_MODEL_FACES];
 
         /* Pixel offsets for each face wrt the base tile origin. */
         SDL_Rect offsets[N_MODEL_FACES];
@@ -29,9 +32,10 @@ typedef struct {
 /**
  * Initialize a model.
  *
- * Set up the textures, offsets and tile_h fields.
+ * Set up the texture, offsets and tile_h fields. The faces are the atlas
+ * images at `texture_indices`.
  */
-void model_init(model_t * model, SDL_Texture ** textures,
+void model_init(model_t * model, atlas_t * atlas,
                 const size_t * texture_indices, int tile_h);
 
 #endif
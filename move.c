@@ -0,0 +1,108 @@
+/**
+ * Movement rules for things standing in an area.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include "move.h"
+
+const point_t move_directions[N_DIR] = {
+        {-1, 0, 0},             /* left */
+        {1, 0, 0},              /* right */
+        {0, -1, 0},             /* up */
+        {0, 1, 0},              /* down */
+        {0, 0, 1},              /* vert up */
+        {0, 0, -1}              /* vert down */
+};
+
+bool move_step(area_t * area, const point_t from, const point_t dir,
+               point_t to)
+{
+        /* Figure out where the new point is, at least horizontally. */
+        point_copy(to, from);
+        to[X] += dir[X];
+        to[Y] += dir[Y];
+        to[Z] += L2Z(dir[Z]);   /* dir z is # levels */
+
+        /* While there is a map at this level that contains the (x, y)
+         * coordinates...  */
+        while (area_has_level(area, Z2L(to[Z])) &&
+               area_contains(area, to[X], to[Y])) {
+
+                /* Find the terrain there. */
+                pixel_t pix = area_get_pixel(area, Z2L(to[Z]), to[X], to[Y]);
+                if (!pix) {
+                        /* If there's a hole there, try the next level down... */
+                        to[Z] -= Z_PER_LEVEL;
+                } else {
+                        /* Else if it's passable */
+                        if (PIXEL_IS_IMPASSABLE(pix)) {
+                                if (!PIXEL_IS_STAIRS(pix)) {
+                                        return false;
+                                }
+                                int lvl_z = L2Z(Z2L(to[Z]));
+                                int new_z = (PIXEL_HEIGHT(pix) + lvl_z);
+                                if ((new_z - from[Z]) > 1) {
+                                        return false;   /* Can't climb more than 1 step at a time */
+                                }
+                                if (!area_has_level(area, Z2L(new_z))) {
+                                        return false;
+                                }
+                                to[Z] = new_z;
+                                return true;
+                        }
+                        to[Z] = L2Z(Z2L(to[Z]));
+                        return true;
+                }
+        }
+        return false;
+}
+
+bool move_stand(area_t * area, int x, int y, int level, point_t loc)
+{
+        pixel_t pix = area_get_pixel(area, level, x, y);
+
+        loc[X] = x;
+        loc[Y] = y;
+        loc[Z] = L2Z(level);
+
+        if (!pix) {
+                return false;
+        }
+        if (PIXEL_IS_IMPASSABLE(pix)) {
+                if (!PIXEL_IS_STAIRS(pix)) {
+                        return false;
+                }
+                loc[Z] += PIXEL_HEIGHT(pix);
+                return area_has_level(area, Z2L(loc[Z]));
+        }
+        return true;
+}
+
+int move_preds(area_t * area, const point_t to, point_t * preds, int *dirs)
+{
+        int n = 0;
+
+        /* Every location is where something stands on some level, so try
+         * standing on each level of the column a step back. */
+        for (int dir = 0; dir < N_DIR; dir++) {
+                const int *d = move_directions[dir];
+                int x = to[X] - d[X], y = to[Y] - d[Y];
+
+                if (!area_contains(area, x, y)) {
+                        continue;
+                }
+                for (int level = 0; level < area->n_maps; level++) {
+                        point_t from, next;
+                        if (move_stand(area, x, y, level, from) &&
+                            move_step(area, from, d, next) &&
+                            point_equal(next, to)) {
+                                point_copy(preds[n], from);
+                                dirs[n] = dir;
+                                n++;
+                        }
+                }
+        }
+
+        return n;
+}
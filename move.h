@@ -0,0 +1,66 @@
+/**
+ * Movement rules for things standing in an area.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef move_h
+#define move_h
+
+#include <stdbool.h>
+
+#include "map.h"
+#include "point.h"
+
+enum {
+        DIR_XLEFT,
+        DIR_XRIGHT,
+        DIR_YUP,
+        DIR_YDOWN,
+        DIR_ZUP,
+        DIR_ZDOWN,
+        N_DIR
+};
+
+/* Unit steps for each direction. The z component is in levels. */
+extern const point_t move_directions[N_DIR];
+
+/**
+ * Take one step from `from` in direction `dir`, which must already be rotated
+ * into map coordinates (z is in levels). Falls down through holes, climbs
+ * stairs that are at most one z unit higher and stops at impassable terrain.
+ * On success `to` is the new location; on failure `to` is undefined.
+ */
+bool move_step(area_t * area, const point_t from, const point_t dir,
+               point_t to);
+
+/**
+ * Get the location of something standing on the terrain at (x, y) on the
+ * given level, which is where `move_step` would leave it. False if the
+ * terrain can't be stood on.
+ */
+bool move_stand(area_t * area, int x, int y, int level, point_t loc);
+
+/* Most locations that can step into any one location. */
+#define MOVE_MAX_PREDS (N_DIR * N_MAPS)
+
+/**
+ * Find the locations that `move_step` takes to `to`, and the direction of
+ * each of those steps. Returns how many there are, at most MOVE_MAX_PREDS.
+ */
+int move_preds(area_t * area, const point_t to, point_t * preds, int *dirs);
+
+/**
+ * Number of distinct locations a search can visit: one per tile per level.
+ */
+#define move_n_nodes(a) (area_w(a) * area_h(a) * (a)->n_maps)
+
+/**
+ * Index of the node for a location that `move_step` produced.
+ */
+static inline int move_node(area_t * area, const point_t loc)
+{
+        return ((Z2L(loc[Z]) * area_h(area) + loc[Y]) * area_w(area) +
+                loc[X]);
+}
+
+#endif
@@ -0,0 +1,135 @@
+/**
+ * Keeping frames to a steady rate, and measuring how steady they were.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pace.h"
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+/* Sleep until `deadline`, then spin the last bit. */
+static void pace_wait(pace_t * pace, Uint64 deadline)
+{
+        Uint64 now = SDL_GetPerformanceCounter();
+
+        while (now < deadline) {
+                Uint64 left = deadline - now;
+                Uint32 ms = 0;
+
+                if (left > pace->slack) {
+                        ms = (left - pace->slack) * 1000 / pace->freq;
+                }
+                if (!ms) {
+                        now = SDL_GetPerformanceCounter();
+                        continue;
+                }
+
+                Uint64 before = now, asked = ms * pace->freq / 1000;
+                SDL_Delay(ms);
+                now = SDL_GetPerformanceCounter();
+
+                /* Take on a bigger oversleep at once, and let go of it
+                 * slowly. */
+                if (now - before > asked) {
+                        Uint64 over = now - before - asked;
+                        pace->slack = max(over, pace->slack -
+                                          pace->slack / 16);
+                        pace->slack = min(pace->slack, pace->period);
+                }
+        }
+}
+
+void pace_init(pace_t * pace, int rate)
+{
+        memset(pace, 0, sizeof (*pace));
+        pace->freq = SDL_GetPerformanceFrequency();
+        if (rate > 0) {
+                pace->period = pace->freq / rate;
+        }
+        pace->slack = pace->freq / 1000;
+}
+
+void pace_idle(pace_t * pace)
+{
+        pace->deadline = 0;
+        pace->shown = 0;
+}
+
+void pace_frame(pace_t * pace)
+{
+        Uint64 now = SDL_GetPerformanceCounter();
+
+        if (pace->shown) {
+                double ms = (now - pace->shown) * 1000.0 / pace->freq;
+                int bin = ms * 1000 / PACE_BIN_US;
+
+                pace->frames++;
+                pace->sum += ms;
+                pace->sum_sq += ms * ms;
+                pace->max = max(pace->max, ms);
+                pace->bins[min(bin, PACE_BINS - 1)]++;
+                pace->busy += now - pace->woke;
+        }
+        pace->shown = now;
+
+        if (pace->period) {
+                if (!pace->deadline) {
+                        pace->deadline = now;
+                }
+                pace->deadline += pace->period;
+                if (now > pace->deadline) {
+                        pace->late++;
+                        if (now - pace->deadline >= pace->period) {
+                                pace->deadline = now;
+                        }
+                } else {
+                        pace_wait(pace, pace->deadline);
+                }
+        }
+
+        pace->woke = SDL_GetPerformanceCounter();
+        pace->waited += pace->woke - now;
+}
+
+double pace_percentile(const pace_t * pace, double percent)
+{
+        int goal = ceil(pace->frames * percent / 100.0), count = 0;
+
+        for (int i = 0; i < PACE_BINS - 1; i++) {
+                if ((count += pace->bins[i]) >= goal) {
+                        return (i + 1) * PACE_BIN_US / 1000.0;
+                }
+        }
+        return pace->max;
+}
+
+void pace_print(const pace_t * pace)
+{
+        double mean, jitter;
+
+        if (!pace->frames) {
+                return;
+        }
+        mean = pace->sum / pace->frames;
+        jitter = sqrt(max(pace->sum_sq / pace->frames - mean * mean, 0));
+
+        printf("%2.2f FPS while drawing", 1000.0 / mean);
+        if (pace->period) {
+                printf(" (target %2.2f, %d frames late)",
+                       pace->freq / pace->period, pace->late);
+        }
+        printf("\n");
+        printf("frame time msecs: p50 %.1f, p90 %.1f, p99 %.1f, max %.1f, "
+               "jitter %.2f\n", pace_percentile(pace, 50),
+               pace_percentile(pace, 90), pace_percentile(pace, 99),
+               pace->max, jitter);
+        printf("%f msecs avg drawing, %f msecs avg waiting\n",
+               pace->busy * 1000.0 / pace->freq / pace->frames,
+               pace->waited * 1000.0 / pace->freq / pace->frames);
+}
@@ -0,0 +1,72 @@
+/**
+ * Keeping frames to a steady rate, and measuring how steady they were.
+ *
+ * Frames are due at fixed steps of the high resolution counter from the
+ * first one. Waiting for the next one sleeps in whole milliseconds while
+ * that can't oversleep, learning how late SDL_Delay tends to wake, and spins
+ * for the rest. A frame that comes in late is shown right away; one late by
+ * a whole step or more gives up on the steps it missed and starts counting
+ * again from itself, instead of rushing frames out to catch up.
+ *
+ * The time from each frame to the next goes in a histogram, so percentiles
+ * come out at the end without keeping every frame. Gaps where nothing was
+ * drawn because nothing changed are left out.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef pace_h
+#define pace_h
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+/* Histogram of frame times, in bins this many microseconds wide. The last
+ * one holds everything longer. */
+#define PACE_BIN_US 100
+#define PACE_BINS 1000
+
+typedef struct {
+        double freq;            /* counter ticks per second */
+        Uint64 period;          /* ticks per frame, or 0 not to wait */
+        Uint64 slack;           /* how late SDL_Delay wakes, in ticks */
+        Uint64 deadline;        /* when the next frame is due, or 0 */
+        Uint64 shown;           /* when the last frame was, or 0 */
+        Uint64 woke;            /* when the wait after it ended */
+
+        /* Statistics. */
+        int frames;             /* with a time since the one before */
+        int late;
+        Uint64 busy, waited;    /* ticks drawing and waiting */
+        double sum, sum_sq;     /* of frame times in msecs */
+        double max;
+        int bins[PACE_BINS];
+} pace_t;
+
+/**
+ * Start pacing at `rate` frames per second, or not at all if that is zero.
+ */
+void pace_init(pace_t * pace, int rate);
+
+/**
+ * Note that nothing was drawn for a while, so the next frame starts afresh.
+ */
+void pace_idle(pace_t * pace);
+
+/**
+ * Note that a frame was just shown and wait until the next one is due.
+ */
+void pace_frame(pace_t * pace);
+
+/**
+ * Get the frame time, in msecs, that `percent` of frames took no longer
+ * than.
+ */
+double pace_percentile(const pace_t * pace, double percent);
+
+/**
+ * Print the frame rate, frame time percentiles and jitter.
+ */
+void pace_print(const pace_t * pace);
+
+#endif
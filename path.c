@@ -0,0 +1,261 @@
+/**
+ * A* pathfinding over all the levels of an area.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "move.h"
+#include "path.h"
+
+/* Order by f, breaking ties toward the deeper node. */
+static inline int heap_less(path_finder_t * pf, int a, int b)
+{
+        return (pf->f[a] < pf->f[b] ||
+                (pf->f[a] == pf->f[b] && pf->g[a] > pf->g[b]));
+}
+
+static inline void heap_set(path_finder_t * pf, int i, int node)
+{
+        pf->heap[i] = node;
+        pf->heap_pos[node] = i;
+}
+
+static void heap_up(path_finder_t * pf, int i)
+{
+        int node = pf->heap[i];
+        while (i > 0) {
+                int parent = (i - 1) / 2;
+                if (!heap_less(pf, node, pf->heap[parent])) {
+                        break;
+                }
+                heap_set(pf, i, pf->heap[parent]);
+                i = parent;
+        }
+        heap_set(pf, i, node);
+}
+
+static void heap_down(path_finder_t * pf, int i)
+{
+        int node = pf->heap[i];
+        for (;;) {
+                int child = i * 2 + 1;
+                if (child >= pf->heap_n) {
+                        break;
+                }
+                if (child + 1 < pf->heap_n &&
+                    heap_less(pf, pf->heap[child + 1], pf->heap[child])) {
+                        child++;
+                }
+                if (!heap_less(pf, pf->heap[child], node)) {
+                        break;
+                }
+                heap_set(pf, i, pf->heap[child]);
+                i = child;
+        }
+        heap_set(pf, i, node);
+}
+
+int path_init(path_finder_t * pf, area_t * area)
+{
+        int n = move_n_nodes(area);
+
+        memset(pf, 0, sizeof (*pf));
+        pf->area = area;
+        pf->n_nodes = n;
+        path_clear_bounds(pf);
+
+        if (!(pf->g = malloc(n * sizeof (int))) ||
+            !(pf->f = malloc(n * sizeof (int))) ||
+            !(pf->parent = malloc(n * sizeof (int))) ||
+            !(pf->z = malloc(n * sizeof (int))) ||
+            !(pf->seen = calloc(n, sizeof (uint32_t))) ||
+            !(pf->closed = calloc(n, sizeof (uint32_t))) ||
+            !(pf->heap = malloc(n * sizeof (int))) ||
+            !(pf->heap_pos = malloc(n * sizeof (int)))) {
+                path_deinit(pf);
+                return ERROR_ALLOC;
+        }
+
+        return 0;
+}
+
+void path_deinit(path_finder_t * pf)
+{
+        free(pf->g);
+        free(pf->f);
+        free(pf->parent);
+        free(pf->z);
+        free(pf->seen);
+        free(pf->closed);
+        free(pf->heap);
+        free(pf->heap_pos);
+        memset(pf, 0, sizeof (*pf));
+}
+
+void path_begin(path_finder_t * pf, const point_t goal)
+{
+        /* On wraparound the old stamps could look current, so clear them. */
+        if (++pf->gen == 0) {
+                memset(pf->seen, 0, pf->n_nodes * sizeof (uint32_t));
+                memset(pf->closed, 0, pf->n_nodes * sizeof (uint32_t));
+                pf->gen = 1;
+        }
+        pf->heap_n = 0;
+        pf->expanded = 0;
+        pf->use_goal = goal != NULL;
+        if (goal) {
+                point_copy(pf->goal, goal);
+        }
+}
+
+void path_set_bounds(path_finder_t * pf, int x0, int y0, int x1, int y1)
+{
+        pf->x0 = x0;
+        pf->y0 = y0;
+        pf->x1 = x1;
+        pf->y1 = y1;
+}
+
+void path_clear_bounds(path_finder_t * pf)
+{
+        path_set_bounds(pf, 0, 0, area_w(pf->area), area_h(pf->area));
+}
+
+void path_push(path_finder_t * pf, const point_t loc, int g, int parent)
+{
+        int node;
+
+        if (loc[X] < pf->x0 || loc[X] >= pf->x1 ||
+            loc[Y] < pf->y0 || loc[Y] >= pf->y1) {
+                return;
+        }
+
+        node = move_node(pf->area, loc);
+        if (pf->seen[node] != pf->gen) {
+                pf->seen[node] = pf->gen;
+                pf->g[node] = g;
+                pf->f[node] = g;
+                if (pf->use_goal) {
+                        pf->f[node] += abs(loc[X] - pf->goal[X]) +
+                            abs(loc[Y] - pf->goal[Y]);
+                }
+                pf->parent[node] = parent;
+                pf->z[node] = loc[Z];
+                pf->heap_n++;
+                heap_set(pf, pf->heap_n - 1, node);
+                heap_up(pf, pf->heap_n - 1);
+                return;
+        }
+
+        if (pf->closed[node] == pf->gen || g >= pf->g[node]) {
+                return;
+        }
+
+        pf->f[node] -= pf->g[node] - g;
+        pf->g[node] = g;
+        pf->parent[node] = parent;
+        heap_up(pf, pf->heap_pos[node]);
+}
+
+int path_pop(path_finder_t * pf)
+{
+        int node;
+
+        if (!pf->heap_n) {
+                return -1;
+        }
+
+        node = pf->heap[0];
+        pf->heap_n--;
+        if (pf->heap_n) {
+                heap_set(pf, 0, pf->heap[pf->heap_n]);
+                heap_down(pf, 0);
+        }
+        pf->closed[node] = pf->gen;
+
+        return node;
+}
+
+void path_node_loc(path_finder_t * pf, int node, point_t loc)
+{
+        int w = area_w(pf->area);
+        loc[X] = node % w;
+        loc[Y] = (node / w) % area_h(pf->area);
+        loc[Z] = pf->z[node];
+}
+
+int path_extract(path_finder_t * pf, int node, point_t * path, int max_path)
+{
+        int len = 0;
+
+        for (int i = node; i >= 0; i = pf->parent[i]) {
+                len++;
+        }
+
+        for (int i = node, j = len - 1; i >= 0; i = pf->parent[i], j--) {
+                if (j < max_path) {
+                        path_node_loc(pf, i, path[j]);
+                }
+        }
+
+        return len;
+}
+
+/* Open the neighbors of a closed node. */
+static void path_expand(path_finder_t * pf, int node)
+{
+        point_t loc, next;
+
+        pf->expanded++;
+        path_node_loc(pf, node, loc);
+        for (int dir = 0; dir < N_DIR; dir++) {
+                if (move_step(pf->area, loc, move_directions[dir], next)) {
+                        path_push(pf, next, pf->g[node] + 1, node);
+                }
+        }
+}
+
+int path_find(path_finder_t * pf, const point_t from, const point_t to,
+              point_t * path, int max_path)
+{
+        int goal = move_node(pf->area, to);
+        int node;
+
+        path_begin(pf, to);
+        path_push(pf, from, 0, -1);
+
+        while ((node = path_pop(pf)) >= 0) {
+                if (node == goal) {
+                        return path_extract(pf, node, path, max_path);
+                }
+                path_expand(pf, node);
+        }
+
+        return -1;
+}
+
+void path_flood(path_finder_t * pf, const point_t from)
+{
+        int node;
+
+        path_begin(pf, NULL);
+        path_push(pf, from, 0, -1);
+
+        while ((node = path_pop(pf)) >= 0) {
+                path_expand(pf, node);
+        }
+}
+
+int path_cost(path_finder_t * pf, const point_t loc)
+{
+        int node = move_node(pf->area, loc);
+
+        if (pf->closed[node] != pf->gen || pf->z[node] != loc[Z]) {
+                return -1;
+        }
+        return pf->g[node];
+}
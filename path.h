@@ -0,0 +1,116 @@
+/**
+ * A* pathfinding over all the levels of an area.
+ *
+ * Steps follow `move_step`, so paths fall through holes, climb stairs one z
+ * unit at a time and change levels the same way the cursor does. A node is a
+ * tile on a level; all of the per-node state is allocated once by
+ * `path_init` and reused by every search, with generation stamps standing in
+ * for clearing it between searches.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef path_h
+#define path_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "map.h"
+#include "point.h"
+
+typedef struct {
+        area_t *area;
+        int n_nodes;
+
+        /* Per-node state, valid when seen[node] == gen. */
+        int *g;                 /* cost from the start */
+        int *f;                 /* g plus the heuristic */
+        int *parent;            /* previous node, or -1 */
+        int *z;                 /* z of the location */
+        uint32_t *seen;
+        uint32_t *closed;       /* expanded when == gen */
+        uint32_t gen;
+
+        /* Open set as an indexed binary heap on f. */
+        int *heap;
+        int *heap_pos;
+        int heap_n;
+
+        point_t goal;
+        bool use_goal;          /* else the heuristic is zero */
+
+        /* Nodes outside [x0, x1) x [y0, y1) are never opened. */
+        int x0, y0, x1, y1;
+
+        /* Statistics for the last search. */
+        int expanded;
+} path_finder_t;
+
+/**
+ * Allocate/free the per-node state for searches over the area.
+ */
+int path_init(path_finder_t * pf, area_t * area);
+void path_deinit(path_finder_t * pf);
+
+/**
+ * Find a shortest path from one location to another. Both locations must be
+ * places something can stand, as produced by `move_step` or `move_stand`.
+ * Fills in up to `max_path` locations starting with `from` and ending with
+ * `to`. Returns the full length of the path, or -1 if there is none.
+ */
+int path_find(path_finder_t * pf, const point_t from, const point_t to,
+              point_t * path, int max_path);
+
+/**
+ * Limit searches to the tiles in [x0, x1) x [y0, y1) on every level, or lift
+ * the limit.
+ */
+void path_set_bounds(path_finder_t * pf, int x0, int y0, int x1, int y1);
+void path_clear_bounds(path_finder_t * pf);
+
+/**
+ * Find the cost from one location to everything reachable from it. Query the
+ * results with `path_cost` until the next search.
+ */
+void path_flood(path_finder_t * pf, const point_t from);
+
+/**
+ * Cost to a location from the start of the last `path_flood`, or -1 if it was
+ * not reached.
+ */
+int path_cost(path_finder_t * pf, const point_t loc);
+
+/*
+ * The rest of this is for other searches that share the path finder's state.
+ */
+
+/**
+ * Start a new search toward `goal`, forgetting all previous nodes. With no
+ * goal the search is a plain Dijkstra flood.
+ */
+void path_begin(path_finder_t * pf, const point_t goal);
+
+/**
+ * Open the node at `loc` with cost `g` via `parent`, or lower its cost if it
+ * is already open. Closed nodes are left alone.
+ */
+void path_push(path_finder_t * pf, const point_t loc, int g, int parent);
+
+/**
+ * Pop and close the open node with the lowest f. Returns -1 when the open set
+ * is empty.
+ */
+int path_pop(path_finder_t * pf);
+
+/**
+ * Get the location of a node seen by the current search.
+ */
+void path_node_loc(path_finder_t * pf, int node, point_t loc);
+
+/**
+ * Walk the parents back from `node` and store the path that leads to it.
+ * Returns the full length of the path.
+ */
+int path_extract(path_finder_t * pf, int node, point_t * path, int max_path);
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * What was drawn at each screen pixel.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "pick.h"
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+void pick_init(pick_t * pick, atlas_t * atlas, int w, int h)
+{
+        memset(pick, 0, sizeof (*pick));
+        pick->atlas = atlas;
+        pick->w = w;
+        pick->h = h;
+}
+
+void pick_deinit(pick_t * pick)
+{
+        free(pick->ids);
+        memset(pick, 0, sizeof (*pick));
+}
+
+int pick_clear(pick_t * pick)
+{
+        if (!pick->ids &&
+            !(pick->ids = malloc(pick->w * pick->h * sizeof (Uint32)))) {
+                return ERROR_ALLOC;
+        }
+        memset(pick->ids, 0, pick->w * pick->h * sizeof (Uint32));
+        pick->valid = false;
+        return 0;
+}
+
+void pick_draw(pick_t * pick, const draw_t * draw, Uint32 id)
+{
+        const atlas_t *atlas = pick->atlas;
+        const SDL_Rect *src = &draw->src, *dst = &draw->dst;
+        int x0 = max(dst->x, 0), x1 = min(dst->x + dst->w, pick->w);
+        int y0 = max(dst->y, 0), y1 = min(dst->y + dst->h, pick->h);
+
+        if (draw->color.a != 255 || !dst->w || !dst->h) {
+                return;
+        }
+
+        /* Nearest texel, like the renderer picks for stretched draws. */
+        for (int y = y0; y < y1; y++) {
+                int ty = src->y + (y - dst->y) * src->h / dst->h;
+                const Uint8 *alpha = &atlas->alpha[ty * atlas->w];
+                Uint32 *ids = &pick->ids[y * pick->w];
+
+                for (int x = x0; x < x1; x++) {
+                        int tx = src->x + (x - dst->x) * src->w / dst->w;
+                        if (alpha[tx]) {
+                                ids[x] = id;
+                        }
+                }
+        }
+}
@@ -0,0 +1,64 @@
+/**
+ * What was drawn at each screen pixel.
+ *
+ * The buffer holds an id per screen pixel. It is filled by going through a
+ * frame's draws in order on the CPU, writing each one's id wherever its
+ * atlas texels aren't clear, so a pixel ends up with the id of the draw
+ * that shows there, whatever the shape of the faces and however many levels
+ * are stacked. What the ids mean is up to the caller.
+ *
+ * Clicks are rare next to frames, so the buffer is only filled when someone
+ * asks what is under a pixel, and then answers every question by looking
+ * up the pixel until the screen changes.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef pick_h
+#define pick_h
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "atlas.h"
+#include "draw.h"
+
+/* The id where nothing was drawn. */
+#define PICK_NONE 0
+
+typedef struct {
+        atlas_t *atlas;         /* draws are from this */
+        int w, h;               /* screen */
+        Uint32 *ids;            /* allocated on first use */
+        bool valid;             /* matches the screen */
+} pick_t;
+
+/**
+ * Set up/tear down a buffer for a `w` by `h` screen and draws from `atlas`.
+ */
+void pick_init(pick_t * pick, atlas_t * atlas, int w, int h);
+void pick_deinit(pick_t * pick);
+
+/**
+ * Start filling the buffer, with nothing drawn. Returns 0 or ERROR_ALLOC.
+ */
+int pick_clear(pick_t * pick);
+
+/**
+ * Write a draw's id where it shows. Draws with an alpha mod under 255 are
+ * see-through and leave what's behind them.
+ */
+void pick_draw(pick_t * pick, const draw_t * draw, Uint32 id);
+
+/**
+ * Get the id at a pixel, or PICK_NONE.
+ */
+static inline Uint32 pick_at(const pick_t * pick, int x, int y)
+{
+        if (!pick->ids || x < 0 || y < 0 || x >= pick->w || y >= pick->h) {
+                return PICK_NONE;
+        }
+        return pick->ids[y * pick->w + x];
+}
+
+#endif
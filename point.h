@@ -31,6 +31,7 @@ enum {
                 (l)[Y] = (r)[Y];\
                 (l)[Z] = (r)[Z];\
         } while(0);
+#define point_equal(l, r) ((l)[X] == (r)[X] && (l)[Y] == (r)[Y] && (l)[Z] == (r)[Z])
 
 
 /* Fixed rotations. */
@@ -0,0 +1,131 @@
+/**
+ * A fixed set of worker threads that run batches of numbered jobs.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <string.h>
+
+#include "error.h"
+#include "log.h"
+#include "pool.h"
+
+/* Take jobs from the current batch until there are none left. */
+static void pool_work(pool_t * pool)
+{
+        int job;
+
+        while ((job = SDL_AtomicAdd(&pool->next_job, 1)) < pool->n_jobs) {
+                pool->fn(pool->data, job);
+        }
+}
+
+static int pool_worker(void *data)
+{
+        pool_t *pool = data;
+        uint32_t batch = 0;
+
+        SDL_LockMutex(pool->lock);
+        for (;;) {
+                while (!pool->quit && pool->batch == batch) {
+                        SDL_CondWait(pool->start, pool->lock);
+                }
+                if (pool->quit) {
+                        break;
+                }
+                batch = pool->batch;
+                SDL_UnlockMutex(pool->lock);
+
+                pool_work(pool);
+
+                SDL_LockMutex(pool->lock);
+                if (!--pool->busy) {
+                        SDL_CondSignal(pool->done);
+                }
+        }
+        SDL_UnlockMutex(pool->lock);
+
+        return 0;
+}
+
+int pool_init(pool_t * pool, int n_threads)
+{
+        memset(pool, 0, sizeof (*pool));
+
+        if (n_threads <= 0) {
+                n_threads = SDL_GetCPUCount();
+        }
+        if (n_threads > POOL_MAX_THREADS + 1) {
+                n_threads = POOL_MAX_THREADS + 1;
+        }
+
+        if (!(pool->lock = SDL_CreateMutex()) ||
+            !(pool->start = SDL_CreateCond()) ||
+            !(pool->done = SDL_CreateCond())) {
+                pool_deinit(pool);
+                return ERROR_ALLOC;
+        }
+
+        /* The caller is one of the threads. */
+        for (int i = 0; i < n_threads - 1; i++) {
+                if (!(pool->threads[i] = SDL_CreateThread(pool_worker, "pool",
+                                                          pool))) {
+                        log_error("SDL_CreateThread: %s\n", SDL_GetError());
+                        break;
+                }
+                pool->n_threads++;
+        }
+
+        return 0;
+}
+
+void pool_deinit(pool_t * pool)
+{
+        if (pool->lock) {
+                SDL_LockMutex(pool->lock);
+                pool->quit = true;
+                SDL_CondBroadcast(pool->start);
+                SDL_UnlockMutex(pool->lock);
+        }
+        for (int i = 0; i < pool->n_threads; i++) {
+                SDL_WaitThread(pool->threads[i], NULL);
+        }
+        if (pool->done) {
+                SDL_DestroyCond(pool->done);
+        }
+        if (pool->start) {
+                SDL_DestroyCond(pool->start);
+        }
+        if (pool->lock) {
+                SDL_DestroyMutex(pool->lock);
+        }
+        memset(pool, 0, sizeof (*pool));
+}
+
+void pool_run(pool_t * pool, pool_fn fn, void *data, int n_jobs)
+{
+        if (!pool->n_threads || n_jobs <= 1) {
+                for (int job = 0; job < n_jobs; job++) {
+                        fn(data, job);
+                }
+                return;
+        }
+
+        SDL_LockMutex(pool->lock);
+        pool->fn = fn;
+        pool->data = data;
+        pool->n_jobs = n_jobs;
+        SDL_AtomicSet(&pool->next_job, 0);
+        pool->busy = pool->n_threads;
+        pool->batch++;
+        SDL_CondBroadcast(pool->start);
+        SDL_UnlockMutex(pool->lock);
+
+        pool_work(pool);
+
+        SDL_LockMutex(pool->lock);
+        while (pool->busy) {
+                SDL_CondWait(pool->done, pool->lock);
+        }
+        SDL_UnlockMutex(pool->lock);
+}
@@ -0,0 +1,56 @@
+/**
+ * A fixed set of worker threads that run batches of numbered jobs.
+ *
+ * The thread that starts a batch works on it too, and `pool_run` returns once
+ * every job is done, so a batch is a parallel for-loop over job numbers. Jobs
+ * in a batch must not depend on each other's order.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef pool_h
+#define pool_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+#define POOL_MAX_THREADS 64
+
+typedef void (*pool_fn) (void *data, int job);
+
+typedef struct {
+        SDL_Thread *threads[POOL_MAX_THREADS];
+        int n_threads;
+        SDL_mutex *lock;
+        SDL_cond *start;        /* a new batch is ready */
+        SDL_cond *done;         /* the last worker finished the batch */
+
+        /* The current batch. */
+        pool_fn fn;
+        void *data;
+        int n_jobs;
+        SDL_atomic_t next_job;
+        int busy;               /* workers still on the batch */
+        uint32_t batch;
+        bool quit;
+} pool_t;
+
+/**
+ * Start/stop the workers. `n_threads` counts the caller, so with one every
+ * batch runs on the caller alone; zero or less means one per CPU.
+ */
+int pool_init(pool_t * pool, int n_threads);
+void pool_deinit(pool_t * pool);
+
+/**
+ * Run jobs 0 to n_jobs - 1 and wait for them to finish.
+ */
+void pool_run(pool_t * pool, pool_fn fn, void *data, int n_jobs);
+
+/**
+ * Threads that work on a batch, counting the caller.
+ */
+#define pool_size(p) ((p)->n_threads + 1)
+
+#endif
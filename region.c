@@ -0,0 +1,175 @@
+/**
+ * Rectangle counts over area terrain attributes.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "region.h"
+
+#define clamp(x, a, b) ((x) < (a) ? (a) : ((x) > (b) ? (b) : (x)))
+
+static inline int pixel_attr(pixel_t pixel, int attr)
+{
+        switch (attr) {
+        case REGION_OPAQUE:
+                return PIXEL_IS_OPAQUE(pixel) ? 1 : 0;
+        case REGION_IMPASSABLE:
+                return PIXEL_IS_IMPASSABLE(pixel) ? 1 : 0;
+        default:
+                return pixel ? 1 : 0;
+        }
+}
+
+/* Trees are 1-based with a stride of w + 1. */
+static void tree_add(region_index_t * index, int32_t * tree, int x, int y,
+                     int delta)
+{
+        int stride = index->w + 1;
+        for (int j = y + 1; j <= index->h; j += j & -j) {
+                for (int i = x + 1; i <= index->w; i += i & -i) {
+                        tree[j * stride + i] += delta;
+                }
+        }
+}
+
+/* Sum over [0, x) x [0, y). */
+static int tree_sum(region_index_t * index, int32_t * tree, int x, int y)
+{
+        int stride = index->w + 1;
+        int sum = 0;
+        for (int j = y; j > 0; j -= j & -j) {
+                for (int i = x; i > 0; i -= i & -i) {
+                        sum += tree[j * stride + i];
+                }
+        }
+        return sum;
+}
+
+/* Build in linear time by pushing each node into its parent, first along the
+ * rows and then along the columns. */
+static void tree_build(region_index_t * index, int32_t * tree, int level,
+                       int attr)
+{
+        int stride = index->w + 1;
+
+        for (int y = 0; y < index->h; y++) {
+                for (int x = 0; x < index->w; x++) {
+                        pixel_t pixel =
+                            area_get_pixel(index->area, level, x, y);
+                        tree[(y + 1) * stride + x + 1] =
+                            pixel_attr(pixel, attr);
+                }
+        }
+
+        for (int j = 1; j <= index->h; j++) {
+                for (int i = 1; i <= index->w; i++) {
+                        int p = i + (i & -i);
+                        if (p <= index->w) {
+                                tree[j * stride + p] += tree[j * stride + i];
+                        }
+                }
+        }
+
+        for (int j = 1; j <= index->h; j++) {
+                int p = j + (j & -j);
+                if (p > index->h) {
+                        continue;
+                }
+                for (int i = 1; i <= index->w; i++) {
+                        tree[p * stride + i] += tree[j * stride + i];
+                }
+        }
+}
+
+static void region_on_change(void *data, int level, int x, int y, pixel_t old,
+                             pixel_t pixel)
+{
+        region_index_t *index = data;
+        for (int attr = 0; attr < N_REGION_ATTRS; attr++) {
+                int delta = pixel_attr(pixel, attr) - pixel_attr(old, attr);
+                if (delta) {
+                        tree_add(index, index->trees[level][attr], x, y,
+                                 delta);
+                }
+        }
+}
+
+int region_init(region_index_t * index, area_t * area)
+{
+        size_t n = (area_w(area) + 1) * (area_h(area) + 1);
+
+        memset(index, 0, sizeof (*index));
+        index->area = area;
+        index->w = area_w(area);
+        index->h = area_h(area);
+        index->n_levels = area->n_maps;
+
+        for (int level = 0; level < index->n_levels; level++) {
+                for (int attr = 0; attr < N_REGION_ATTRS; attr++) {
+                        int32_t *tree = calloc(n, sizeof (int32_t));
+                        if (!tree) {
+                                region_deinit(index);
+                                return ERROR_ALLOC;
+                        }
+                        index->trees[level][attr] = tree;
+                        tree_build(index, tree, level, attr);
+                }
+        }
+
+        if (!area_listen(area, region_on_change, index)) {
+                region_deinit(index);
+                return ERROR_ALLOC;
+        }
+
+        return 0;
+}
+
+void region_deinit(region_index_t * index)
+{
+        if (index->area) {
+                area_unlisten(index->area, region_on_change, index);
+        }
+        for (int level = 0; level < N_MAPS; level++) {
+                for (int attr = 0; attr < N_REGION_ATTRS; attr++) {
+                        free(index->trees[level][attr]);
+                }
+        }
+        memset(index, 0, sizeof (*index));
+}
+
+int region_count(region_index_t * index, int level, int attr, int x, int y,
+                 int w, int h)
+{
+        int32_t *tree = index->trees[level][attr];
+        int x0 = clamp(x, 0, index->w);
+        int y0 = clamp(y, 0, index->h);
+        int x1 = clamp(x + w, 0, index->w);
+        int y1 = clamp(y + h, 0, index->h);
+
+        if (x1 <= x0 || y1 <= y0) {
+                return 0;
+        }
+
+        return (tree_sum(index, tree, x1, y1) - tree_sum(index, tree, x0, y1) -
+                tree_sum(index, tree, x1, y0) + tree_sum(index, tree, x0, y0));
+}
+
+bool region_is_passable(region_index_t * index, int level, int x, int y,
+                        int w, int h)
+{
+        /* Tiles off the area can't be passed, so the clipped count of tiles
+         * with terrain has to cover the whole unclipped rectangle. */
+        return (region_count(index, level, REGION_TERRAIN, x, y, w, h) ==
+                w * h &&
+                !region_count(index, level, REGION_IMPASSABLE, x, y, w, h));
+}
+
+size_t region_bytes(region_index_t * index)
+{
+        return ((size_t)index->n_levels * N_REGION_ATTRS * (index->w + 1) *
+                (index->h + 1) * sizeof (int32_t));
+}
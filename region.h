@@ -0,0 +1,62 @@
+/**
+ * Rectangle counts over area terrain attributes.
+ *
+ * Keeps a 2d Fenwick tree per level for each attribute so that "how many
+ * opaque tiles are in this rectangle" costs O(log w * log h) instead of a scan,
+ * and a changed tile costs the same to update. The index listens to the area
+ * and stays current as pixels change.
+ *
+ * The trees are dense: one int32_t per tile, attribute and level, so with all
+ * three attributes that is 12 bytes per tile per level, 48 with four levels.
+ * That is three times the uncompressed maps and much more than compressed
+ * ones, so callers should only build the index if they need it.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef region_h
+#define region_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map.h"
+
+enum {
+        REGION_OPAQUE,
+        REGION_IMPASSABLE,
+        REGION_TERRAIN,         /* any terrain at all */
+        N_REGION_ATTRS
+};
+
+typedef struct {
+        area_t *area;
+        int w, h, n_levels;
+        int32_t *trees[N_MAPS][N_REGION_ATTRS];
+} region_index_t;
+
+/**
+ * Build the index for the area and start listening to it for changes.
+ */
+int region_init(region_index_t * index, area_t * area);
+void region_deinit(region_index_t * index);
+
+/**
+ * Count the tiles with the attribute in the rectangle. The rectangle is
+ * clipped to the area.
+ */
+int region_count(region_index_t * index, int level, int attr, int x, int y,
+                 int w, int h);
+
+/**
+ * True if every tile in the rectangle has passable terrain.
+ */
+bool region_is_passable(region_index_t * index, int level, int x, int y,
+                        int w, int h);
+
+/**
+ * Total bytes used by the trees.
+ */
+size_t region_bytes(region_index_t * index);
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * Pre-rotated copies of the area levels.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "rotmap.h"
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+static void rotmap_on_change(void *data, int level, int x, int y, pixel_t old,
+                             pixel_t pixel)
+{
+        rotmap_t *rotmap = data;
+        point_t mloc = { x, y, 0 }, qloc;
+
+        for (int r = 0; r < N_ROTATIONS; r++) {
+                rotmap_to_rotated(rotmap, r, mloc, qloc);
+                rotmap->planes[r][level][qloc[Y] * rotmap->w[r] + qloc[X]] =
+                    pixel;
+        }
+}
+
+int rotmap_init(rotmap_t * rotmap, area_t * area)
+{
+        memset(rotmap, 0, sizeof (*rotmap));
+        rotmap->area = area;
+
+        for (int r = 0; r < N_ROTATIONS; r++) {
+                point_t corner, qloc, lo = { 0, 0, 0 }, hi = { 0, 0, 0 };
+
+                /* Find the bounds of the rotated area from its corners. */
+                for (int i = 0; i < 4; i++) {
+                        corner[X] = (i & 1) ? area_w(area) - 1 : 0;
+                        corner[Y] = (i & 2) ? area_h(area) - 1 : 0;
+                        rotmap_to_rotated(rotmap, r, corner, qloc);
+                        lo[X] = i ? min(lo[X], qloc[X]) : qloc[X];
+                        lo[Y] = i ? min(lo[Y], qloc[Y]) : qloc[Y];
+                        hi[X] = i ? max(hi[X], qloc[X]) : qloc[X];
+                        hi[Y] = i ? max(hi[Y], qloc[Y]) : qloc[Y];
+                }
+                point_copy(rotmap->origin[r], lo);
+                rotmap->w[r] = hi[X] - lo[X] + 1;
+                rotmap->h[r] = hi[Y] - lo[Y] + 1;
+
+                for (int level = 0; level < area->n_maps; level++) {
+                        pixel_t *plane;
+                        if (!(plane = malloc(rotmap->w[r] * rotmap->h[r] *
+                                             sizeof (pixel_t)))) {
+                                rotmap_deinit(rotmap);
+                                return ERROR_ALLOC;
+                        }
+                        rotmap->planes[r][level] = plane;
+                        for (int y = 0; y < area_h(area); y++) {
+                                for (int x = 0; x < area_w(area); x++) {
+                                        point_t mloc = { x, y, 0 };
+                                        rotmap_to_rotated(rotmap, r, mloc,
+                                                          qloc);
+                                        plane[qloc[Y] * rotmap->w[r] +
+                                              qloc[X]] =
+                                            area_get_pixel(area, level, x, y);
+                                }
+                        }
+                }
+        }
+
+        if (!area_listen(area, rotmap_on_change, rotmap)) {
+                rotmap_deinit(rotmap);
+                return ERROR_ALLOC;
+        }
+
+        return 0;
+}
+
+void rotmap_deinit(rotmap_t * rotmap)
+{
+        if (rotmap->area) {
+                area_unlisten(rotmap->area, rotmap_on_change, rotmap);
+        }
+        for (int r = 0; r < N_ROTATIONS; r++) {
+                for (int level = 0; level < N_MAPS; level++) {
+                        free(rotmap->planes[r][level]);
+                }
+        }
+        memset(rotmap, 0, sizeof (*rotmap));
+}
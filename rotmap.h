@@ -0,0 +1,64 @@
+/**
+ * Pre-rotated copies of the area levels.
+ *
+ * For each rotation, every level is stored as a packed pixel plane laid out
+ * so that walking the view left-to-right, top-to-bottom walks the plane in
+ * memory order. The copies listen to the area and follow its changes.
+ *
+ * A map location m and its rotated location q are related by
+ *
+ *     m = R * (q + origin)
+ *
+ * where R is the rotation matrix, so a camera offset c from the cursor lands
+ * at q = c + rotated(cursor).
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef rotmap_h
+#define rotmap_h
+
+#include "map.h"
+#include "point.h"
+
+typedef struct {
+        area_t *area;
+        int w[N_ROTATIONS], h[N_ROTATIONS];
+        point_t origin[N_ROTATIONS];
+        pixel_t *planes[N_ROTATIONS][N_MAPS];
+} rotmap_t;
+
+/**
+ * Build the rotated copies and start following changes to the area.
+ */
+int rotmap_init(rotmap_t * rotmap, area_t * area);
+void rotmap_deinit(rotmap_t * rotmap);
+
+/**
+ * Convert a map location to rotated plane coordinates. Only (x, y) are
+ * converted.
+ */
+static inline void rotmap_to_rotated(rotmap_t * rotmap, rotation_t r,
+                                     const point_t mloc, point_t qloc)
+{
+        const matrix_t *m = &rotations[r];
+
+        /* The inverse of a rotation is its transpose. */
+        qloc[X] = mloc[X] * (*m)[0][0] + mloc[Y] * (*m)[1][0];
+        qloc[Y] = mloc[X] * (*m)[0][1] + mloc[Y] * (*m)[1][1];
+        qloc[X] -= rotmap->origin[r][X];
+        qloc[Y] -= rotmap->origin[r][Y];
+}
+
+#define rotmap_contains(rm, r, x, y) \
+        (((x) >= 0 && (x) < (rm)->w[r]) && ((y) >= 0 && (y) < (rm)->h[r]))
+
+/**
+ * Get the pixel at the rotated location, which must be valid.
+ */
+static inline pixel_t rotmap_get_pixel(rotmap_t * rotmap, rotation_t r,
+                                       int level, int x, int y)
+{
+        return rotmap->planes[r][level][y * rotmap->w[r] + x];
+}
+
+#endif
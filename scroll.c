@@ -0,0 +1,291 @@
+/**
+ * Reusing the last frame when the view only moved.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "scroll.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+#define SCROLL_FNV_BASIS 14695981039346656037ULL
+#define SCROLL_FNV_PRIME 1099511628211ULL
+
+/* Hash what decides the pixels of a draw moved by (dx, dy). */
+static Uint64 scroll_hash_draw(const draw_t * draw, int dx, int dy)
+{
+        const SDL_Rect *src = &draw->src, *dst = &draw->dst;
+        const SDL_Color *color = &draw->color;
+        Uint32 parts[] = {
+                dst->x + dx, dst->y + dy, dst->w, dst->h,
+                src->x, src->y, src->w, src->h,
+                (Uint32) color->r << 24 | color->g << 16 | color->b << 8 |
+                    color->a
+        };
+        Uint64 hash = SCROLL_FNV_BASIS;
+
+        for (size_t i = 0; i < sizeof (parts) / sizeof (parts[0]); i++) {
+                hash = (hash ^ parts[i]) * SCROLL_FNV_PRIME;
+        }
+        return hash;
+}
+
+/* Hash the draws touching each cell, in order, with the draws moved by
+ * (dx, dy). */
+static void scroll_hash_cells(scroll_t * scroll, Uint64 * hashes,
+                              const draw_list_t * draws, int dx, int dy)
+{
+        int w = scroll->cells.w;
+
+        memset(hashes, 0, cells_count(&scroll->cells) * sizeof (Uint64));
+        for (int i = 0; i < draws->n_draws; i++) {
+                const draw_t *draw = &draws->draws[i];
+                SDL_Rect dst = draw->dst;
+                Uint64 hash;
+                int c0, r0, c1, r1;
+
+                dst.x += dx;
+                dst.y += dy;
+                if (!cells_range(&scroll->cells, &dst, &c0, &r0, &c1, &r1)) {
+                        continue;
+                }
+                hash = scroll_hash_draw(draw, dx, dy);
+                for (int r = r0; r <= r1; r++) {
+                        for (int c = c0; c <= c1; c++) {
+                                Uint64 *cell = &hashes[r * w + c];
+                                *cell = (*cell ^ hash) * SCROLL_FNV_PRIME;
+                        }
+                }
+        }
+}
+
+/* Mark the cells that need drawing again. Returns how many there are. */
+static int scroll_mark(scroll_t * scroll, const draw_list_t * draws, int dx,
+                       int dy)
+{
+        SDL_Rect was = { dx, dy, scroll->w, scroll->h };
+        int marked = 0;
+
+        scroll_hash_cells(scroll, scroll->was, &scroll->last, dx, dy);
+        scroll_hash_cells(scroll, scroll->now, draws, 0, 0);
+
+        for (int r = 0, i = 0; r < scroll->cells.h; r++) {
+                for (int c = 0; c < scroll->cells.w; c++, i++) {
+                        SDL_Rect cell = {
+                                c * CELL_SIZE, r * CELL_SIZE,
+                                min(CELL_SIZE, scroll->w - c * CELL_SIZE),
+                                min(CELL_SIZE, scroll->h - r * CELL_SIZE)
+                        }, kept;
+
+                        /* Cells that were partly off screen come in new. */
+                        SDL_IntersectRect(&cell, &was, &kept);
+                        scroll->cells.marks[i] =
+                            (scroll->was[i] != scroll->now[i] ||
+                             kept.w != cell.w || kept.h != cell.h);
+                        marked += scroll->cells.marks[i];
+                }
+        }
+
+        return marked;
+}
+
+/* Clear the marked cells and draw the frame's draws in them. Returns the
+ * number of SDL calls made. */
+static int scroll_patch(scroll_t * scroll, const draw_list_t * draws)
+{
+        SDL_Renderer *renderer = scroll->renderer;
+        const cells_t *cells = &scroll->cells;
+        SDL_BlendMode mode;
+        int calls = 0;
+
+        SDL_GetRenderDrawBlendMode(renderer, &mode);
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+        for (int r = 0; r < cells->h; r++) {
+                for (int c = 0; c < cells->w;) {
+                        SDL_Rect run;
+                        int end;
+
+                        if (!cells_at(cells, c, r)) {
+                                c++;
+                                continue;
+                        }
+                        end = cells_run_end(cells, r, c, cells->w - 1);
+                        cells_run_rect(r, c, end, &run);
+                        SDL_RenderFillRect(renderer, &run);
+                        calls++;
+                        c = end;
+                }
+        }
+        SDL_SetRenderDrawBlendMode(renderer, mode);
+
+        /* The frame's draws, cut to the runs of marked cells they cross.
+         * Cutting a stretched draw would move where its texels land, so
+         * those are drawn whole with the run as the clip rect instead,
+         * after whatever came before them. */
+        draw_list_clear(&scroll->clipped);
+        for (int i = 0; i < draws->n_draws; i++) {
+                draw_t *draw = &draws->draws[i];
+                bool stretched = (draw->src.w != draw->dst.w ||
+                                  draw->src.h != draw->dst.h);
+                bool touched = false;
+                cells_runs_t runs;
+                SDL_Rect run;
+                draw_t part;
+
+                if (!cells_runs_begin(&runs, cells, &draw->dst)) {
+                        continue;
+                }
+                while (cells_runs_next(&runs, &run)) {
+                        touched = true;
+                        if (!stretched) {
+                                if (draw_clip(draw, &run, &part)) {
+                                        draw_list_append(&scroll->clipped,
+                                                         &part, 1);
+                                }
+                                continue;
+                        }
+                        calls += draw_list_geometry(&scroll->clipped,
+                                                    renderer);
+                        draw_list_clear(&scroll->clipped);
+                        draw_list_append(&scroll->clipped, draw, 1);
+                        SDL_RenderSetClipRect(renderer, &run);
+                        calls += 2 + draw_list_geometry(&scroll->clipped,
+                                                        renderer);
+                        SDL_RenderSetClipRect(renderer, NULL);
+                        draw_list_clear(&scroll->clipped);
+                }
+                scroll->scrolled_draws += touched;
+        }
+
+        return calls + draw_list_geometry(&scroll->clipped, renderer);
+}
+
+int scroll_init(scroll_t * scroll, SDL_Renderer * renderer,
+                SDL_Texture * texture, draw_state_t * state, int screen_w,
+                int screen_h)
+{
+        SDL_RendererInfo info;
+
+        memset(scroll, 0, sizeof (*scroll));
+
+        if (SDL_GetRendererInfo(renderer, &info) ||
+            !(info.flags & SDL_RENDERER_TARGETTEXTURE)) {
+                return -1;
+        }
+
+        scroll->renderer = renderer;
+        scroll->w = screen_w;
+        scroll->h = screen_h;
+
+        if (cells_init(&scroll->cells, screen_w, screen_h) ||
+            !(scroll->was = malloc(cells_count(&scroll->cells) *
+                                   sizeof (Uint64))) ||
+            !(scroll->now = malloc(cells_count(&scroll->cells) *
+                                   sizeof (Uint64))) ||
+            draw_list_init(&scroll->last, texture, NULL) ||
+            draw_list_init(&scroll->clipped, texture, state)) {
+                scroll_deinit(scroll);
+                return ERROR_ALLOC;
+        }
+
+        return 0;
+}
+
+void scroll_deinit(scroll_t * scroll)
+{
+        for (int i = 0; i < 2; i++) {
+                if (scroll->frames[i]) {
+                        SDL_DestroyTexture(scroll->frames[i]);
+                }
+        }
+        free(scroll->was);
+        free(scroll->now);
+        cells_deinit(&scroll->cells);
+        draw_list_deinit(&scroll->last);
+        draw_list_deinit(&scroll->clipped);
+        memset(scroll, 0, sizeof (*scroll));
+}
+
+void scroll_reset(scroll_t * scroll)
+{
+        scroll->valid = false;
+}
+
+void scroll_lost(scroll_t * scroll, SDL_Texture * texture)
+{
+        for (int i = 0; i < 2; i++) {
+                if (scroll->frames[i]) {
+                        SDL_DestroyTexture(scroll->frames[i]);
+                        scroll->frames[i] = NULL;
+                }
+        }
+        scroll->valid = false;
+        draw_list_set_texture(&scroll->last, texture);
+        draw_list_set_texture(&scroll->clipped, texture);
+}
+
+int scroll_draw(scroll_t * scroll, draw_list_t * draws, bool moved, int dx,
+                int dy)
+{
+        SDL_Renderer *renderer = scroll->renderer;
+        int next = !scroll->shown, calls = 0;
+
+        for (int i = 0; i < 2; i++) {
+                if (scroll->frames[i]) {
+                        continue;
+                }
+                if (!(scroll->frames[i] =
+                      SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                        SDL_TEXTUREACCESS_TARGET, scroll->w,
+                                        scroll->h))) {
+                        /* Draw it all straight to the screen instead. */
+                        scroll->valid = false;
+                        return draw_list_geometry(draws, renderer);
+                }
+                SDL_SetTextureBlendMode(scroll->frames[i], SDL_BLENDMODE_NONE);
+        }
+
+        SDL_SetRenderTarget(renderer, scroll->frames[next]);
+        if (moved && scroll->valid && abs(dx) < scroll->w &&
+            abs(dy) < scroll->h) {
+                SDL_Rect bounds = { 0, 0, scroll->w, scroll->h }, src, dst;
+                int marked = scroll_mark(scroll, draws, dx, dy);
+
+                dst.x = dx;
+                dst.y = dy;
+                dst.w = scroll->w;
+                dst.h = scroll->h;
+                SDL_IntersectRect(&dst, &bounds, &dst);
+                src = dst;
+                src.x -= dx;
+                src.y -= dy;
+                SDL_RenderCopy(renderer, scroll->frames[scroll->shown], &src,
+                               &dst);
+                calls = 1 + scroll_patch(scroll, draws);
+
+                scroll->scrolled++;
+                scroll->marked_cells += marked;
+                scroll->clean_cells += cells_count(&scroll->cells) - marked;
+        } else {
+                SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+                SDL_RenderClear(renderer);
+                calls = 1 + draw_list_geometry(draws, renderer);
+                scroll->redrawn++;
+        }
+        SDL_SetRenderTarget(renderer, NULL);
+        SDL_RenderCopy(renderer, scroll->frames[next], NULL, NULL);
+
+        scroll->shown = next;
+        scroll->valid = true;
+
+        /* Keep the draws to tell what changed in the next frame. */
+        draw_list_clear(&scroll->last);
+        draw_list_append(&scroll->last, draws->draws, draws->n_draws);
+
+        return calls + 1;
+}
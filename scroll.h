@@ -0,0 +1,82 @@
+/**
+ * Reusing the last frame when the view only moved.
+ *
+ * Frames are drawn into one of two target textures and copied to the screen
+ * from there, so the last one is still around when the next is drawn. If
+ * the view only slid across the screen since, the next frame starts as a
+ * copy of the last one moved by as much, and only the screen cells that
+ * don't look the same are drawn again.
+ *
+ * Which cells look the same is found from the draws. Each cell gets a hash
+ * of the draws that touch it, in order, for this frame and for the last one
+ * moved. A cell with the same hash both times, that was all on screen last
+ * time, gets the same pixels. That covers the edges coming into view, the
+ * cursor, and whatever the fov, cutaways or transparency changed, without
+ * having to know about any of them. The other cells are cleared and get the
+ * frame's draws, clipped to them.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef scroll_h
+#define scroll_h
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "cells.h"
+#include "draw.h"
+
+typedef struct {
+        SDL_Renderer *renderer;
+        SDL_Texture *frames[2]; /* created on first use */
+        int shown;              /* which one has the last frame */
+        bool valid;             /* if it does */
+        int w, h;               /* screen */
+
+        /* The screen cells, marked where drawn again. */
+        cells_t cells;
+        Uint64 *was, *now;      /* hashes of the draws touching each */
+
+        draw_list_t last;       /* the last frame's draws */
+        draw_list_t clipped;    /* this frame's draws in the marked cells */
+
+        /* Statistics. */
+        int scrolled, redrawn;  /* frames */
+        Uint64 clean_cells, marked_cells;
+        Uint64 scrolled_draws;  /* drawn again, in part, when scrolled */
+} scroll_t;
+
+/**
+ * Set up/tear down frames for a `screen_w` by `screen_h` screen, with draws
+ * from `texture` and texture mods tracked with `state`, which may be NULL.
+ * Returns -1 if the renderer can't draw to textures, or ERROR_ALLOC.
+ */
+int scroll_init(scroll_t * scroll, SDL_Renderer * renderer,
+                SDL_Texture * texture, draw_state_t * state, int screen_w,
+                int screen_h);
+void scroll_deinit(scroll_t * scroll);
+
+/**
+ * Forget the last frame, like after the renderer lost what was drawn into
+ * its textures.
+ */
+void scroll_reset(scroll_t * scroll);
+
+/**
+ * Drop the frame textures, like after the renderer lost every texture, and
+ * take draws from `texture` instead. The frames are made again when next
+ * drawn.
+ */
+void scroll_lost(scroll_t * scroll, SDL_Texture * texture);
+
+/**
+ * Draw a frame to the screen. If `moved` is true the view slid by (dx, dy)
+ * pixels since the last frame, and whatever still looks the same is kept
+ * from it; otherwise all of it is drawn. Returns the number of SDL calls
+ * made.
+ */
+int scroll_draw(scroll_t * scroll, draw_list_t * draws, bool moved, int dx,
+                int dy);
+
+#endif
@@ -0,0 +1,263 @@
+/**
+ * Models drawn ahead of time as one image each.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "sprite.h"
+
+/* Clear pixels after each slot. */
+#define SPRITE_PAD 1
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+#define sprite_pixel(s, x, y) \
+        (((Uint32 *) ((Uint8 *) (s)->pixels + (y) * (s)->pitch))[x])
+
+/* Find the box some faces of a model cover, relative to the tile's top
+ * left on screen. */
+static void sprite_bounds(const model_t * model, int faces, SDL_Rect * box)
+{
+        int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+        bool first = true;
+
+        for (int f = 0; f < N_MODEL_FACES; f++) {
+                const SDL_Rect *offset = &model->offsets[f];
+
+                if (!(faces & (1 << f))) {
+                        continue;
+                }
+                if (first) {
+                        x0 = offset->x;
+                        y0 = -offset->y;
+                        x1 = x0 + offset->w;
+                        y1 = y0 + offset->h;
+                        first = false;
+                } else {
+                        x0 = min(x0, offset->x);
+                        y0 = min(y0, -offset->y);
+                        x1 = max(x1, offset->x + offset->w);
+                        y1 = max(y1, -offset->y + offset->h);
+                }
+        }
+
+        box->x = x0;
+        box->y = y0;
+        box->w = x1 - x0;
+        box->h = y1 - y0;
+}
+
+/* Check that every texel of a model's faces is clear or opaque. */
+static bool sprite_is_solid(const atlas_t * atlas, const model_t * model)
+{
+        for (int f = 0; f < N_MODEL_FACES; f++) {
+                const SDL_Rect *src = &model->srcs[f];
+                for (int y = src->y; y < src->y + src->h; y++) {
+                        const Uint8 *alpha = &atlas->alpha[y * atlas->w];
+                        for (int x = src->x; x < src->x + src->w; x++) {
+                                if (alpha[x] && alpha[x] != 255) {
+                                        return false;
+                                }
+                        }
+                }
+        }
+        return true;
+}
+
+/* Put the faces for `key` together in a slot, in the order they would be
+ * drawn, and send it to the texture. */
+static int sprite_build(sprite_cache_t * cache, sprite_t * sprite, int key)
+{
+        atlas_t *atlas = cache->atlas;
+        SDL_Surface *sheet = atlas->sheet;
+        const model_t *model = &cache->models[key / SPRITE_FACES];
+        int faces = key % SPRITE_FACES;
+        Uint32 amask = sheet->format->Amask;
+        SDL_Rect box, slot;
+
+        slot.x = sprite->src.x;
+        slot.y = sprite->src.y;
+        slot.w = cache->slot_w;
+        slot.h = cache->slot_h;
+        for (int y = slot.y; y < slot.y + slot.h; y++) {
+                memset(&sprite_pixel(sheet, slot.x, y), 0, slot.w * 4);
+        }
+
+        sprite_bounds(model, faces, &box);
+        for (int f = 0; f < N_MODEL_FACES; f++) {
+                const SDL_Rect *src = &model->srcs[f];
+                int x = slot.x + model->offsets[f].x - box.x;
+                int y = slot.y - model->offsets[f].y - box.y;
+
+                if (!(faces & (1 << f))) {
+                        continue;
+                }
+                for (int v = 0; v < src->h; v++) {
+                        for (int u = 0; u < src->w; u++) {
+                                Uint32 texel = sprite_pixel(sheet, src->x + u,
+                                                            src->y + v);
+                                if (texel & amask) {
+                                        sprite_pixel(sheet, x + u, y + v) =
+                                            texel;
+                                }
+                        }
+                }
+        }
+
+        sprite->src.w = box.w;
+        sprite->src.h = box.h;
+        sprite->dx = box.x;
+        sprite->dy = box.y;
+
+        return atlas_update(atlas, &slot);
+}
+
+/* Pick the slot to build in: a free one, or else the one unused for
+ * longest. Returns -1 if they were all drawn from this frame. */
+static int sprite_victim(sprite_cache_t * cache)
+{
+        int best = -1, oldest = cache->frame;
+
+        for (int i = 0; i < cache->n_slots; i++) {
+                sprite_t *sprite = &cache->slots[i];
+                int used = SDL_AtomicGet(&sprite->used);
+
+                if (sprite->key < 0) {
+                        return i;
+                }
+                if (used < oldest) {
+                        oldest = used;
+                        best = i;
+                }
+        }
+        return best;
+}
+
+int sprite_cache_init(sprite_cache_t * cache, atlas_t * atlas,
+                      const model_t * models, int n_models)
+{
+        int n_keys = n_models * SPRITE_FACES, cols, rows;
+
+        memset(cache, 0, sizeof (*cache));
+        cache->atlas = atlas;
+        cache->models = models;
+        cache->n_models = n_models;
+
+        if (!atlas->spare.h) {
+                return -1;
+        }
+
+        /* Every sprite fits in a slot big enough for all of the faces of
+         * the biggest model. */
+        for (int m = 0; m < n_models; m++) {
+                SDL_Rect box;
+                sprite_bounds(&models[m], SPRITE_ALL_FACES, &box);
+                cache->slot_w = max(cache->slot_w, box.w);
+                cache->slot_h = max(cache->slot_h, box.h);
+        }
+        cols = atlas->spare.w / (cache->slot_w + SPRITE_PAD);
+        rows = atlas->spare.h / (cache->slot_h + SPRITE_PAD);
+        if (!(cache->n_slots = min(cols * rows, SPRITE_SLOTS))) {
+                return -1;
+        }
+
+        if (!(cache->solid = calloc(n_models, sizeof (bool))) ||
+            !(cache->slots = calloc(cache->n_slots, sizeof (sprite_t))) ||
+            !(cache->index = malloc(n_keys * sizeof (int))) ||
+            !(cache->wanted = calloc(n_keys, sizeof (SDL_atomic_t)))) {
+                sprite_cache_deinit(cache);
+                return ERROR_ALLOC;
+        }
+
+        for (int m = 0; m < n_models; m++) {
+                cache->solid[m] = sprite_is_solid(atlas, &models[m]);
+        }
+        for (int i = 0; i < n_keys; i++) {
+                cache->index[i] = -1;
+        }
+        for (int i = 0; i < cache->n_slots; i++) {
+                sprite_t *sprite = &cache->slots[i];
+                sprite->src.x = atlas->spare.x +
+                    (i % cols) * (cache->slot_w + SPRITE_PAD);
+                sprite->src.y = atlas->spare.y +
+                    (i / cols) * (cache->slot_h + SPRITE_PAD);
+                sprite->key = -1;
+                sprite->used.value = -1;
+        }
+
+        return 0;
+}
+
+void sprite_cache_deinit(sprite_cache_t * cache)
+{
+        free(cache->solid);
+        free(cache->slots);
+        free(cache->index);
+        free(cache->wanted);
+        memset(cache, 0, sizeof (*cache));
+}
+
+const sprite_t *sprite_get(sprite_cache_t * cache, int model, int faces)
+{
+        int key = model * SPRITE_FACES + faces, slot;
+        sprite_t *sprite;
+
+        if (!faces || !cache->solid[model]) {
+                return NULL;
+        }
+        if ((slot = cache->index[key]) < 0) {
+                SDL_AtomicSet(&cache->wanted[key], 1);
+                SDL_AtomicAdd(&cache->misses, 1);
+                return NULL;
+        }
+
+        sprite = &cache->slots[slot];
+        SDL_AtomicSet(&sprite->used, cache->frame);
+        SDL_AtomicAdd(&cache->hits, 1);
+        return sprite;
+}
+
+void sprite_cache_update(sprite_cache_t * cache)
+{
+        int n_keys = cache->n_models * SPRITE_FACES;
+
+        for (int key = 0; key < n_keys; key++) {
+                sprite_t *sprite;
+                int slot;
+
+                if (!SDL_AtomicGet(&cache->wanted[key])) {
+                        continue;
+                }
+
+                /* Keep wanting it if there is no room this frame. */
+                if ((slot = sprite_victim(cache)) < 0) {
+                        break;
+                }
+                SDL_AtomicSet(&cache->wanted[key], 0);
+
+                sprite = &cache->slots[slot];
+                if (sprite->key >= 0) {
+                        cache->index[sprite->key] = -1;
+                        cache->evictions++;
+                }
+                sprite->key = -1;
+                SDL_AtomicSet(&sprite->used, -1);
+
+                if (sprite_build(cache, sprite, key)) {
+                        /* Draw its faces from now on. */
+                        cache->solid[key / SPRITE_FACES] = false;
+                        continue;
+                }
+                sprite->key = key;
+                SDL_AtomicSet(&sprite->used, cache->frame);
+                cache->index[key] = slot;
+                cache->builds++;
+        }
+
+        cache->frame++;
+}
@@ -0,0 +1,82 @@
+/**
+ * Models drawn ahead of time as one image each.
+ *
+ * A model is three faces, so three draws per tile. Putting its faces
+ * together once, in the spare rows of the atlas, makes that one draw from
+ * the same texture, which still batches with everything else. The faces
+ * only ever replace what is under them or leave it alone, as long as every
+ * texel is clear or opaque, so a sprite tinted with a color mod looks
+ * exactly like its faces tinted the same way. The tint is left out of the
+ * key, and one sprite serves every color. Models with partly clear texels
+ * don't get sprites, and see-through draws don't use them, since the
+ * faces would blend over each other.
+ *
+ * There are as many slots as fit in the spare rows, up to SPRITE_SLOTS.
+ * Looking up a sprite is safe from any thread and never makes one. Misses
+ * are remembered and made by sprite_cache_update() between frames, in the
+ * slots unused for longest, but never one drawn from in the frame being
+ * finished.
+ *
+ * Copyright (c) 2019 Gordon McNutt
+ */
+#ifndef sprite_h
+#define sprite_h
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "atlas.h"
+#include "model.h"
+
+#define SPRITE_SLOTS 32
+
+/* Face combinations, a bit per MODEL_FACE_*. */
+#define SPRITE_FACES (1 << N_MODEL_FACES)
+#define SPRITE_ALL_FACES (SPRITE_FACES - 1)
+
+typedef struct {
+        SDL_Rect src;           /* in the atlas */
+        int dx, dy;             /* from the tile's top left on screen */
+        int key;                /* model * SPRITE_FACES + faces, or -1 */
+        SDL_atomic_t used;      /* frame it was last drawn in */
+} sprite_t;
+
+typedef struct {
+        atlas_t *atlas;
+        const model_t *models;
+        int n_models;
+        bool *solid;            /* per model: texels all clear or opaque */
+
+        sprite_t *slots;
+        int n_slots;
+        int slot_w, slot_h;
+        int *index;             /* per key: slot, or -1 */
+        SDL_atomic_t *wanted;   /* per key: missed since the last update */
+        int frame;
+
+        /* Statistics. */
+        SDL_atomic_t hits, misses;
+        int builds, evictions;
+} sprite_cache_t;
+
+/**
+ * Set up/tear down sprites for `n_models` models drawn from `atlas`. Returns
+ * -1 if the atlas has no room for sprites, or ERROR_ALLOC.
+ */
+int sprite_cache_init(sprite_cache_t * cache, atlas_t * atlas,
+                      const model_t * models, int n_models);
+void sprite_cache_deinit(sprite_cache_t * cache);
+
+/**
+ * Get the sprite for some faces of a model, or NULL to draw the faces
+ * instead.
+ */
+const sprite_t *sprite_get(sprite_cache_t * cache, int model, int faces);
+
+/**
+ * Make the sprites that were missed, after the frame's last lookup.
+ */
+void sprite_cache_update(sprite_cache_t * cache);
+
+#endif
@@ -13,21 +13,33 @@ int view_init(view_t * view, area_t * maps, bool use_fov)
 
         view->n_fovs = maps->n_maps;
 
+        for (int r = 0; r < N_ROTATIONS; r++) {
+                for (int y = 0, index = 0; y < VIEW_H; y++) {
+                        for (int x = 0; x < VIEW_W; x++, index++) {
+                                point_t cam = { x, y, 0 };
+                                view_to_camera(cam, cam);
+                                point_rotate(cam, r);
+                                view->offsets[r][index].x = cam[X];
+                                view->offsets[r][index].y = cam[Y];
+                        }
+                }
+        }
+
         for (int i = 0; i < view->n_fovs; i++) {
                 fov_map_t *fov = &view->fovs[i];
-                map_t *map = maps->maps[i];
-                view->fov_w = map_w(map);
-                view->fov_h = map_h(map);
+                view->fov_w = area_w(maps);
+                view->fov_h = area_h(maps);
 
-                if ((res = fov_init(fov, map_w(map), map_h(map)))) {
+                if ((res = fov_init(fov, area_w(maps), area_h(maps)))) {
                         view_deinit(view);
                         return res;
                 }
 
                 if (use_fov) {
-                        for (size_t y = 0, index = 0; y < map_h(map); y++) {
-                                for (size_t x = 0; x < map_w(map); x++, index++) {
-                                        if (map_opaque_at(map, x, y)) {
+                        for (int y = 0, index = 0; y < area_h(maps); y++) {
+                                for (int x = 0; x < area_w(maps); x++, index++) {
+                                        if (area_get_pixel(maps, i, x, y) &
+                                            PIXEL_MASK_OPAQUE) {
                                                 fov->opq[index] = 1;
                                         }
                                 }
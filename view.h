@@ -8,6 +8,7 @@
 #define view_header
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "fov.h"
 #include "point.h"
@@ -21,9 +22,15 @@
  * screen. */
 #define VIEW_OFFSET ((VIEW_H - 1) * TILE_WIDTH_HALF)
 
+/* Where a view tile is on the map, relative to the cursor. */
+typedef struct {
+        int8_t x, y;
+} view_offset_t;
+
 typedef struct {
         point_t cursor;
         rotation_t rotation;
+        view_offset_t offsets[N_ROTATIONS][VIEW_H * VIEW_W];
         fov_map_t fovs[N_MAPS]; /* one per map */
         int n_fovs;
         int fov_w;
@@ -61,6 +68,17 @@ static inline void view_to_map(view_t * view, point_t vloc, point_t mloc)
         mloc[Y] += view->cursor[Y];
 }
 
+/**
+ * Like `view_to_map` for the view tile at `index`, counting across the rows
+ * from the top left, but with a table lookup instead of a rotation.
+ */
+static inline void view_index_to_map(view_t * view, int index, point_t mloc)
+{
+        const view_offset_t *offset = &view->offsets[view->rotation][index];
+        mloc[X] = view->cursor[X] + offset->x;
+        mloc[Y] = view->cursor[Y] + offset->y;
+}
+
 bool view_in_fov(view_t *view, point_t maploc);
 
 #endif